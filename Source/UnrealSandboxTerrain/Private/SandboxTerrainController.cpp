@@ -15,13 +15,41 @@
 
 bool LoadDataFromKvFile(TKvFile& KvFile, const TVoxelIndex& Index, std::function<void(TArray<uint8>&)> Function);
 
+bool LoadViewFromKvFile(TKvFile& KvFile, const TVoxelIndex& Index, std::function<void(const kvdb::TValueView&)> Function);
+
+void LogKvFileCacheStats(const TKvFile& KvFile, const TCHAR* Name);
+
 void SerializeMeshData(TMeshData const * MeshDataPtr, TArray<uint8>& CompressedData);
 
-void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData);
+void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData);
+
+void serializeVoxelDataPatch(TVoxelData& vd, int min_x, int max_x, std::vector<kvdb::TPatch>& patchList);
 
 void deserializeVoxelData(TVoxelData &vd, FMemoryReader& binaryData);
 
-void deserializeVoxelData2(TVoxelData* vd, TArray<uint8>& Data, bool createSubstanceCache);
+void deserializeVoxelData2(TVoxelData* vd, const uint8* Data, bool createSubstanceCache);
+
+#define USBT_PREFETCH_DEPTH 32
+
+// terrain files in map save directory
+#define USBT_FILE_VD		TEXT("terrain_voxeldata.dat")
+#define USBT_FILE_MD		TEXT("terrain_mesh.dat")
+#define USBT_FILE_OBJ		TEXT("terrain_objects.dat")
+#define USBT_FILE_TERRAIN	TEXT("terrain.dat")
+#define USBT_BACKUP_DIR		TEXT("Backup/")
+#define USBT_STATS_FILE		TEXT("storage_stats.csv")
+#define USBT_REGION_DIR		TEXT("Regions/")
+
+// region files: cube of zones per file, closed after minute without access
+#define USBT_REGION_ZONES		(int32)(USBT_REGION_SIZE / USBT_ZONE_SIZE)
+#define USBT_REGION_IDLE_TIME	60000
+
+// columns of single terrain file
+#define USBT_COLUMN_VD	0
+#define USBT_COLUMN_MD	1
+#define USBT_COLUMN_OBJ	2
+
+#define USBT_SAVE_BATCH_SIZE (64 * 1024 * 1024)
 
 
 class FAsyncThread : public FRunnable {
@@ -106,6 +134,14 @@ ASandboxTerrainController::ASandboxTerrainController(const FObjectInitializer& O
 	TerrainSizeZ = 5;
 	bEnableLOD = false;
 	SaveGeneratedZones = 1000;
+	bMemoryMappedStorage = false;
+	bWriteAheadLog = false;
+	StorageCacheSizeMb = 0;
+	bCompressedStorage = false;
+	VoxelDataStorage = ETerrainVoxelDataStorage::TVS_Whole;
+	bSingleFileStorage = false;
+	bRegionFileStorage = false;
+	bDumpStorageStatsOnSave = false;
 
 	ServerPort = 6000;
 
@@ -121,6 +157,14 @@ ASandboxTerrainController::ASandboxTerrainController() {
 	TerrainSizeZ = 5;
 	bEnableLOD = false;
 	SaveGeneratedZones = 1000;
+	bMemoryMappedStorage = false;
+	bWriteAheadLog = false;
+	StorageCacheSizeMb = 0;
+	bCompressedStorage = false;
+	VoxelDataStorage = ETerrainVoxelDataStorage::TVS_Whole;
+	bSingleFileStorage = false;
+	bRegionFileStorage = false;
+	bDumpStorageStatsOnSave = false;
 
 	ServerPort = 6000;
 
@@ -168,6 +212,14 @@ void ASandboxTerrainController::EndPlay(const EEndPlayReason::Type EndPlayReason
 
 	Save();
 
+	if (VdFile.isColumn()) {
+		LogKvFileCacheStats(VdFile, TEXT("terrain data"));
+	} else {
+		LogKvFileCacheStats(VdFile, TEXT("voxel data"));
+		LogKvFileCacheStats(MdFile, TEXT("mesh data"));
+		LogKvFileCacheStats(ObjFile, TEXT("objects data"));
+	}
+
 	VdFile.close();
 	MdFile.close();
 	ObjFile.close();
@@ -217,37 +269,81 @@ void ASandboxTerrainController::BeginServer() {
 	bIsGeneratingTerrain = true;
 	LoadJson();
 
+	// zones stored in file are registered at once, so spawn does not probe file for each index
+	std::vector<TVoxelIndex> StoredIndexList = VdFile.keys(true);
+	for (const TVoxelIndex& Index : StoredIndexList) {
+		TVoxelDataInfo VdInfo;
+		VdInfo.DataState = TVoxelDataState::READY_TO_LOAD;
+		RegisterTerrainVoxelData(VdInfo, Index);
+	}
+
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Stored zones ----> %d"), (int32)StoredIndexList.size());
+
 	SpawnInitialZone();
 	// async loading other zones
-	RunThread([&](FAsyncThread& ThisThread) {
+	RunThread([&, StoredIndexList](FAsyncThread& ThisThread) {
 		if (!bGenerateOnlySmallSpawnPoint) {
-			int Total = (TerrainSizeX * 2 + 1) * (TerrainSizeY * 2 + 1) * (TerrainSizeZ * 2 + 1);
-			int Progress = 0;
+			const int s = static_cast<int>(TerrainInitialArea);
+			auto IsInitialZone = [&](const TVoxelIndex& Index) {
+				return FMath::Abs(Index.X) <= s && FMath::Abs(Index.Y) <= s && FMath::Abs(Index.Z) <= s;
+			};
+
+			auto IsInsideTerrain = [&](const TVoxelIndex& Index) {
+				return FMath::Abs(Index.X) <= TerrainSizeX && FMath::Abs(Index.Y) <= TerrainSizeY && FMath::Abs(Index.Z) <= TerrainSizeZ;
+			};
+
+			// stored zones first, in disk order. then zones to generate
+			TArray<TVoxelIndex> IndexList;
+			IndexList.Reserve((TerrainSizeX * 2 + 1) * (TerrainSizeY * 2 + 1) * (TerrainSizeZ * 2 + 1));
+			for (const TVoxelIndex& Index : StoredIndexList) {
+				if (IsInsideTerrain(Index) && !IsInitialZone(Index)) {
+					IndexList.Add(Index);
+				}
+			}
 
 			for (int x = -TerrainSizeX; x <= TerrainSizeX; x++) {
 				for (int y = -TerrainSizeY; y <= TerrainSizeY; y++) {
 					for (int z = -TerrainSizeZ; z <= TerrainSizeZ; z++) {
-						TVoxelIndex Index(x, y, z);
-						if (ThisThread.IsNotValid()) return;
-
+						const TVoxelIndex Index(x, y, z);
 						if (!HasVoxelData(Index)) {
-							SpawnZone(Index);
+							IndexList.Add(Index);
 						}
+					}
+				}
+			}
 
-						Progress++;
-						GeneratingProgress = (float)Progress / (float)Total;
-						// must invoke in main thread
-						//OnProgressBuildTerrain(PercentProgress);
+			const int Total = IndexList.Num();
+			int Progress = 0;
 
-						if (GeneratedVdConter > SaveGeneratedZones) {
-							TControllerTaskTaskPtr TaskPtr = InvokeSafe([=]() { Save(); });
-							TControllerTask::WaitForFinish(TaskPtr.get());
-							GeneratedVdConter = 0;
-						}
+			// mesh data of next zones is read into cache on I/O threads while current zone is processed,
+			// LoadMeshDataByIndex takes it from cache
+			const int PrefetchDepth = (StorageCacheSizeMb > 0) ? USBT_PREFETCH_DEPTH : 0;
+			for (int I = 0; I < PrefetchDepth && I < IndexList.Num(); I++) {
+				MdFile.prefetch(IndexList[I]);
+			}
 
-						if (ThisThread.IsNotValid()) return;
-					}
+			for (int I = 0; I < IndexList.Num(); I++) {
+				const TVoxelIndex& Index = IndexList[I];
+				if (ThisThread.IsNotValid()) return;
+
+				if (PrefetchDepth > 0 && I + PrefetchDepth < IndexList.Num()) {
+					MdFile.prefetch(IndexList[I + PrefetchDepth]);
 				}
+
+				SpawnZone(Index);
+
+				Progress++;
+				GeneratingProgress = (float)Progress / (float)Total;
+				// must invoke in main thread
+				//OnProgressBuildTerrain(PercentProgress);
+
+				if (GeneratedVdConter > SaveGeneratedZones) {
+					TControllerTaskTaskPtr TaskPtr = InvokeSafe([=]() { Save(); });
+					TControllerTask::WaitForFinish(TaskPtr.get());
+					GeneratedVdConter = 0;
+				}
+
+				if (ThisThread.IsNotValid()) return;
 			}
 		}
 
@@ -274,27 +370,73 @@ void ASandboxTerrainController::BeginClient() {
 
 void ASandboxTerrainController::NetworkSerializeVd(FBufferArchive& Buffer, const TVoxelIndex& VoxelIndex) {
 	TVoxelDataInfo* VoxelDataInfo = GetVoxelDataInfo(VoxelIndex);
-	// TODO: shared lock Vd
 	if (VoxelDataInfo) {
 		if (VoxelDataInfo->DataState == TVoxelDataState::READY_TO_LOAD) {
 			TVoxelData* Vd = LoadVoxelDataByIndex(VoxelIndex);
 			serializeVoxelData(*Vd, Buffer);
 			delete Vd;
 		} else if (VoxelDataInfo->DataState == TVoxelDataState::LOADED)  {
-			serializeVoxelData(*VoxelDataInfo->Vd, Buffer);
+			// send stable copy while zone may be edited
+			VoxelDataInfo->Vd->vd_edit_mutex.lock();
+			std::shared_ptr<TVoxelData> Snapshot = VoxelDataInfo->Vd->snapshot();
+			VoxelDataInfo->Vd->vd_edit_mutex.unlock();
+
+			serializeVoxelData(*Snapshot, Buffer);
 		}
 
 	}
 }
 
+// collects pairs and writes them to file with one saveBatch call per USBT_SAVE_BATCH_SIZE bytes
+class TKvFileSaveBatch {
+
+private:
+	TKvFile& KvFile;
+
+	std::vector<std::pair<TVoxelIndex, TValueData>> Batch;
+
+	size_t BatchSize = 0;
+
+public:
+	TKvFileSaveBatch(TKvFile& File) : KvFile(File) { }
+
+	~TKvFileSaveBatch() {
+		Flush();
+	}
+
+	void Add(const TVoxelIndex& Index, const uint8* Data, int32 Size) {
+		Batch.push_back({ Index, TValueData(Data, Data + Size) });
+		BatchSize += Size;
+
+		if (BatchSize >= USBT_SAVE_BATCH_SIZE) {
+			Flush();
+		}
+	}
+
+	void Flush() {
+		if (Batch.size() > 0) {
+			if (!KvFile.saveBatch(Batch)) {
+				UE_LOG(LogSandboxTerrain, Warning, TEXT("Save batch: some values are not saved"));
+			}
+			Batch.clear();
+			BatchSize = 0;
+		}
+	}
+};
+
 void ASandboxTerrainController::Save() {
 	UE_LOG(LogSandboxTerrain, Log, TEXT("Start save terrain data..."));
 
 	double Start = FPlatformTime::Seconds();
 	uint32 SavedVd = 0;
+	uint32 PatchedVd = 0;
 	uint32 SavedMd = 0;
 	uint32 SavedObj = 0;
 
+	TKvFileSaveBatch VdBatch(VdFile);
+	TKvFileSaveBatch MdBatch(MdFile);
+	TKvFileSaveBatch ObjBatch(ObjFile);
+
 	for (auto& It : VoxelDataIndexMap) {
 		TVoxelDataInfo& VdInfo = VoxelDataIndexMap[It.first];
 
@@ -302,29 +444,41 @@ void ASandboxTerrainController::Save() {
 			continue;
 		}
 
-		//============================================
-		// TODO remove
-		// test
-		FBufferArchive TempBufferVd;
-		TValueData buffer;
-
-		serializeVoxelData(*VdInfo.Vd, TempBufferVd);
-		buffer.reserve(TempBufferVd.Num());
-
-		for (uint8 b : TempBufferVd) {
-			buffer.push_back(b);
-		}
-
-		TVoxelIndex Index = GetZoneIndex(VdInfo.Vd->getOrigin());
 		if (VdInfo.Vd->isChanged()) {
-			VdFile.save(Index, buffer);
+			// serialize stable copy, zone edit doesn't wait for file
+			VdInfo.Vd->vd_edit_mutex.lock();
+			std::shared_ptr<TVoxelData> Snapshot = VdInfo.Vd->snapshot();
 			VdInfo.Vd->resetLastSave();
+			VdInfo.Vd->resetDirty();
+			VdInfo.Vd->vd_edit_mutex.unlock();
+
+			TVoxelIndex Index = GetZoneIndex(Snapshot->getOrigin());
+
+			// write only changed planes over stored data of the same layout.
+			// zone stored compressed before patches were enabled is saved whole once
+			bool bIsPatched = false;
+			int MinX, MaxX;
+			if (VoxelDataStorage == ETerrainVoxelDataStorage::TVS_Patched && !Snapshot->isLayoutChanged() && Snapshot->getDirtyRange(MinX, MaxX)) {
+				std::vector<kvdb::TPatch> PatchList;
+				serializeVoxelDataPatch(*Snapshot, MinX, MaxX, PatchList);
+				bIsPatched = VdFile.patch(Index, PatchList);
+			}
+
+			if (bIsPatched) {
+				PatchedVd++;
+			} else {
+				FBufferArchive TempBufferVd;
+				serializeVoxelData(*Snapshot, TempBufferVd);
+				VdBatch.Add(Index, TempBufferVd.GetData(), TempBufferVd.Num());
+			}
+
 			SavedVd++;
 		}
 
 		VdInfo.Unload();
 	}
-	UE_LOG(LogSandboxTerrain, Log, TEXT("Save voxel data ----> %d"), SavedVd);
+	VdBatch.Flush();
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Save voxel data ----> %d (patched %d)"), SavedVd, PatchedVd);
 
 	for (auto& Elem : TerrainZoneMap) {
 		FVector ZoneIndex = Elem.Key;
@@ -336,14 +490,7 @@ void ASandboxTerrainController::Save() {
 			SerializeMeshData(MeshDataPtr, TempBufferMd);
 
 			TVoxelIndex Index2(ZoneIndex.X, ZoneIndex.Y, ZoneIndex.Z);
-
-			TValueData buffer;
-			buffer.reserve(TempBufferMd.Num());
-			for (uint8 b : TempBufferMd) {
-				buffer.push_back(b);
-			}
-
-			MdFile.save(Index2, buffer);
+			MdBatch.Add(Index2, TempBufferMd.GetData(), TempBufferMd.Num());
 
 			Zone->ClearCachedMeshData();
 			SavedMd++;
@@ -354,27 +501,33 @@ void ASandboxTerrainController::Save() {
 			Zone->SerializeInstancedMeshes(BinaryData);
 
 			TVoxelIndex Index2(ZoneIndex.X, ZoneIndex.Y, ZoneIndex.Z);
-
-			TValueData buffer;
-			buffer.reserve(BinaryData.Num());
-			for (uint8 b : BinaryData) {
-				buffer.push_back(b);
-			}
-
-			ObjFile.save(Index2, buffer);
+			ObjBatch.Add(Index2, BinaryData.GetData(), BinaryData.Num());
 
 			Zone->ResetNeedSave();
 			SavedObj++;
 		}
 	}
+	MdBatch.Flush();
+	ObjBatch.Flush();
 	UE_LOG(LogSandboxTerrain, Log, TEXT("Save mesh data ----> %d"), SavedMd);
 	UE_LOG(LogSandboxTerrain, Log, TEXT("Save objects data ----> %d"), SavedObj);
 
+	// close last group of logged saves
+	VdFile.commit();
+	MdFile.commit();
+	ObjFile.commit();
+
+	VdFile.closeIdle(USBT_REGION_IDLE_TIME);
+
 	SaveJson();
 
 	double End = FPlatformTime::Seconds();
 	double Time = (End - Start) * 1000;
 	UE_LOG(LogSandboxTerrain, Log, TEXT("Terrain saved -> %f ms"), Time);
+
+	if (bDumpStorageStatsOnSave) {
+		DumpStorageStats();
+	}
 }
 
 void ASandboxTerrainController::SaveMapAsync() {
@@ -385,6 +538,136 @@ void ASandboxTerrainController::SaveMapAsync() {
 	});
 }
 
+void CompactKvFile(TKvFile& KvFile, const TCHAR* Name) {
+	double Start = FPlatformTime::Seconds();
+	kvdb::TCompactionStats Stats = KvFile.compact();
+	double Time = (FPlatformTime::Seconds() - Start) * 1000;
+
+	if (Stats.bSuccess) {
+		UE_LOG(LogSandboxTerrain, Log, TEXT("Compact %s -> %llu records, %llu -> %llu bytes, reclaimed %llu bytes -> %f ms"), Name, Stats.records, Stats.sizeBefore, Stats.sizeAfter, Stats.reclaimedBytes, Time);
+	} else {
+		UE_LOG(LogSandboxTerrain, Warning, TEXT("Unable to compact %s"), Name);
+	}
+}
+
+void ASandboxTerrainController::CompactMapAsync() {
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Start compact terrain files async"));
+	RunThread([&](FAsyncThread& ThisThread) {
+		if (VdFile.isColumn()) {
+			CompactKvFile(VdFile, TEXT("terrain data"));
+			return;
+		}
+
+		CompactKvFile(VdFile, TEXT("voxel data"));
+		CompactKvFile(MdFile, TEXT("mesh data"));
+		CompactKvFile(ObjFile, TEXT("objects data"));
+	});
+}
+
+void BackupKvFile(TKvFile& KvFile, const FString& BackupDir, const FString& FileName) {
+	FString BackupPath = BackupDir + FileName;
+	double Start = FPlatformTime::Seconds();
+	kvdb::TBackupStats Stats = KvFile.backup(std::string(TCHAR_TO_UTF8(*BackupPath)));
+	double Time = (FPlatformTime::Seconds() - Start) * 1000;
+
+	if (Stats.bSuccess) {
+		UE_LOG(LogSandboxTerrain, Log, TEXT("Backup %s #%d (%s) -> %llu records, %llu erased, %llu bytes -> %f ms"), *FileName, Stats.seq, Stats.bFull ? TEXT("full") : TEXT("incremental"), Stats.pairs, Stats.erased, Stats.bytes, Time);
+	} else {
+		UE_LOG(LogSandboxTerrain, Warning, TEXT("Unable to backup %s"), *FileName);
+	}
+}
+
+void ASandboxTerrainController::BackupMapAsync() {
+	if (!GetWorld()->IsServer()) {
+		return;
+	}
+
+	if (VdFile.isRegion()) {
+		UE_LOG(LogSandboxTerrain, Warning, TEXT("Backup of region files is not supported, copy Regions directory of map"));
+		return;
+	}
+
+	FString BackupDir = FPaths::ProjectSavedDir() + TEXT("/Map/") + MapName + TEXT("/") + USBT_BACKUP_DIR;
+
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Start backup terrain async"));
+	RunThread([&, BackupDir](FAsyncThread& ThisThread) {
+		Save();
+
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		if (!PlatformFile.DirectoryExists(*BackupDir)) {
+			PlatformFile.CreateDirectory(*BackupDir);
+		}
+
+		if (VdFile.isColumn()) {
+			BackupKvFile(VdFile, BackupDir, USBT_FILE_TERRAIN);
+			return;
+		}
+
+		BackupKvFile(VdFile, BackupDir, USBT_FILE_VD);
+		BackupKvFile(MdFile, BackupDir, USBT_FILE_MD);
+		BackupKvFile(ObjFile, BackupDir, USBT_FILE_OBJ);
+	});
+}
+
+bool ASandboxTerrainController::RestoreMapBackup(const FString& SavedMapName, int32 BackupId) {
+	FString SaveDir = FPaths::ProjectSavedDir() + TEXT("/Map/") + SavedMapName + TEXT("/");
+	FString BackupDir = SaveDir + USBT_BACKUP_DIR;
+	const uint32 Seq = (BackupId > 0) ? (uint32)BackupId : UINT_MAX;
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	bool bIsRestored = false;
+
+	// files are restored independently, every file has own manifest
+	for (const TCHAR* FileName : { USBT_FILE_VD, USBT_FILE_MD, USBT_FILE_OBJ, USBT_FILE_TERRAIN }) {
+		FString BackupPath = BackupDir + FileName;
+		FString ManifestPath = BackupPath + TEXT(".manifest");
+		if (!PlatformFile.FileExists(*ManifestPath)) {
+			continue;
+		}
+
+		FString FilePath = SaveDir + FileName;
+		if (kvdb::KvFile<TVoxelIndex, TValueData>::restoreBackup(std::string(TCHAR_TO_UTF8(*BackupPath)), std::string(TCHAR_TO_UTF8(*FilePath)), Seq)) {
+			UE_LOG(LogSandboxTerrain, Log, TEXT("Restore %s from backup %d"), FileName, BackupId);
+			bIsRestored = true;
+		} else {
+			UE_LOG(LogSandboxTerrain, Warning, TEXT("Unable to restore %s from backup %d"), FileName, BackupId);
+			return false;
+		}
+	}
+
+	return bIsRestored;
+}
+
+void LogKvFileStats(TKvFile& KvFile, const TCHAR* Name, FString& Csv) {
+	const kvdb::TFileStats Stats = KvFile.getStats();
+
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Stats %s -> %llu records, %llu live / %llu dead bytes, %llu free extents, %llu tables, %llu reserved / %llu deleted slots"), Name, Stats.pairs, Stats.liveBytes, Stats.deadBytes, Stats.freeExtents, Stats.tableCount, Stats.reservedSlots, Stats.deletedSlots);
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Stats %s -> read %llu ops / %llu bytes, write %llu ops / %llu bytes, log %llu bytes"), Name, Stats.dataIo.readOps, Stats.dataIo.readBytes, Stats.dataIo.writeOps, Stats.dataIo.writeBytes, Stats.walIo.writeBytes);
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Stats %s -> load %llu (p50 %llu, p99 %llu, max %llu us), save %llu (p50 %llu, p99 %llu, max %llu us), lock wait %llu us"), Name, 
+		Stats.load.count, Stats.load.p50Us, Stats.load.p99Us, Stats.load.maxUs, Stats.save.count, Stats.save.p50Us, Stats.save.p99Us, Stats.save.maxUs, Stats.lockWait.totalUs);
+
+	Csv += UTF8_TO_TCHAR(kvdb::statsCsvRow(TCHAR_TO_UTF8(Name), Stats).c_str());
+	Csv += LINE_TERMINATOR;
+}
+
+void ASandboxTerrainController::DumpStorageStats() {
+	FString Csv;
+	if (VdFile.isColumn()) {
+		LogKvFileStats(VdFile, VdFile.isRegion() ? TEXT("regions") : TEXT("terrain"), Csv);
+	} else {
+		LogKvFileStats(VdFile, TEXT("voxeldata"), Csv);
+		LogKvFileStats(MdFile, TEXT("mesh"), Csv);
+		LogKvFileStats(ObjFile, TEXT("objects"), Csv);
+	}
+
+	FString FullPath = FPaths::ProjectSavedDir() + TEXT("/Map/") + MapName + TEXT("/") + USBT_STATS_FILE;
+	if (!FPlatformFileManager::Get().GetPlatformFile().FileExists(*FullPath)) {
+		Csv = FString(UTF8_TO_TCHAR(kvdb::statsCsvHeader().c_str())) + LINE_TERMINATOR + Csv;
+	}
+
+	FFileHelper::SaveStringToFile(Csv, *FullPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
+
 void ASandboxTerrainController::SaveJson() {
 	UE_LOG(LogTemp, Log, TEXT("----------- save json -----------"));
 
@@ -435,12 +718,25 @@ void ASandboxTerrainController::SaveJson() {
 	FFileHelper::SaveStringToFile(*JsonStr, *FullPath);
 }
 
-bool OpenKvFile(kvdb::KvFile<TVoxelIndex, TValueData>& KvFile, const FString& FileName, const FString& SaveDir) {
+void LogKvFileCacheStats(const TKvFile& KvFile, const TCHAR* Name) {
+	const kvdb::TCacheStats Stats = KvFile.getCacheStats();
+	if (Stats.capacity == 0) {
+		return;
+	}
+
+	const ulong64 Total = Stats.hits + Stats.misses;
+	const float HitRate = (Total > 0) ? (float)Stats.hits / (float)Total * 100.f : 0.f;
+	UE_LOG(LogSandboxTerrain, Log, TEXT("Cache %s -> %llu hits, %llu misses (%.1f%%), %llu entries, %llu / %llu bytes"), Name, Stats.hits, Stats.misses, HitRate, Stats.entries, Stats.usedBytes, Stats.capacity);
+}
+
+// KvFile or KvColumnFile
+template <typename T>
+bool OpenKvFile(T& KvFile, const FString& FileName, const FString& SaveDir, uint32 Codec) {
 	FString FullPath = SaveDir + FileName;
 	std::string FilePathString = std::string(TCHAR_TO_UTF8(*FullPath));
 
 	if (!FPlatformFileManager::Get().GetPlatformFile().FileExists(*FullPath)) {
-		kvdb::KvFile<TVoxelIndex, TValueData>::create(FilePathString, std::unordered_map<TVoxelIndex, TValueData>());// create new empty file
+		kvdb::KvFile<TVoxelIndex, TValueData>::create(FilePathString, std::unordered_map<TVoxelIndex, TValueData>(), Codec);// create new empty file
 	}
 
 	if (!KvFile.open(FilePathString)) {
@@ -453,9 +749,10 @@ bool OpenKvFile(kvdb::KvFile<TVoxelIndex, TValueData>& KvFile, const FString& Fi
 
 bool ASandboxTerrainController::OpenFile() {
 	// open vd file 	
-	FString FileNameVd = TEXT("terrain_voxeldata.dat");
-	FString FileNameMd = TEXT("terrain_mesh.dat");
-	FString FileNameObj = TEXT("terrain_objects.dat");
+	FString FileNameVd = USBT_FILE_VD;
+	FString FileNameMd = USBT_FILE_MD;
+	FString FileNameObj = USBT_FILE_OBJ;
+	FString FileNameTerrain = USBT_FILE_TERRAIN;
 
 	FString SavePath = FPaths::ProjectSavedDir();
 	FString SaveDir = SavePath + TEXT("/Map/") + MapName + TEXT("/");
@@ -473,15 +770,88 @@ bool ASandboxTerrainController::OpenFile() {
 		}
 	}
 
-	if (!OpenKvFile(VdFile, FileNameVd, SaveDir)) {
+	const uint32 Codec = bCompressedStorage ? kvdb::CODEC_LZ : kvdb::CODEC_NONE;
+	const uint32 VdCodec = (VoxelDataStorage == ETerrainVoxelDataStorage::TVS_Compressed) ? kvdb::CODEC_LZ : kvdb::CODEC_NONE;
+
+	// calls not supported by storage layout, e.g. snapshot of region files
+	kvdb::errorLog() = [](const std::string& Message) {
+		UE_LOG(LogSandboxTerrain, Warning, TEXT("%s"), UTF8_TO_TCHAR(Message.c_str()));
+	};
+
+	// one pool of I/O threads for async loads of all terrain files
+	kvdb::TIoThreadPoolPtr IoThreadPool = std::make_shared<kvdb::TIoThreadPool>();
+
+	auto SetupKvFile = [&](auto& KvFile) {
+		KvFile.setMemoryMapping(bMemoryMappedStorage);
+		KvFile.setWriteAheadLog(bWriteAheadLog, kvdb::DURABILITY_GROUP);
+		KvFile.setCacheSize((StorageCacheSizeMb > 0) ? (ulong64)StorageCacheSizeMb * 1024 * 1024 : 0);
+		KvFile.setPlacement(kvdb::PLACEMENT_MORTON); // neighbour zones are close in file
+		KvFile.setIoThreadPool(IoThreadPool);
+	};
+
+	if (bRegionFileStorage) {
+		// terrain file per region of zones, opened on first access
+		FString RegionDir = SaveDir + USBT_REGION_DIR;
+		if (!PlatformFile.DirectoryExists(*RegionDir)) {
+			PlatformFile.CreateDirectory(*RegionDir);
+		}
+
+		auto RegionFile = std::make_shared<kvdb::KvRegionFile<TVoxelIndex>>();
+		SetupKvFile(*RegionFile);
+		RegionFile->setRegionSize(USBT_REGION_ZONES);
+		RegionFile->setColumnCodec(USBT_COLUMN_VD, VdCodec);
+		RegionFile->setColumnCodec(USBT_COLUMN_OBJ, Codec);
+
+		if (!RegionFile->open(std::string(TCHAR_TO_UTF8(*RegionDir)))) {
+			UE_LOG(LogSandboxTerrain, Warning, TEXT("Unable to open region files: %s"), *RegionDir);
+			return false;
+		}
+
+		VdFile.bind(RegionFile, USBT_COLUMN_VD);
+		MdFile.bind(RegionFile, USBT_COLUMN_MD);
+		ObjFile.bind(RegionFile, USBT_COLUMN_OBJ);
+		return true;
+	}
+
+	if (bSingleFileStorage) {
+		// one index and one read per zone for all kinds of data
+		auto TerrainFile = std::make_shared<kvdb::KvColumnFile<TVoxelIndex>>();
+		SetupKvFile(*TerrainFile);
+		TerrainFile->setColumnCodec(USBT_COLUMN_VD, VdCodec);
+		TerrainFile->setColumnCodec(USBT_COLUMN_OBJ, Codec);
+
+		if (!OpenKvFile(*TerrainFile, FileNameTerrain, SaveDir, kvdb::CODEC_NONE)) {
+			return false;
+		}
+
+		VdFile.bind(TerrainFile, USBT_COLUMN_VD);
+		MdFile.bind(TerrainFile, USBT_COLUMN_MD);
+		ObjFile.bind(TerrainFile, USBT_COLUMN_OBJ);
+		return true;
+	}
+
+	auto OpenStandaloneFile = [&](TKvFile& KvFile, const FString& FileName, uint32 FileCodec) {
+		auto FilePtr = std::make_shared<kvdb::KvFile<TVoxelIndex, TValueData>>();
+		SetupKvFile(*FilePtr);
+		FilePtr->setCodec(FileCodec);
+
+		if (!OpenKvFile(*FilePtr, FileName, SaveDir, FileCodec)) {
+			return false;
+		}
+
+		KvFile.bind(FilePtr);
+		return true;
+	};
+
+	if (!OpenStandaloneFile(VdFile, FileNameVd, VdCodec)) {
 		return false;
 	}
 
-	if (!OpenKvFile(MdFile, FileNameMd, SaveDir)) {
+	if (!OpenStandaloneFile(MdFile, FileNameMd, kvdb::CODEC_NONE)) {
 		return false;
 	}
 
-	if (!OpenKvFile(ObjFile, FileNameObj, SaveDir)) {
+	if (!OpenStandaloneFile(ObjFile, FileNameObj, Codec)) {
 		return false;
 	}
 
@@ -564,27 +934,21 @@ void ASandboxTerrainController::SpawnZone(const TVoxelIndex& Index) {
 	// cancel if zone already exist
 	if (GetZoneByVectorIndex(Index) != nullptr) return; 
 
-	//if no voxel data in memory
+	// if no voxel data in memory or in file (stored zones are registered on start)
 	if (!HasVoxelData(Index)) {
+		// generate new voxel data
 		TVoxelDataInfo VdInfo;
-		// if voxel data exist in file
-		if (VdFile.isExist(Index)) {
-			VdInfo.DataState = TVoxelDataState::READY_TO_LOAD;
-			RegisterTerrainVoxelData(VdInfo, Index);
-		} else {
-			// generate new voxel data
-			VdInfo.Vd = new TVoxelData(USBT_ZONE_DIMENSION, USBT_ZONE_SIZE);
-			VdInfo.Vd->setOrigin(Pos);
+		VdInfo.Vd = new TVoxelData(USBT_ZONE_DIMENSION, USBT_ZONE_SIZE);
+		VdInfo.Vd->setOrigin(Pos);
 
-			TerrainGeneratorComponent->GenerateVoxelTerrain(*VdInfo.Vd);
-			GeneratedVdConter++;
+		TerrainGeneratorComponent->GenerateVoxelTerrain(*VdInfo.Vd);
+		GeneratedVdConter++;
 
-			VdInfo.DataState = TVoxelDataState::GENERATED;
-			VdInfo.Vd->setChanged();
-			VdInfo.Vd->setCacheToValid();
+		VdInfo.DataState = TVoxelDataState::GENERATED;
+		VdInfo.Vd->setChanged();
+		VdInfo.Vd->setCacheToValid();
 
-			RegisterTerrainVoxelData(VdInfo, Index);
-		}
+		RegisterTerrainVoxelData(VdInfo, Index);
 	}
 
 	// voxel data must exist in this point
@@ -625,6 +989,11 @@ void ASandboxTerrainController::SpawnInitialZone() {
 	TSet<FVector> InitialZoneSet;
 
 	if (s > 0) {
+		if (StorageCacheSizeMb > 0) {
+			// read mesh data of initial area at once into cache, LoadMeshDataByIndex of zones below takes it from there
+			MdFile.loadRange(TVoxelIndex(-s, -s, -s), TVoxelIndex(s, s, s));
+		}
+
 		for (auto x = -s; x <= s; x++) {
 			for (auto y = -s; y <= s; y++) {
 				for (auto z = -s; z <= s; z++) {
@@ -917,18 +1286,27 @@ void ASandboxTerrainController::PerformZoneEditHandler(TVoxelData* Vd, H handler
 	bool bIsChanged = false;
 	TMeshDataPtr MeshDataPtr = nullptr;
 
+	// mesh is generated from snapshot after unlock, so next edit of zone doesn't wait for mesher.
+	// time stamp of snapshot lets zone skip mesh of older snapshot finished later
+	std::shared_ptr<TVoxelData> Snapshot;
+	double SnapshotTime = 0;
+
 	Vd->vd_edit_mutex.lock();
 	bIsChanged = handler(Vd);
 	if (bIsChanged) {
 		Vd->setChanged();
 		Vd->setCacheToValid();
-		MeshDataPtr = GenerateMesh(Vd);
 		Vd->resetLastMeshRegenerationTime();
-		MeshDataPtr->TimeStamp = FPlatformTime::Seconds();
+		Snapshot = Vd->snapshot();
+		SnapshotTime = FPlatformTime::Seconds();
 	}
 	Vd->vd_edit_mutex.unlock();
 
 	if (bIsChanged) {
+		MeshDataPtr = GenerateMesh(Snapshot.get());
+		if (MeshDataPtr != nullptr) {
+			MeshDataPtr->TimeStamp = SnapshotTime;
+		}
 		OnComplete(MeshDataPtr);
 	}
 }
@@ -1026,11 +1404,12 @@ TVoxelData* ASandboxTerrainController::LoadVoxelDataByIndex(const TVoxelIndex& I
 	TVoxelData* Vd = new TVoxelData(USBT_ZONE_DIMENSION, USBT_ZONE_SIZE);
 	Vd->setOrigin(GetZonePos(Index));
 
-	bool bIsLoaded = LoadDataFromKvFile(VdFile, Index, [=](TArray<uint8>& Data) { 
-		//FMemoryReader BinaryData = FMemoryReader(Data, true); //true, free data after done
-		//BinaryData.Seek(0);
-		//deserializeVoxelData(*Vd, BinaryData);
-		deserializeVoxelData2(Vd, Data, false);
+	// deserialize directly from file view, without intermediate copy
+	bool bIsLoaded = LoadViewFromKvFile(VdFile, Index, [=](const kvdb::TValueView& View) { 
+		deserializeVoxelData2(Vd, View.data(), false);
+
+		// memory and stored data have the same layout now
+		Vd->resetDirty();
 	});
 
 	double End = FPlatformTime::Seconds();
@@ -1232,6 +1611,9 @@ std::shared_ptr<TMeshData> ASandboxTerrainController::GenerateMesh(TVoxelData* V
 
 	TMeshDataPtr MeshDataPtr = sandboxVoxelGenerateMesh(*Vd, Vdp);
 
+	// voxel data was read after start. zone skips meshes older than its cached one
+	MeshDataPtr->TimeStamp = start;
+
 	double end = FPlatformTime::Seconds();
 	double time = (end - start) * 1000;
 
@@ -1374,22 +1756,27 @@ TMeshDataPtr DeserializeMeshData(FMemoryReader& BinaryData, uint32 CollisionMesh
 	return MeshDataPtr;
 }
 
-bool LoadDataFromKvFile(TKvFile& KvFile, const TVoxelIndex& Index, std::function<void(TArray<uint8>&)> Function) {
-	TValueDataPtr DataPtr = KvFile.loadData(Index);
+bool LoadViewFromKvFile(TKvFile& KvFile, const TVoxelIndex& Index, std::function<void(const kvdb::TValueView&)> Function) {
+	kvdb::TValueView View = KvFile.loadView(Index);
 
-	if (DataPtr == nullptr || DataPtr->size() == 0) {
+	if (!View) {
 		return false;
 	}
 
+	Function(View);
+	return true;
+}
+
+bool LoadDataFromKvFile(TKvFile& KvFile, const TVoxelIndex& Index, std::function<void(TArray<uint8>&)> Function) {
 	// we need TArray to deseralization 
-	// so just copy memory from std::vector<char> to TArray<uint8>
-	// TODO refactor deseralization to use std::vector<char>
-	TArray<uint8> BinaryArray;
-	BinaryArray.SetNum(DataPtr->size());
-	FMemory::Memcpy(BinaryArray.GetData(), DataPtr->data(), DataPtr->size());
+	// so just copy memory from file view to TArray<uint8>
+	return LoadViewFromKvFile(KvFile, Index, [&](const kvdb::TValueView& View) {
+		TArray<uint8> BinaryArray;
+		BinaryArray.SetNum(View.size());
+		FMemory::Memcpy(BinaryArray.GetData(), View.data(), View.size());
 
-	Function(BinaryArray);
-	return true;
+		Function(BinaryArray);
+	});
 }
 
 
@@ -1411,6 +1798,7 @@ TMeshDataPtr ASandboxTerrainController::LoadMeshDataByIndex(const TVoxelIndex& I
 		BinaryData.Seek(0);
 
 		MeshDataPtr = DeserializeMeshData(BinaryData, GetCollisionMeshSectionLodIndex());
+		MeshDataPtr->TimeStamp = Start;
 
 		Data.Empty();
 		Decompressor.FlushCache();
@@ -1450,7 +1838,10 @@ void ASandboxTerrainController::LoadObjectDataByIndex(UTerrainZoneComponent* Zon
 
 
 
-#define DATA_END_MARKER 666999
+#define DATA_END_MARKER 666999
+
+// num, size, density state, material state, base material. see TVoxelDataHeader
+#define DATA_HEADER_SIZE 12
 
 void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData) {
 	int32 num = vd.num();
@@ -1476,7 +1867,7 @@ void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData) {
 	binaryData << volume_state;
 
 	// save material
-	if (vd.material_data == NULL) {
+	if (!vd.hasMaterialData()) {
 		volume_state = 0;
 	} else {
 		volume_state = 2;
@@ -1487,31 +1878,50 @@ void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData) {
 	binaryData << volume_state;
 	binaryData << base_mat;
 
+	// kept by bricks, stored linear. bricks are written out one by one
+	const size_t count = (size_t)num * num * num;
 	if (vd.getDensityFillState() == TVoxelDataFillState::MIXED) {
-		for (int x = 0; x < num; x++) {
-			for (int y = 0; y < num; y++) {
-				for (int z = 0; z < num; z++) {
-					unsigned char density = vd.getRawDensityUnsafe(x, y, z);
-					binaryData << density;
-				}
-			}
-		}
+		std::vector<unsigned char> density(count);
+		vd.exportVoxels(0, num - 1, density.data(), nullptr);
+		binaryData.Serialize(density.data(), count);
 	}
 
 	if (volume_state == 2) {
-		for (int x = 0; x < num; x++) {
-			for (int y = 0; y < num; y++) {
-				for (int z = 0; z < num; z++) {
-					unsigned short matId = vd.getRawMaterialUnsafe(x, y, z);
-					binaryData << matId;
-				}
-			}
-		}
+		std::vector<unsigned short> material(count);
+		vd.exportVoxels(0, num - 1, nullptr, material.data());
+		binaryData.Serialize(material.data(), count * sizeof(unsigned short));
 	}
 
 	int32 end_marker = DATA_END_MARKER;
 	binaryData << end_marker;
-}
+}
+
+// x planes from min_x to max_x as patches of data written by serializeVoxelData
+void serializeVoxelDataPatch(TVoxelData& vd, int min_x, int max_x, std::vector<kvdb::TPatch>& patchList) {
+	const int num = vd.num();
+	const uint64 plane = num * num;
+	const uint64 count = (max_x - min_x + 1) * plane;
+	uint64 offset = DATA_HEADER_SIZE;
+
+	if (vd.getDensityFillState() == TVoxelDataFillState::MIXED) {
+		kvdb::TPatch densityPatch;
+		densityPatch.offset = offset + min_x * plane;
+		densityPatch.data.resize(count);
+		vd.exportVoxels(min_x, max_x, densityPatch.data.data(), nullptr);
+
+		patchList.push_back(std::move(densityPatch));
+		offset += num * plane;
+	}
+
+	if (vd.hasMaterialData()) {
+		kvdb::TPatch materialPatch;
+		materialPatch.offset = offset + min_x * plane * sizeof(unsigned short);
+		materialPatch.data.resize(count * sizeof(unsigned short));
+		vd.exportVoxels(min_x, max_x, nullptr, materialPatch.data.data());
+
+		patchList.push_back(std::move(materialPatch));
+	}
+}
 
 //===============================================================================================
 // test
@@ -1521,10 +1931,10 @@ class FastUnsafeDeserializer {
 
 private:
 	size_t pos = 0;
-	uint8_t* dataPtr = nullptr;
+	const uint8_t* dataPtr = nullptr;
 
 public:
-	FastUnsafeDeserializer(uint8_t* dataPtr_) : dataPtr(dataPtr_) { }
+	FastUnsafeDeserializer(const uint8_t* dataPtr_) : dataPtr(dataPtr_) { }
 
 	template <typename T>
 	void readObj(T& obj) {
@@ -1538,12 +1948,20 @@ public:
 		memcpy(buffer, dataPtr + pos, len);
 		pos += len;
 	}
+
+	// pointer to data in place, without copy. may be unaligned
+	template <typename T>
+	const uint8_t* skip(size_t size) {
+		const uint8_t* ptr = dataPtr + pos;
+		pos += sizeof(T) * size;
+		return ptr;
+	}
 };
 
 
 
-void deserializeVoxelData2(TVoxelData* vd, TArray<uint8>& Data, bool createSubstanceCache) {
-	FastUnsafeDeserializer deserializer(Data.GetData());
+void deserializeVoxelData2(TVoxelData* vd, const uint8* Data, bool createSubstanceCache) {
+	FastUnsafeDeserializer deserializer(Data);
 
 	TVoxelDataHeader header;
 	deserializer.readObj(header);
@@ -1555,16 +1973,14 @@ void deserializeVoxelData2(TVoxelData* vd, TArray<uint8>& Data, bool createSubst
 	if (header.density_state == 2) {
 		const size_t s = header.voxel_num * header.voxel_num * header.voxel_num;
 
-		vd->density_data = new unsigned char[s];
-		deserializer.read(vd->density_data, s);
-
-		vd->material_data = new unsigned short[s];
-		deserializer.read(vd->material_data, s);
+		const uint8_t* density_data = deserializer.skip<unsigned char>(s);
+		const uint8_t* material_data = deserializer.skip<unsigned short>(s);
 
 		uint32 test;
 		deserializer.readObj(test);
 
-		vd->density_state = TVoxelDataFillState::MIXED;
+		// stored linear, kept by bricks. bricks are read straight from source
+		vd->importVoxels(density_data, material_data);
 
 		if (createSubstanceCache) {
 			auto num = header.voxel_num;
@@ -1643,6 +2059,8 @@ void deserializeVoxelData(TVoxelData &vd, FMemoryReader& binaryData) {
 		vd.deinitializeMaterial(base_mat);
 	}
 
+	vd.compact();
+
 	int32 end_marker;
 	binaryData << end_marker;
 
@@ -696,9 +696,8 @@ TMeshDataPtr polygonizeCellSubstanceCacheNoLOD(const TVoxelData &vd, const TVoxe
 	for (auto it = vd.substanceCacheLOD[0].cellList.cbegin(); it != vd.substanceCacheLOD[0].cellList.cend(); ++it) {
 		int index = *it;
 
-		int x = index / (vd.num() * vd.num());
-		int y = (index / vd.num()) % vd.num();
-		int z = index % vd.num();
+		int x, y, z;
+		vd.clcCellPos(index, x, y, z);
 
 		mesh_extractor_ptr->generateCell(x, y, z);
 	}
@@ -724,9 +723,8 @@ TMeshDataPtr polygonizeCellSubstanceCacheLOD(const TVoxelData &vd, const TVoxelD
 		for (auto it = vd.substanceCacheLOD[lod].cellList.cbegin(); it != vd.substanceCacheLOD[lod].cellList.cend(); ++it) {
 			int index = *it;
 
-			int x = index / (vd.num() * vd.num());
-			int y = (index / vd.num()) % vd.num();
-			int z = index % vd.num();
+			int x, y, z;
+			vd.clcCellPos(index, x, y, z);
 
 			mesh_extractor_ptr->generateCell(x, y, z);
 		}
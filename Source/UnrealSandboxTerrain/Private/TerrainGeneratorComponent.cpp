@@ -141,6 +141,7 @@ void UTerrainGeneratorComponent::GenerateZoneVolume(TVoxelData &VoxelData, const
 		VoxelData.deinitializeMaterial(base_mat);
 	}
 
+	VoxelData.compact();
 }
 
 void UTerrainGeneratorComponent::GenerateVoxelTerrain(TVoxelData &VoxelData) {
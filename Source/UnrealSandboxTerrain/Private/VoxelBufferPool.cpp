@@ -0,0 +1,95 @@
+
+#include "UnrealSandboxTerrainPrivatePCH.h"
+#include "VoxelBufferPool.h"
+
+#if PLATFORM_LINUX && VD_POOL_HUGE_PAGES
+#include <sys/mman.h>
+#endif
+
+//====================================================================================
+// Voxel buffer pool impl
+//====================================================================================
+
+// never destroyed, voxel data may outlive static objects on exit
+TVoxelBufferPool& TVoxelBufferPool::instance() {
+	static TVoxelBufferPool* pool = new TVoxelBufferPool();
+	return *pool;
+}
+
+void* TVoxelBufferPool::allocateFromSlab(size_t size) {
+	std::unique_lock<std::mutex> lock(slab_mutex);
+
+	if (slab_left < size) {
+		// tail of previous slab is dropped, it is smaller than buffer
+		void* slab = FMemory::Malloc(VD_POOL_SLAB_SIZE, VD_POOL_SLAB_SIZE);
+#if PLATFORM_LINUX && VD_POOL_HUGE_PAGES
+		madvise(slab, VD_POOL_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+		slab_list.push_back(slab);
+		slab_pos = (uint8*)slab;
+		slab_left = VD_POOL_SLAB_SIZE;
+	}
+
+	void* ptr = slab_pos;
+	slab_pos += size;
+	slab_left -= size;
+	return ptr;
+}
+
+void* TVoxelBufferPool::allocate(size_t size) {
+	if (size == 0 || size > VD_POOL_MAX_SIZE) {
+		return FMemory::Malloc(size, VD_POOL_GRANULARITY);
+	}
+
+	const size_t index = classIndex(size);
+	TSizeClass& size_class = class_list[index];
+	used_bytes += (index + 1) * VD_POOL_GRANULARITY;
+
+	{
+		std::unique_lock<std::mutex> lock(size_class.mutex);
+		if (size_class.free_list != nullptr) {
+			TFreeBuffer* buffer = size_class.free_list;
+			size_class.free_list = buffer->next;
+			size_class.free_count--;
+			return buffer;
+		}
+	}
+
+	return allocateFromSlab((index + 1) * VD_POOL_GRANULARITY);
+}
+
+void TVoxelBufferPool::free(void* ptr, size_t size) {
+	if (ptr == nullptr) {
+		return;
+	}
+
+	if (size == 0 || size > VD_POOL_MAX_SIZE) {
+		FMemory::Free(ptr);
+		return;
+	}
+
+	const size_t index = classIndex(size);
+	TSizeClass& size_class = class_list[index];
+	used_bytes -= (index + 1) * VD_POOL_GRANULARITY;
+
+	std::unique_lock<std::mutex> lock(size_class.mutex);
+	TFreeBuffer* buffer = (TFreeBuffer*)ptr;
+	buffer->next = size_class.free_list;
+	size_class.free_list = buffer;
+	size_class.free_count++;
+}
+
+TVoxelBufferPoolStats TVoxelBufferPool::getStats() {
+	TVoxelBufferPoolStats stats;
+	stats.usedBytes = used_bytes;
+
+	for (size_t index = 0; index < VD_POOL_CLASS_COUNT; index++) {
+		TSizeClass& size_class = class_list[index];
+		std::unique_lock<std::mutex> lock(size_class.mutex);
+		stats.freeBytes += size_class.free_count * (index + 1) * VD_POOL_GRANULARITY;
+	}
+
+	std::unique_lock<std::mutex> lock(slab_mutex);
+	stats.slabBytes = (uint64)slab_list.size() * VD_POOL_SLAB_SIZE;
+	return stats;
+}
@@ -7,51 +7,31 @@
 //====================================================================================
 
 TVoxelData::TVoxelData(int num, float size) {
-	density_data = nullptr;
 	density_state = TVoxelDataFillState::ZERO;
-	material_data = nullptr;
 
 	voxel_num = num;
 	volume_size = size;
+
+	resetDirty();
+	layout_changed = true;
 }
 
 TVoxelData::~TVoxelData() {
-	if (density_data != nullptr) delete[] density_data;
-	if (material_data != nullptr) delete[] material_data;
 }
 
+// bricks start uniform with fill state value
 FORCEINLINE void TVoxelData::initializeDensity() {
-	const int s = voxel_num * voxel_num * voxel_num;
-	density_data = new unsigned char[s];
-	for (auto x = 0; x < voxel_num; x++) {
-		for (auto y = 0; y < voxel_num; y++) {
-			for (auto z = 0; z < voxel_num; z++) {
-				if (density_state == TVoxelDataFillState::FULL) {
-					setDensity(x, y, z, 1);
-				}
-
-				if (density_state == TVoxelDataFillState::ZERO) {
-					setDensity(x, y, z, 0);
-				}
-			}
-		}
-	}
+	density_data.allocate(voxel_num, (density_state == TVoxelDataFillState::FULL) ? 255 : 0);
+	layout_changed = true;
 }
 
 FORCEINLINE void TVoxelData::initializeMaterial() {
-	const int s = voxel_num * voxel_num * voxel_num;
-	material_data = new unsigned short[s];
-	for (auto x = 0; x < voxel_num; x++) {
-		for (auto y = 0; y < voxel_num; y++) {
-			for (auto z = 0; z < voxel_num; z++) {
-				setMaterial(x, y, z, base_fill_mat);
-			}
-		}
-	}
+	material_data.allocate(voxel_num, base_fill_mat);
+	layout_changed = true;
 }
 
 FORCEINLINE void TVoxelData::setDensity(int x, int y, int z, float density) {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		if (density_state == TVoxelDataFillState::ZERO && density == 0) {
 			return;
 		}
@@ -65,19 +45,18 @@ FORCEINLINE void TVoxelData::setDensity(int x, int y, int z, float density) {
 	}
 
 	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		const int index = clcLinearIndex(x, y, z);
-
 		if (density < 0) density = 0;
 		if (density > 1) density = 1;
 
 		unsigned char d = 255 * density;
 
-		density_data[index] = d;
+		density_data.set(x, y, z, d);
+		markDirty(x);
 	}
 }
 
 FORCEINLINE float TVoxelData::getDensity(int x, int y, int z) const {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		if (density_state == TVoxelDataFillState::FULL) {
 			return 1;
 		}
@@ -86,9 +65,7 @@ FORCEINLINE float TVoxelData::getDensity(int x, int y, int z) const {
 	}
 
 	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		const int index = clcLinearIndex(x, y, z);
-
-		float d = (float)density_data[index] / 255.0f;
+		float d = (float)density_data.get(x, y, z) / 255.0f;
 		return d;
 	}
 	else {
@@ -97,34 +74,31 @@ FORCEINLINE float TVoxelData::getDensity(int x, int y, int z) const {
 }
 
 FORCEINLINE unsigned char TVoxelData::getRawDensityUnsafe(int x, int y, int z) const {
-	const int index = clcLinearIndex(x, y, z);
-	return density_data[index];
+	return density_data.get(x, y, z);
 }
 
 FORCEINLINE unsigned short TVoxelData::getRawMaterialUnsafe(int x, int y, int z) const {
-	const int index = clcLinearIndex(x, y, z);
-	return material_data[index];
+	return material_data.get(x, y, z);
 }
 
 FORCEINLINE void TVoxelData::setMaterial(const int x, const int y, const int z, const unsigned short material) {
-	if (material_data == NULL) {
+	if (!material_data.isAllocated()) {
 		initializeMaterial();
 	}
 
 	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		const int index = clcLinearIndex(x, y, z);
-		material_data[index] = material;
+		material_data.set(x, y, z, material);
+		markDirty(x);
 	}
 }
 
 FORCEINLINE unsigned short TVoxelData::getMaterial(int x, int y, int z) const {
-	if (material_data == NULL) {
+	if (!material_data.isAllocated()) {
 		return base_fill_mat;
 	}
 
 	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		const int index = clcLinearIndex(x, y, z);
-		return material_data[index];
+		return material_data.get(x, y, z);
 	}
 	else {
 		return 0;
@@ -193,53 +167,51 @@ FORCEINLINE int TVoxelData::num() const {
 }
 
 FORCEINLINE void TVoxelData::getRawVoxelData(int x, int y, int z, unsigned char& density, unsigned short& material) const {
-	const int index = clcLinearIndex(x, y, z);
-
-	if (density_data != NULL) {
-		density = density_data[index];
+	if (density_data.isAllocated()) {
+		density = density_data.get(x, y, z);
 	} else {
 		density = 0;
 	}
 
-	if (material_data != NULL) {
-		material = material_data[index];
+	if (material_data.isAllocated()) {
+		material = material_data.get(x, y, z);
 	} else {
 		material = base_fill_mat;
 	}
 }
 
 FORCEINLINE void TVoxelData::setVoxelPoint(int x, int y, int z, unsigned char density, unsigned short material) {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		initializeDensity();
 		density_state = TVoxelDataFillState::MIXED;
 	}
 
-	if (material_data == NULL) {
+	if (!material_data.isAllocated()) {
 		initializeMaterial();
 	}
 
-	const int index = clcLinearIndex(x, y, z);
-	material_data[index] = material;
-	density_data[index] = density;
+	material_data.set(x, y, z, material);
+	density_data.set(x, y, z, density);
+	markDirty(x);
 }
 
 FORCEINLINE void TVoxelData::setVoxelPointDensity(int x, int y, int z, unsigned char density) {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		initializeDensity();
 		density_state = TVoxelDataFillState::MIXED;
 	}
 
-	const int index = clcLinearIndex(x, y, z);
-	density_data[index] = density;
+	density_data.set(x, y, z, density);
+	markDirty(x);
 }
 
 FORCEINLINE void TVoxelData::setVoxelPointMaterial(int x, int y, int z, unsigned short material) {
-	if (material_data == NULL) {
+	if (!material_data.isAllocated()) {
 		initializeMaterial();
 	}
 
-	const int index = clcLinearIndex(x, y, z);
-	material_data[index] = material;
+	material_data.set(x, y, z, material);
+	markDirty(x);
 }
 
 FORCEINLINE void TVoxelData::deinitializeDensity(TVoxelDataFillState State) {
@@ -247,22 +219,71 @@ FORCEINLINE void TVoxelData::deinitializeDensity(TVoxelDataFillState State) {
 		return;
 	}
 
-	density_state = State;
-	if (density_data != NULL) {
-		delete density_data;
-	}
-
-	density_data = NULL;
+	density_state = State;
+	layout_changed = true;
+	density_data.release();
 }
 
 FORCEINLINE void TVoxelData::deinitializeMaterial(unsigned short base_mat) {
 	base_fill_mat = base_mat;
+	layout_changed = true;
+	material_data.release();
+}
 
-	if (material_data != NULL) {
-		delete material_data;
-	}
-
-	material_data = NULL;
+void TVoxelData::compact() {
+	if (density_data.isAllocated()) {
+		density_data.compact();
+	}
+
+	if (material_data.isAllocated()) {
+		material_data.compact();
+	}
+}
+
+void TVoxelData::importVoxels(const void* density, const void* material) {
+	density_state = TVoxelDataFillState::MIXED;
+	density_data.import(voxel_num, density);
+	material_data.import(voxel_num, material);
+	layout_changed = true;
+}
+
+void TVoxelData::exportVoxels(int min_x, int max_x, void* density, void* material) const {
+	if (density != nullptr) {
+		density_data.exportPlanes(voxel_num, min_x, max_x, density);
+	}
+
+	if (material != nullptr) {
+		material_data.exportPlanes(voxel_num, min_x, max_x, material);
+	}
+}
+
+std::shared_ptr<TVoxelData> TVoxelData::snapshot() {
+	std::shared_ptr<TVoxelData> vd = std::make_shared<TVoxelData>(voxel_num, volume_size);
+
+	vd->density_state = density_state;
+	vd->base_fill_mat = base_fill_mat;
+	vd->density_data = density_data.share();
+	vd->material_data = material_data.share();
+
+	vd->origin = origin;
+	vd->lower = lower;
+	vd->upper = upper;
+
+	vd->last_change = last_change;
+	vd->last_save = last_save;
+	vd->last_mesh_generation = last_mesh_generation;
+	vd->last_cache_check = last_cache_check;
+
+	vd->dirty_min_x = dirty_min_x;
+	vd->dirty_max_x = dirty_max_x;
+	vd->layout_changed = layout_changed;
+
+	vd->substanceCacheLOD = substanceCacheLOD;
+	return vd;
+}
+
+size_t TVoxelData::memoryUsage() const {
+	return density_data.memoryUsage() + material_data.memoryUsage();
 }
 
 FORCEINLINE TVoxelDataFillState TVoxelData::getDensityFillState()	const {
@@ -316,7 +337,7 @@ FORCEINLINE bool TVoxelData::performCellSubstanceCaching(int x, int y, int z, in
 		return false;
 	}
 
-	int index = clcLinearIndex(rx, ry, rz);
+	int index = clcCellIndex(rx, ry, rz);
 	TSubstanceCache& lodCache = substanceCacheLOD[lod];
 	lodCache.cellList.push_back(index);
 	return true;
@@ -324,7 +345,7 @@ FORCEINLINE bool TVoxelData::performCellSubstanceCaching(int x, int y, int z, in
 
 
 FORCEINLINE void TVoxelData::performSubstanceCacheNoLOD(int x, int y, int z) {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		return;
 	}
 
@@ -332,7 +353,7 @@ FORCEINLINE void TVoxelData::performSubstanceCacheNoLOD(int x, int y, int z) {
 }
 
 FORCEINLINE void TVoxelData::performSubstanceCacheLOD(int x, int y, int z) {
-	if (density_data == NULL) {
+	if (!density_data.isAllocated()) {
 		return;
 	}
 
@@ -22,7 +22,7 @@ class UVdClientComponent;
 
 typedef TMap<int32, TInstMeshTransArray> TInstMeshTypeMap;
 typedef std::shared_ptr<TMeshData> TMeshDataPtr;
-typedef kvdb::KvFile<TVoxelIndex, TValueData> TKvFile;
+typedef kvdb::KvColumn<TVoxelIndex> TKvFile; // standalone file or column of single terrain file
 
 #define TH_STATE_NEW		0
 #define TH_STATE_RUNNING	1
@@ -49,6 +49,15 @@ enum class ETerrainInitialArea : uint8 {
 	TIA_3_3 = 1	UMETA(DisplayName = "3x3"),
 };
 
+// how voxel data of zones is kept in terrain files. patched data can't be compressed, 
+// compressed data is saved whole. zone stored other way is converted when it is saved next time
+UENUM(BlueprintType)
+enum class ETerrainVoxelDataStorage : uint8 {
+	TVS_Whole = 0		UMETA(DisplayName = "Uncompressed, saved whole"),
+	TVS_Compressed = 1	UMETA(DisplayName = "Compressed, saved whole"),
+	TVS_Patched = 2		UMETA(DisplayName = "Uncompressed, changed planes saved in place"),
+};
+
 enum TVoxelDataState {
 	UNDEFINED, 
 	GENERATED, 
@@ -219,9 +228,59 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "UnrealSandbox")
 	void SaveMapAsync();
 
+	// rewrite terrain files without dead space. terrain data is still readable while compacting
+	UFUNCTION(BlueprintCallable, Category = "UnrealSandbox")
+	void CompactMapAsync();
+
+	// save terrain and back up terrain files into Backup directory of map. 
+	// the first backup after start is full, next ones keep only zones changed since previous backup
+	UFUNCTION(BlueprintCallable, Category = "UnrealSandbox")
+	void BackupMapAsync();
+
+	// roll terrain files of map back or forward to backup. BackupId <= 0 - the latest backup.
+	// terrain of map must not be loaded
+	UFUNCTION(BlueprintCallable, Category = "UnrealSandbox")
+	static bool RestoreMapBackup(const FString& SavedMapName, int32 BackupId);
+
+	// log I/O counters, latencies and space usage of terrain files and append them to storage_stats.csv of map
+	UFUNCTION(BlueprintCallable, Category = "UnrealSandbox")
+	void DumpStorageStats();
+
 	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
 	int32 SaveGeneratedZones;
 
+	// read zone data directly from memory mapped terrain files
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bMemoryMappedStorage;
+
+	// crash-safe saves. terrain files are updated from log on checkpoint
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bWriteAheadLog;
+
+	// in-memory cache of loaded zone data per terrain file, megabytes. mesh data of zones around is prefetched into it
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	int32 StorageCacheSizeMb;
+
+	// compress objects data in terrain files. mesh data is compressed anyway, voxel data - see VoxelDataStorage
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bCompressedStorage;
+
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	ETerrainVoxelDataStorage VoxelDataStorage;
+
+	// keep voxel, mesh and objects data of new maps in one file with one index. separate files of existing maps are not converted
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bSingleFileStorage;
+
+	// keep terrain data of each region of zones in own file in Regions directory of map. overrides single file storage.
+	// region files are opened on first access and closed when idle. backups are not supported
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bRegionFileStorage;
+
+	// DumpStorageStats after each save
+	UPROPERTY(EditAnywhere, Category = "UnrealSandbox Terrain")
+	bool bDumpStorageStatsOnSave;
+
 	//========================================================================================
 	// materials
 	//========================================================================================
@@ -0,0 +1,624 @@
+#pragma once
+
+#include "EngineMinimal.h"
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "VoxelBufferPool.h"
+
+// sparse brick storage of voxel values, engine types only. used by TVoxelData and standalone voxel tools
+
+typedef unsigned char TDensityVal;
+typedef unsigned short TMaterialId;
+
+// density or material state
+enum TVoxelDataFillState {
+	ZERO = 0,		// data contains only zero values
+	FULL = 1,		// data contains only one same value
+	MIXED = 2		// mixed state, any value in any point
+};
+
+// voxels are stored by bricks of VD_BRICK_SIZE^3
+#define VD_BRICK_SHIFT 3
+#define VD_BRICK_SIZE (1 << VD_BRICK_SHIFT)
+#define VD_BRICK_MASK (VD_BRICK_SIZE - 1)
+#define VD_BRICK_VOLUME (VD_BRICK_SIZE * VD_BRICK_SIZE * VD_BRICK_SIZE)
+
+// order of voxels inside brick, compile-time. see Tools/VoxelBench
+// tiled - rows of brick, z is fastest. morton - Z-order of brick coordinates, 2x2x2 cell corners are closer
+#define VD_LAYOUT_TILED 0
+#define VD_LAYOUT_MORTON 1
+
+#ifndef VD_BRICK_LAYOUT
+#define VD_BRICK_LAYOUT VD_LAYOUT_TILED
+#endif
+
+#if VD_BRICK_LAYOUT == VD_LAYOUT_MORTON
+#if VD_BRICK_SHIFT != 3
+#error "morton brick layout expects 8^3 bricks"
+#endif
+
+#define VD_LAYOUT_NAME TEXT("morton")
+
+// 3 bits of coordinate to every third bit
+FORCEINLINE int spreadBrickBits(int v) {
+	return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4);
+}
+
+FORCEINLINE int brickVoxelIndex(int x, int y, int z) {
+	return (spreadBrickBits(x & VD_BRICK_MASK) << 2) | (spreadBrickBits(y & VD_BRICK_MASK) << 1) | spreadBrickBits(z & VD_BRICK_MASK);
+}
+
+// every third bit back to 3 bits of coordinate
+FORCEINLINE int compactBrickBits(int v) {
+	return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4);
+}
+
+FORCEINLINE void brickVoxelPos(int index, int& x, int& y, int& z) {
+	x = compactBrickBits(index >> 2);
+	y = compactBrickBits(index >> 1);
+	z = compactBrickBits(index);
+}
+#else
+#define VD_LAYOUT_NAME TEXT("tiled")
+
+FORCEINLINE int brickVoxelIndex(int x, int y, int z) {
+	return ((x & VD_BRICK_MASK) << (2 * VD_BRICK_SHIFT)) | ((y & VD_BRICK_MASK) << VD_BRICK_SHIFT) | (z & VD_BRICK_MASK);
+}
+
+FORCEINLINE void brickVoxelPos(int index, int& x, int& y, int& z) {
+	x = (index >> (2 * VD_BRICK_SHIFT)) & VD_BRICK_MASK;
+	y = (index >> VD_BRICK_SHIFT) & VD_BRICK_MASK;
+	z = index & VD_BRICK_MASK;
+}
+#endif
+
+// voxel as brick index (bricks per axis given) in high bits and voxel inside brick in low bits.
+// voxels of one brick are neighbours in order of such indexes
+FORCEINLINE int brickRelativeIndex(int brick_num, int x, int y, int z) {
+	const int brick = ((x >> VD_BRICK_SHIFT) * brick_num + (y >> VD_BRICK_SHIFT)) * brick_num + (z >> VD_BRICK_SHIFT);
+	return (brick << (3 * VD_BRICK_SHIFT)) | brickVoxelIndex(x, y, z);
+}
+
+FORCEINLINE void brickRelativePos(int brick_num, int index, int& x, int& y, int& z) {
+	const int brick = index >> (3 * VD_BRICK_SHIFT);
+	brickVoxelPos(index & (VD_BRICK_VOLUME - 1), x, y, z);
+	x += (brick / (brick_num * brick_num)) << VD_BRICK_SHIFT;
+	y += ((brick / brick_num) % brick_num) << VD_BRICK_SHIFT;
+	z += (brick % brick_num) << VD_BRICK_SHIFT;
+}
+
+// voxels of brick from linear array (x is slowest, z is fastest), source may be unaligned.
+// voxels out of array repeat the first voxel of brick, so brick of one value stays uniform
+template <typename T>
+void gatherBrick(const unsigned char* src, int voxel_num, int bx, int by, int bz, T* values) {
+	const int x0 = bx << VD_BRICK_SHIFT;
+	const int y0 = by << VD_BRICK_SHIFT;
+	const int z0 = bz << VD_BRICK_SHIFT;
+	const int len = std::min(VD_BRICK_SIZE, voxel_num - z0);
+
+	T first;
+	FMemory::Memcpy(&first, src + ((size_t)(x0 * voxel_num + y0) * voxel_num + z0) * sizeof(T), sizeof(T));
+
+	T row[VD_BRICK_SIZE];
+	for (int x = 0; x < VD_BRICK_SIZE; x++) {
+		for (int y = 0; y < VD_BRICK_SIZE; y++) {
+			const unsigned char* row_src = src + ((size_t)((x0 + x) * voxel_num + y0 + y) * voxel_num + z0) * sizeof(T);
+			if (x0 + x < voxel_num && y0 + y < voxel_num && len == VD_BRICK_SIZE) {
+				FMemory::Memcpy(row, row_src, sizeof(row));
+			} else if (x0 + x < voxel_num && y0 + y < voxel_num) {
+				FMemory::Memcpy(row, row_src, len * sizeof(T));
+				std::fill(row + len, row + VD_BRICK_SIZE, first);
+			} else {
+				std::fill(row, row + VD_BRICK_SIZE, first);
+			}
+
+			for (int z = 0; z < VD_BRICK_SIZE; z++) {
+				values[brickVoxelIndex(x, y, z)] = row[z];
+			}
+		}
+	}
+}
+
+// voxels of brick to x planes from min_x to max_x of linear array (x is slowest, z is fastest), inverse of gatherBrick.
+// dst starts at plane min_x and may be unaligned. values nullptr means uniform brick of value
+template <typename T>
+void scatterBrick(const T* values, T value, int voxel_num, int bx, int by, int bz, int min_x, int max_x, unsigned char* dst) {
+	const int x0 = bx << VD_BRICK_SHIFT;
+	const int y0 = by << VD_BRICK_SHIFT;
+	const int z0 = bz << VD_BRICK_SHIFT;
+	const int len = std::min(VD_BRICK_SIZE, voxel_num - z0);
+	const int x_end = std::min(x0 + VD_BRICK_SIZE - 1, max_x);
+	const int y_end = std::min(y0 + VD_BRICK_SIZE, voxel_num);
+
+	T row[VD_BRICK_SIZE];
+	if (values == nullptr) {
+		std::fill(row, row + VD_BRICK_SIZE, value);
+	}
+
+	for (int x = std::max(x0, min_x); x <= x_end; x++) {
+		for (int y = y0; y < y_end; y++) {
+			if (values != nullptr) {
+				for (int z = 0; z < len; z++) {
+					row[z] = values[brickVoxelIndex(x, y, z)];
+				}
+			}
+
+			FMemory::Memcpy(dst + ((size_t)((x - min_x) * voxel_num + y) * voxel_num + z0) * sizeof(T), row, len * sizeof(T));
+		}
+	}
+}
+
+// sparse voxel array. uniform brick keeps one value, voxels of brick are taken from pool on first different value.
+// share() makes copy with the same voxels of bricks, brick is copied on first write to shared voxels
+template <typename T>
+class TBrickArray {
+
+private:
+	typedef struct TBrick {
+		std::shared_ptr<T> data;	// dense voxels or nullptr
+		T value;					// value of uniform brick
+		bool owned;					// voxels were never shared, written in place
+	} TBrick;
+
+	std::vector<TBrick> brick_list;
+	int brick_num = 0; // per axis
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VD_BRICK_SHIFT) * brick_num + (y >> VD_BRICK_SHIFT)) * brick_num + (z >> VD_BRICK_SHIFT);
+	}
+
+	FORCEINLINE static int voxelIndex(int x, int y, int z) {
+		return brickVoxelIndex(x, y, z);
+	}
+
+	static std::shared_ptr<T> newBrickData() {
+		return TVoxelBufferPool::instance().allocateShared<T, VD_BRICK_VOLUME>();
+	}
+
+	TBrickArray(const TBrickArray&) = default;
+	TBrickArray& operator=(const TBrickArray&) = default;
+
+public:
+	TBrickArray() = default;
+	TBrickArray(TBrickArray&&) = default;
+	TBrickArray& operator=(TBrickArray&&) = default;
+
+	// copy with the same voxels. bricks of both arrays are not owned anymore, so writer of either copies brick first
+	TBrickArray share() {
+		for (TBrick& brick : brick_list) brick.owned = false;
+		return TBrickArray(*this);
+	}
+
+	bool isAllocated() const {
+		return !brick_list.empty();
+	}
+
+	// all bricks uniform
+	void allocate(int voxel_num, T fill) {
+		brick_num = (voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT;
+
+		TBrick brick;
+		brick.value = fill;
+		brick.owned = false;
+		brick_list.assign(brick_num * brick_num * brick_num, brick);
+	}
+
+	void release() {
+		brick_list.clear();
+		brick_list.shrink_to_fit();
+		brick_num = 0;
+	}
+
+	// all bricks from linear voxels, brick by brick. only bricks of different values take voxels from pool
+	void import(int voxel_num, const void* src) {
+		brick_num = (voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT;
+		brick_list.assign(brick_num * brick_num * brick_num, TBrick());
+
+		T values[VD_BRICK_VOLUME];
+		for (int bx = 0; bx < brick_num; bx++) {
+			for (int by = 0; by < brick_num; by++) {
+				for (int bz = 0; bz < brick_num; bz++) {
+					gatherBrick((const unsigned char*)src, voxel_num, bx, by, bz, values);
+
+					TBrick& brick = brick_list[(bx * brick_num + by) * brick_num + bz];
+					brick.value = values[0];
+					if (!std::all_of(values, values + VD_BRICK_VOLUME, [&](T v) { return v == values[0]; })) {
+						brick.data = newBrickData();
+						brick.owned = true;
+						std::copy(values, values + VD_BRICK_VOLUME, brick.data.get());
+					}
+				}
+			}
+		}
+	}
+
+	// x planes from min_x to max_x to linear voxels, brick by brick. inverse of import
+	void exportPlanes(int voxel_num, int min_x, int max_x, void* dst) const {
+		for (int bx = min_x >> VD_BRICK_SHIFT; bx <= (max_x >> VD_BRICK_SHIFT); bx++) {
+			for (int by = 0; by < brick_num; by++) {
+				for (int bz = 0; bz < brick_num; bz++) {
+					const TBrick& brick = brick_list[(bx * brick_num + by) * brick_num + bz];
+					scatterBrick(brick.data.get(), brick.value, voxel_num, bx, by, bz, min_x, max_x, (unsigned char*)dst);
+				}
+			}
+		}
+	}
+
+	FORCEINLINE T get(int x, int y, int z) const {
+		const TBrick& brick = brick_list[brickIndex(x, y, z)];
+		return (brick.data != nullptr) ? brick.data.get()[voxelIndex(x, y, z)] : brick.value;
+	}
+
+	// shared voxels are never written, brick gets own copy first
+	FORCEINLINE void set(int x, int y, int z, T value) {
+		TBrick& brick = brick_list[brickIndex(x, y, z)];
+		if (brick.data == nullptr) {
+			if (brick.value == value) {
+				return;
+			}
+
+			brick.data = newBrickData();
+			brick.owned = true;
+			std::fill(brick.data.get(), brick.data.get() + VD_BRICK_VOLUME, brick.value);
+		} else if (!brick.owned) {
+			if (brick.data.get()[voxelIndex(x, y, z)] == value) {
+				return;
+			}
+
+			std::shared_ptr<T> data = newBrickData();
+			std::copy(brick.data.get(), brick.data.get() + VD_BRICK_VOLUME, data.get());
+			brick.data = data;
+			brick.owned = true;
+		}
+
+		brick.data.get()[voxelIndex(x, y, z)] = value;
+	}
+
+	// dense bricks of one value become uniform again
+	void compact() {
+		for (TBrick& brick : brick_list) {
+			if (brick.data == nullptr) {
+				continue;
+			}
+
+			const T* data = brick.data.get();
+			const T value = data[0];
+			if (std::all_of(data, data + VD_BRICK_VOLUME, [value](T v) { return v == value; })) {
+				brick.data = nullptr;
+				brick.value = value;
+			}
+		}
+	}
+
+	// bytes, shared voxels are counted by each copy
+	size_t memoryUsage() const {
+		size_t usage = brick_list.size() * sizeof(TBrick);
+		for (const TBrick& brick : brick_list) {
+			if (brick.data != nullptr) usage += VD_BRICK_VOLUME * sizeof(T);
+		}
+
+		return usage;
+	}
+};
+
+// bits per palette index of brick: 1, 2, 4, 8. wider brick keeps raw values
+#define VD_PALETTE_MAX_BITS 8
+#define VD_RAW_BITS 16
+
+// words of dense brick block: palette of 16 bit values, then packed indexes
+#define VD_PALETTE_BLOCK_WORDS(bits) ((((bits) == VD_RAW_BITS) ? 0 : (1 << (bits)) / 2) + VD_BRICK_VOLUME * (bits) / 32)
+
+// sparse voxel array with palette per brick. dense brick keeps palette and packed palette indexes in one block,
+// index width grows when new value doesn't fit palette. share() shares blocks like TBrickArray
+class TPaletteBrickArray {
+
+private:
+	typedef struct TPaletteBrick {
+		std::shared_ptr<uint32> block;	// palette of 1 << bits entries (none for raw values), then packed indexes. nullptr for uniform brick
+		unsigned short value;			// value of uniform brick
+		unsigned short palette_size;
+		unsigned char bits;
+		bool owned;						// block was never shared, written in place
+	} TPaletteBrick;
+
+	std::vector<TPaletteBrick> brick_list;
+	int brick_num = 0; // per axis
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VD_BRICK_SHIFT) * brick_num + (y >> VD_BRICK_SHIFT)) * brick_num + (z >> VD_BRICK_SHIFT);
+	}
+
+	FORCEINLINE static int voxelIndex(int x, int y, int z) {
+		return brickVoxelIndex(x, y, z);
+	}
+
+	FORCEINLINE static int paletteWords(int bits) {
+		return (bits == VD_RAW_BITS) ? 0 : (1 << bits) / 2;
+	}
+
+	static int indexWords(int bits) {
+		return VD_BRICK_VOLUME * bits / 32;
+	}
+
+	FORCEINLINE static unsigned short* paletteOf(const TPaletteBrick& brick) {
+		return (brick.bits == VD_RAW_BITS) ? nullptr : (unsigned short*)brick.block.get();
+	}
+
+	FORCEINLINE static uint32* indexesOf(const TPaletteBrick& brick) {
+		return brick.block.get() + paletteWords(brick.bits);
+	}
+
+	// bits divide 32, index never crosses word
+	FORCEINLINE static uint32 readIndex(const uint32* index_data, int bits, int i) {
+		const uint32 pos = i * bits;
+		return (index_data[pos >> 5] >> (pos & 31)) & ((1u << bits) - 1);
+	}
+
+	FORCEINLINE static void writeIndex(uint32* index_data, int bits, int i, uint32 index) {
+		const uint32 pos = i * bits;
+		const uint32 mask = ((1u << bits) - 1) << (pos & 31);
+		index_data[pos >> 5] = (index_data[pos >> 5] & ~mask) | (index << (pos & 31));
+	}
+
+	// block size is fixed per index width, so block and its control block are one pooled buffer
+	static std::shared_ptr<uint32> newBlock(int bits) {
+		TVoxelBufferPool& pool = TVoxelBufferPool::instance();
+		std::shared_ptr<uint32> block;
+		switch (bits) {
+			case 1: block = pool.allocateShared<uint32, VD_PALETTE_BLOCK_WORDS(1)>(); break;
+			case 2: block = pool.allocateShared<uint32, VD_PALETTE_BLOCK_WORDS(2)>(); break;
+			case 4: block = pool.allocateShared<uint32, VD_PALETTE_BLOCK_WORDS(4)>(); break;
+			case 8: block = pool.allocateShared<uint32, VD_PALETTE_BLOCK_WORDS(8)>(); break;
+			default: block = pool.allocateShared<uint32, VD_PALETTE_BLOCK_WORDS(VD_RAW_BITS)>(); break;
+		}
+
+		FMemory::Memzero(block.get(), (paletteWords(bits) + indexWords(bits)) * sizeof(uint32));
+		return block;
+	}
+
+	static void unpackBrick(const TPaletteBrick& brick, unsigned short* values) {
+		const unsigned short* palette = paletteOf(brick);
+		const uint32* index_data = indexesOf(brick);
+		for (int i = 0; i < VD_BRICK_VOLUME; i++) {
+			const uint32 index = readIndex(index_data, brick.bits, i);
+			values[i] = (palette != nullptr) ? palette[index] : (unsigned short)index;
+		}
+	}
+
+	// dense brick of given values in new block, smallest index width
+	static void packBrick(TPaletteBrick& brick, const unsigned short* values, const unsigned short* palette, int palette_size) {
+		int bits = 1;
+		while (bits <= VD_PALETTE_MAX_BITS && (1 << bits) < palette_size) bits *= 2;
+		if (bits > VD_PALETTE_MAX_BITS) bits = VD_RAW_BITS;
+
+		brick.block = newBlock(bits);
+		brick.owned = true;
+		brick.bits = bits;
+		brick.palette_size = (bits == VD_RAW_BITS) ? 0 : palette_size;
+
+		unsigned short* new_palette = paletteOf(brick);
+		uint32* index_data = indexesOf(brick);
+		if (new_palette == nullptr) {
+			for (int i = 0; i < VD_BRICK_VOLUME; i++) writeIndex(index_data, bits, i, values[i]);
+			return;
+		}
+
+		std::copy(palette, palette + palette_size, new_palette);
+		int index = 0;
+		for (int i = 0; i < VD_BRICK_VOLUME; i++) {
+			if (i == 0 || values[i] != values[i - 1]) {
+				index = (int)(std::find(palette, palette + palette_size, values[i]) - palette);
+			}
+
+			writeIndex(index_data, bits, i, index);
+		}
+	}
+
+	// own block with room for one more palette entry if needed. full palette makes indexes twice wider,
+	// palette of 256 entries becomes raw values
+	static void prepareBrick(TPaletteBrick& brick, bool bGrowPalette) {
+		const bool bWiden = bGrowPalette && brick.palette_size == (1 << brick.bits);
+		if (!bWiden) {
+			if (!brick.owned) {
+				const int words = paletteWords(brick.bits) + indexWords(brick.bits);
+				std::shared_ptr<uint32> block = newBlock(brick.bits);
+				std::copy(brick.block.get(), brick.block.get() + words, block.get());
+				brick.block = block;
+				brick.owned = true;
+			}
+
+			return;
+		}
+
+		unsigned short values[VD_BRICK_VOLUME];
+		unpackBrick(brick, values);
+
+		// placeholder entry for width of new value
+		std::vector<unsigned short> palette(paletteOf(brick), paletteOf(brick) + brick.palette_size);
+		palette.push_back(values[0]);
+
+		packBrick(brick, values, palette.data(), (int)palette.size());
+		if (brick.bits != VD_RAW_BITS) {
+			brick.palette_size--;
+		}
+	}
+
+	TPaletteBrickArray(const TPaletteBrickArray&) = default;
+	TPaletteBrickArray& operator=(const TPaletteBrickArray&) = default;
+
+public:
+	TPaletteBrickArray() = default;
+	TPaletteBrickArray(TPaletteBrickArray&&) = default;
+	TPaletteBrickArray& operator=(TPaletteBrickArray&&) = default;
+
+	// copy with the same blocks, see TBrickArray::share()
+	TPaletteBrickArray share() {
+		for (TPaletteBrick& brick : brick_list) brick.owned = false;
+		return TPaletteBrickArray(*this);
+	}
+
+	bool isAllocated() const {
+		return !brick_list.empty();
+	}
+
+	// all bricks uniform
+	void allocate(int voxel_num, unsigned short fill) {
+		brick_num = (voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT;
+
+		TPaletteBrick brick;
+		brick.value = fill;
+		brick.palette_size = 0;
+		brick.bits = 0;
+		brick.owned = false;
+		brick_list.assign(brick_num * brick_num * brick_num, brick);
+	}
+
+	void release() {
+		brick_list.clear();
+		brick_list.shrink_to_fit();
+		brick_num = 0;
+	}
+
+	// all bricks from linear voxels, brick by brick, with palette of brick values
+	void import(int voxel_num, const void* src) {
+		brick_num = (voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT;
+		brick_list.assign(brick_num * brick_num * brick_num, TPaletteBrick());
+
+		unsigned short values[VD_BRICK_VOLUME];
+		unsigned short palette[(1 << VD_PALETTE_MAX_BITS) + 1];
+		for (int bx = 0; bx < brick_num; bx++) {
+			for (int by = 0; by < brick_num; by++) {
+				for (int bz = 0; bz < brick_num; bz++) {
+					gatherBrick((const unsigned char*)src, voxel_num, bx, by, bz, values);
+
+					// more than max palette entries means raw values
+					int palette_size = 0;
+					for (int v = 0; v < VD_BRICK_VOLUME && palette_size <= (1 << VD_PALETTE_MAX_BITS); v++) {
+						if (v > 0 && values[v] == values[v - 1]) continue;
+						if (std::find(palette, palette + palette_size, values[v]) == palette + palette_size) {
+							palette[palette_size++] = values[v];
+						}
+					}
+
+					TPaletteBrick& brick = brick_list[(bx * brick_num + by) * brick_num + bz];
+					brick.value = values[0];
+					brick.palette_size = 0;
+					brick.bits = 0;
+					brick.owned = false;
+					if (palette_size > 1) {
+						packBrick(brick, values, palette, palette_size);
+					}
+				}
+			}
+		}
+	}
+
+	// x planes from min_x to max_x to linear voxels, brick by brick. inverse of import
+	void exportPlanes(int voxel_num, int min_x, int max_x, void* dst) const {
+		unsigned short values[VD_BRICK_VOLUME];
+		for (int bx = min_x >> VD_BRICK_SHIFT; bx <= (max_x >> VD_BRICK_SHIFT); bx++) {
+			for (int by = 0; by < brick_num; by++) {
+				for (int bz = 0; bz < brick_num; bz++) {
+					const TPaletteBrick& brick = brick_list[(bx * brick_num + by) * brick_num + bz];
+					if (brick.block != nullptr) {
+						unpackBrick(brick, values);
+					}
+
+					scatterBrick((brick.block != nullptr) ? values : (const unsigned short*)nullptr, brick.value, voxel_num, bx, by, bz, min_x, max_x, (unsigned char*)dst);
+				}
+			}
+		}
+	}
+
+	FORCEINLINE unsigned short get(int x, int y, int z) const {
+		const TPaletteBrick& brick = brick_list[brickIndex(x, y, z)];
+		if (brick.block == nullptr) {
+			return brick.value;
+		}
+
+		const uint32 index = readIndex(indexesOf(brick), brick.bits, voxelIndex(x, y, z));
+		const unsigned short* palette = paletteOf(brick);
+		return (palette != nullptr) ? palette[index] : (unsigned short)index;
+	}
+
+	void set(int x, int y, int z, unsigned short value) {
+		TPaletteBrick& brick = brick_list[brickIndex(x, y, z)];
+		if (brick.block == nullptr) {
+			if (brick.value == value) {
+				return;
+			}
+
+			// uniform brick becomes 1 bit brick of old value
+			brick.bits = 1;
+			brick.block = newBlock(1);
+			brick.owned = true;
+			paletteOf(brick)[0] = brick.value;
+			brick.palette_size = 1;
+		}
+
+		if (get(x, y, z) == value) {
+			return;
+		}
+
+		uint32 index = value;
+		if (paletteOf(brick) != nullptr) {
+			const unsigned short* palette = paletteOf(brick);
+			index = (uint32)(std::find(palette, palette + brick.palette_size, value) - palette);
+		}
+
+		const bool bNewEntry = paletteOf(brick) != nullptr && index == brick.palette_size;
+		prepareBrick(brick, bNewEntry);
+
+		if (bNewEntry) {
+			if (paletteOf(brick) != nullptr) {
+				paletteOf(brick)[brick.palette_size++] = value;
+			} else {
+				index = value;
+			}
+		}
+
+		writeIndex(indexesOf(brick), brick.bits, voxelIndex(x, y, z), index);
+	}
+
+	// unused palette entries are dropped, dense bricks of one value become uniform again
+	void compact() {
+		for (TPaletteBrick& brick : brick_list) {
+			if (brick.block == nullptr) {
+				continue;
+			}
+
+			unsigned short values[VD_BRICK_VOLUME];
+			unpackBrick(brick, values);
+
+			std::vector<unsigned short> palette;
+			for (int v = 0; v < VD_BRICK_VOLUME; v++) {
+				if (std::find(palette.begin(), palette.end(), values[v]) == palette.end()) {
+					palette.push_back(values[v]);
+					if (palette.size() > ((size_t)1 << VD_PALETTE_MAX_BITS)) break;
+				}
+			}
+
+			if (palette.size() == 1) {
+				brick.block = nullptr;
+				brick.value = values[0];
+				brick.palette_size = 0;
+				brick.bits = 0;
+			} else if (palette.size() != brick.palette_size) {
+				packBrick(brick, values, palette.data(), (int)palette.size());
+			}
+		}
+	}
+
+	// bytes, shared blocks are counted by each copy
+	size_t memoryUsage() const {
+		size_t usage = brick_list.size() * sizeof(TPaletteBrick);
+		for (const TPaletteBrick& brick : brick_list) {
+			if (brick.block != nullptr) usage += (paletteWords(brick.bits) + indexWords(brick.bits)) * sizeof(uint32);
+		}
+
+		return usage;
+	}
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "EngineMinimal.h"
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <mutex>
+#include <atomic>
+
+// voxel buffers are carved from slabs and kept in free lists per size class after release.
+// bigger buffers go to general heap. largest class fits 1024 bytes of voxels with shared pointer control block
+#define VD_POOL_SLAB_SIZE (2 * 1024 * 1024)
+#define VD_POOL_GRANULARITY 16
+#define VD_POOL_MAX_SIZE (1024 + 64)
+#define VD_POOL_CLASS_COUNT (VD_POOL_MAX_SIZE / VD_POOL_GRANULARITY)
+
+// back slabs by transparent huge pages where supported
+#ifndef VD_POOL_HUGE_PAGES
+#define VD_POOL_HUGE_PAGES 1
+#endif
+
+typedef struct TVoxelBufferPoolStats {
+	uint64 slabBytes = 0;
+	uint64 usedBytes = 0;	// pooled buffers in use
+	uint64 freeBytes = 0;	// buffers in free lists
+} TVoxelBufferPoolStats;
+
+class TVoxelBufferPool {
+
+private:
+	typedef struct TFreeBuffer {
+		TFreeBuffer* next;
+	} TFreeBuffer;
+
+	typedef struct TSizeClass {
+		std::mutex mutex;
+		TFreeBuffer* free_list = nullptr;
+		uint64 free_count = 0;
+	} TSizeClass;
+
+	std::array<TSizeClass, VD_POOL_CLASS_COUNT> class_list;
+
+	std::mutex slab_mutex;
+	std::vector<void*> slab_list;
+	uint8* slab_pos = nullptr;
+	uint64 slab_left = 0;
+
+	std::atomic<uint64> used_bytes{ 0 };
+
+	TVoxelBufferPool() { }
+
+	static size_t classIndex(size_t size) {
+		return (size + VD_POOL_GRANULARITY - 1) / VD_POOL_GRANULARITY - 1;
+	}
+
+	void* allocateFromSlab(size_t size);
+
+public:
+	TVoxelBufferPool(const TVoxelBufferPool&) = delete;
+	TVoxelBufferPool& operator=(const TVoxelBufferPool&) = delete;
+
+	static TVoxelBufferPool& instance();
+
+	void* allocate(size_t size);
+
+	// size must be the same as in allocate
+	void free(void* ptr, size_t size);
+
+	TVoxelBufferPoolStats getStats();
+
+	// buffer of Count elements in one pooled block with its control block, returned to pool with the last owner.
+	// content is undefined
+	template <typename T, size_t Count>
+	std::shared_ptr<T> allocateShared();
+};
+
+// std allocator on top of pool. construct without arguments leaves trivial types uninitialized
+template <typename T>
+class TVoxelPoolAllocator {
+
+public:
+	typedef T value_type;
+
+	TVoxelPoolAllocator() noexcept { }
+
+	template <typename U>
+	TVoxelPoolAllocator(const TVoxelPoolAllocator<U>&) noexcept { }
+
+	T* allocate(size_t count) {
+		return (T*)TVoxelBufferPool::instance().allocate(count * sizeof(T));
+	}
+
+	void deallocate(T* ptr, size_t count) {
+		TVoxelBufferPool::instance().free(ptr, count * sizeof(T));
+	}
+
+	template <typename U>
+	void construct(U* ptr) {
+		::new((void*)ptr) U;
+	}
+
+	template <typename U, typename... Args>
+	void construct(U* ptr, Args&&... args) {
+		::new((void*)ptr) U(std::forward<Args>(args)...);
+	}
+
+	template <typename U>
+	bool operator==(const TVoxelPoolAllocator<U>&) const noexcept {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const TVoxelPoolAllocator<U>&) const noexcept {
+		return false;
+	}
+};
+
+template <typename T, size_t Count>
+std::shared_ptr<T> TVoxelBufferPool::allocateShared() {
+	typedef struct TBuffer {
+		T data[Count];
+	} TBuffer;
+
+	// pointer to elements shares control block of whole buffer
+	std::shared_ptr<TBuffer> buffer = std::allocate_shared<TBuffer>(TVoxelPoolAllocator<TBuffer>());
+	return std::shared_ptr<T>(buffer, buffer->data);
+}
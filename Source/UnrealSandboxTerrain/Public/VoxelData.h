@@ -9,18 +9,11 @@
 #include <mutex>
 #include <functional>
 #include <vector>
+#include <algorithm>
 
-#define LOD_ARRAY_SIZE 7
-
-typedef unsigned char TDensityVal;
-typedef unsigned short TMaterialId;
+#include "VoxelBrickArray.h"
 
-// density or material state
-enum TVoxelDataFillState {
-	ZERO = 0,		// data contains only zero values
-	FULL = 1,		// data contains only one same value
-	MIXED = 2		// mixed state, any value in any point
-};
+#define LOD_ARRAY_SIZE 7
 
 typedef struct TSubstanceCache {
 	std::list<int> cellList;
@@ -42,8 +35,8 @@ private:
 
 	int voxel_num;
 	float volume_size;
-	unsigned char* density_data;
-	unsigned short* material_data;
+	TBrickArray<unsigned char> density_data;
+	TPaletteBrickArray material_data;
 	std::vector<FVector> normal_data;
 
 	volatile double last_change;
@@ -55,6 +48,11 @@ private:
 	FVector lower = FVector(0.0f, 0.0f, 0.0f);
 	FVector upper = FVector(0.0f, 0.0f, 0.0f);
 
+	// changed x planes since last save or load. layout change means stored data can't be patched
+	int dirty_min_x;
+	int dirty_max_x;
+	bool layout_changed;
+
 	void initializeDensity();
 	void initializeMaterial();
 
@@ -68,8 +66,13 @@ public:
 
 	std::mutex vd_edit_mutex;
 
-	FORCEINLINE int clcLinearIndex(int x, int y, int z) const {
-		return x * voxel_num * voxel_num + y * voxel_num + z;
+	// index of substance cache cell, brick relative: brick of cell in high bits, voxel inside brick in low bits
+	FORCEINLINE int clcCellIndex(int x, int y, int z) const {
+		return brickRelativeIndex((voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT, x, y, z);
+	};
+
+	FORCEINLINE void clcCellPos(int index, int& x, int& y, int& z) const {
+		brickRelativePos((voxel_num + VD_BRICK_MASK) >> VD_BRICK_SHIFT, index, x, y, z);
 	};
 
 	void forEach(std::function<void(int x, int y, int z)> func);
@@ -108,17 +111,53 @@ public:
 	void performSubstanceCacheLOD(int x, int y, int z);
 
 	TVoxelDataFillState getDensityFillState() const;
+	bool hasMaterialData() const { return material_data.isAllocated(); }
 	//VoxelDataFillState getMaterialFillState() const; 
 
 	void deinitializeDensity(TVoxelDataFillState density_state);
 	void deinitializeMaterial(unsigned short base_mat);
 
+	// release voxels of bricks filled with one value. call after bulk fill
+	void compact();
+
+	// mixed density and material from stored linear voxels, brick by brick. loaded voxels are not dirty
+	void importVoxels(const void* density, const void* material);
+
+	// x planes from min_x to max_x as stored linear voxels, brick by brick. nullptr skips density or material
+	void exportVoxels(int min_x, int max_x, void* density, void* material) const;
+
+	// copy sharing voxel bricks with this data, brick is copied on next write of either side.
+	// marks bricks of this data as shared, so caller holds vd_edit_mutex. snapshot itself needs no lock
+	std::shared_ptr<TVoxelData> snapshot();
+
+	// bytes of density and material voxels
+	size_t memoryUsage() const;
+
 	void setChanged() { last_change = FPlatformTime::Seconds(); }
 	bool isChanged() { return last_change > last_save; }
 	void resetLastSave() { last_save = FPlatformTime::Seconds(); }
 	bool needToRegenerateMesh() { return last_change > last_mesh_generation; }
 	void resetLastMeshRegenerationTime() { last_mesh_generation = FPlatformTime::Seconds(); }
 
+	void markDirty(int x) {
+		if (x < dirty_min_x) dirty_min_x = x;
+		if (x > dirty_max_x) dirty_max_x = x;
+	}
+
+	bool getDirtyRange(int& min_x, int& max_x) const {
+		min_x = dirty_min_x;
+		max_x = dirty_max_x;
+		return dirty_min_x <= dirty_max_x;
+	}
+
+	bool isLayoutChanged() const { return layout_changed; }
+
+	void resetDirty() {
+		dirty_min_x = voxel_num;
+		dirty_max_x = -1;
+		layout_changed = false;
+	}
+
 	bool isSubstanceCacheValid() const { return last_change <= last_cache_check; }
 	void setCacheToValid() { last_cache_check = FPlatformTime::Seconds(); }
 
@@ -133,6 +172,6 @@ public:
 	friend void serializeVoxelData(TVoxelData& vd, FBufferArchive& binaryData);
 	friend void deserializeVoxelData(TVoxelData &vd, FMemoryReader& binaryData);
 
-	friend void deserializeVoxelData2(TVoxelData* vd, TArray<uint8>& Data, bool createSubstanceCache);
+	friend void deserializeVoxelData2(TVoxelData* vd, const uint8* Data, bool createSubstanceCache);
 
 };
@@ -6,17 +6,56 @@
 #include <fstream>
 #include <stdint.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <array>
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <string>
 #include <list>
 #include <set>
+#include <map>
+#include <iterator>
 #include <mutex>
 #include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <deque>
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <ctime>
 #include <cstring> 
 
+#if defined(_WIN32)
+#if defined(PLATFORM_WINDOWS) // unreal build
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// probe 16 control bytes of key index at once
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KVDB_SSE2 1
+#include <emmintrin.h>
+#endif
 
 #define KVDB_KEY_SIZE 12 // 3 x int32 (X, Y, Z)
 #define KVDB_RESERVED_TABLE_SIZE 1000
@@ -36,17 +75,41 @@ namespace std {
 	template <>
 	struct hash<TKeyData> {
 		std::size_t operator()(const TKeyData& keyData) const {
-			std::size_t h = 0;
-			for (auto elem : keyData) {
-				h ^= std::hash<int>{}(elem)+0x9e3779b9 + (h << 6) + (h >> 2);
-			}
-			return h;
+			// mix key as two words instead of byte by byte
+			unsigned long long lo;
+			uint32_t hi;
+			std::memcpy(&lo, keyData.data(), sizeof(lo));
+			std::memcpy(&hi, keyData.data() + sizeof(lo), sizeof(hi));
+
+			unsigned long long h = lo ^ (hi * 0x9E3779B97F4A7C15ULL);
+			h ^= h >> 30;
+			h *= 0xBF58476D1CE4E5B9ULL;
+			h ^= h >> 27;
+			h *= 0x94D049BB133111EBULL;
+			h ^= h >> 31;
+			return (std::size_t)h;
 		}
 	};
 }
 
 namespace kvdb {
 
+	//============================================================================
+	// Error log
+	//============================================================================
+
+	// unsupported calls are reported here. no output by default
+	typedef std::function<void(const std::string&)> TErrorLogFunc;
+
+	inline TErrorLogFunc& errorLog() {
+		static TErrorLogFunc logFunc;
+		return logFunc;
+	}
+
+	inline void logError(const std::string& message) {
+		if (errorLog()) errorLog()(message);
+	}
+
 	//============================================================================
 	// Base IO
 	//============================================================================
@@ -88,490 +151,5734 @@ namespace kvdb {
 	};
 
 	//============================================================================
-	// File header
+	// Telemetry
 	//============================================================================
-	typedef struct TFileHeader {
-		uint32 version = 1;
-		uint32 keySize = 0;
-		ulong64 timestamp = 0;
-		uint32  endOfHeaderOffset = 0;
-	} TFileHeader;
 
-	inline std::ostream* operator << (std::ostream* os, const TFileHeader& obj) {
-		write(os, obj);
-		return os;
-	}
+	#define KVDB_HISTOGRAM_BUCKETS 32
 
-	inline std::istream* operator >> (std::istream* is, TFileHeader& obj) {
-		read(is, obj);
-		return is;
-	}
+	// each read or write call is one positional request (seek)
+	typedef struct TIoStats {
+		ulong64 readOps = 0;
+		ulong64 readBytes = 0;
+		ulong64 writeOps = 0;
+		ulong64 writeBytes = 0;
+		ulong64 syncOps = 0;
+	} TIoStats;
 
-	//============================================================================
-	// Table header
-	//============================================================================
-	typedef struct TTableHeader {
-		ulong64 recordCount = 0;
-		ulong64 nextTable = 0;
-	} TTableHeader;
+	// microseconds. percentiles are upper bounds of histogram buckets
+	typedef struct TLatencyStats {
+		ulong64 count = 0;
+		ulong64 totalUs = 0;
+		ulong64 p50Us = 0;
+		ulong64 p90Us = 0;
+		ulong64 p99Us = 0;
+		ulong64 maxUs = 0;
+	} TLatencyStats;
 
-	typedef TPosWrapper<TTableHeader> TTableHeaderInfo;
+	// lock-free latency histogram, power of two buckets of microseconds
+	class TLatencyHistogram {
 
-	inline std::ostream* operator << (std::ostream* os, const TTableHeader& obj) {
-		write(os, obj);
-		return os;
-	}
+	private:
+		std::array<std::atomic<ulong64>, KVDB_HISTOGRAM_BUCKETS> bucketList = {};
+		std::atomic<ulong64> count{ 0 };
+		std::atomic<ulong64> totalUs{ 0 };
+		std::atomic<ulong64> maxUs{ 0 };
 
-	inline std::istream* operator >> (std::istream* is, TTableHeader& obj) {
-		read(is, obj);
-		return is;
-	}
+		static uint32 bucketOf(ulong64 us) {
+			uint32 bucket = 0;
+			while (us > 0 && bucket < KVDB_HISTOGRAM_BUCKETS - 1) {
+				us >>= 1;
+				bucket++;
+			}
 
-	//============================================================================
-	// Key Entry
-	//============================================================================
-	typedef struct TKeyEntry {
-		ulong64 dataPos = 0;
-		ulong64 dataLength = 0;
-		ulong64 initialDataLength = 0;
+			return bucket;
+		}
 
-		TKeyData freeKeyData;
-	} TKeyEntry;
+		ulong64 percentile(const std::array<ulong64, KVDB_HISTOGRAM_BUCKETS>& snapshot, ulong64 total, double p) const {
+			const ulong64 rank = (ulong64)(total * p);
+			ulong64 sum = 0;
+			for (uint32 bucket = 0; bucket < KVDB_HISTOGRAM_BUCKETS; bucket++) {
+				sum += snapshot[bucket];
+				if (sum > rank) return (bucket == 0) ? 0 : (1ULL << bucket) - 1;
+			}
 
-	typedef TPosWrapper<TKeyEntry> TKeyEntryInfo;
+			return maxUs.load(std::memory_order_relaxed);
+		}
+
+	public:
+		void add(ulong64 us) {
+			bucketList[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+			totalUs.fetch_add(us, std::memory_order_relaxed);
 
-	struct TKeyInfoComparatorByInitialLength {
-		bool operator() (const TKeyEntryInfo &lhs, const TKeyEntryInfo &rhs) const {
-			return (lhs().initialDataLength > rhs().initialDataLength);
+			ulong64 prev = maxUs.load(std::memory_order_relaxed);
+			while (us > prev && !maxUs.compare_exchange_weak(prev, us, std::memory_order_relaxed));
 		}
-	};
 
-	inline std::ostream* operator << (std::ostream* os, const TKeyEntry& obj) {
-		write(os, obj);
-		return os;
-	}
+		void reset() {
+			for (auto& bucket : bucketList) bucket.store(0, std::memory_order_relaxed);
+			count.store(0, std::memory_order_relaxed);
+			totalUs.store(0, std::memory_order_relaxed);
+			maxUs.store(0, std::memory_order_relaxed);
+		}
 
-	inline std::istream* operator >> (std::istream* is, TKeyEntry& obj) {
-		read(is, obj);
-		return is;
-	}
+		TLatencyStats getStats() const {
+			std::array<ulong64, KVDB_HISTOGRAM_BUCKETS> snapshot;
+			ulong64 total = 0;
+			for (uint32 bucket = 0; bucket < KVDB_HISTOGRAM_BUCKETS; bucket++) {
+				snapshot[bucket] = bucketList[bucket].load(std::memory_order_relaxed);
+				total += snapshot[bucket];
+			}
 
-	//============================================================================
-	// File db
-	//============================================================================
-	template <typename K, typename V>
-	class KvFile {
+			TLatencyStats stats;
+			stats.count = total;
+			stats.totalUs = totalUs.load(std::memory_order_relaxed);
+			stats.maxUs = maxUs.load(std::memory_order_relaxed);
+			if (total > 0) {
+				stats.p50Us = std::min(percentile(snapshot, total, 0.50), stats.maxUs);
+				stats.p90Us = std::min(percentile(snapshot, total, 0.90), stats.maxUs);
+				stats.p99Us = std::min(percentile(snapshot, total, 0.99), stats.maxUs);
+			}
 
-	private:
+			return stats;
+		}
+	};
 
-		std::unordered_map<TKeyData, TKeyEntryInfo> dataMap;
-		std::fstream* filePtr = nullptr;
-		std::list<TKeyEntryInfo> reservedKeyList;
-		std::set<TKeyEntryInfo, TKeyInfoComparatorByInitialLength> deletedKeyList;
-		std::list<TTableHeaderInfo> tableList;
-		mutable std::shared_mutex fileSharedMutex;
-		
-		uint32 reservedKeys = KVDB_RESERVED_TABLE_SIZE;
-		uint32 reservedValueSize = 0;
+	// adds time from construction to destruction
+	class TLatencyTimer {
 
 	private:
+		TLatencyHistogram& histogram;
+		std::chrono::steady_clock::time_point start;
 
-		std::shared_ptr<V> valueFromData(TValueDataPtr dataPtr) {
-			if (dataPtr == nullptr) return nullptr;
+	public:
+		TLatencyTimer(TLatencyHistogram& h) : histogram(h), start(std::chrono::steady_clock::now()) {};
 
-			if constexpr (std::is_same_v<V, TValueData>) {
-				return std::static_pointer_cast<TValueData>(dataPtr);
-			} else {
-				V* temp = new V();
-				memcpy(temp, dataPtr->data(), dataPtr->size());
-				return std::shared_ptr<V>(temp);
-			}
+		~TLatencyTimer() {
+			histogram.add((ulong64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
 		}
+	};
 
-		static TKeyData toKeyData(K key) {
-			byte temp[KVDB_KEY_SIZE];
-			for (int i = 0; i < KVDB_KEY_SIZE; i++) temp[i] = 0;
+	//============================================================================
+	// Positional file IO. 
+	// readAt/writeAt don't use shared file position, so concurrent reads are safe
+	//============================================================================
+	class TFileIO {
 
-			memcpy(&temp, &key, sizeof(K));
+	private:
+#if defined(_WIN32)
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;
+#else
+		int fd = -1;
+#endif
 
-			TKeyData arrayOfByte;
-			for (int i = 0; i < KVDB_KEY_SIZE; i++) arrayOfByte[i] = temp[i];
+		mutable std::atomic<ulong64> readOps{ 0 };
+		mutable std::atomic<ulong64> readBytes{ 0 };
+		std::atomic<ulong64> writeOps{ 0 };
+		std::atomic<ulong64> writeBytes{ 0 };
+		std::atomic<ulong64> syncOps{ 0 };
 
-			return arrayOfByte;
-		}
+	public:
+		TFileIO() {};
 
-		static void toValueData(V value, TValueData& valueData) {
-			if (valueData.size() < sizeof(value)) valueData.resize(sizeof(value));
-			std::memcpy(valueData.data(), &value, sizeof(value));
+		TFileIO(const TFileIO&) = delete;
+
+		TFileIO& operator=(const TFileIO&) = delete;
+
+		~TFileIO() {
+			close();
 		}
 
-		void rewritePair(TKeyEntryInfo& keyInfo, const TValueData& valueData) {
-			// rewrite value data
-			filePtr->seekg(keyInfo().dataPos);
-			filePtr->write((char*)valueData.data(), valueData.size());
+		bool open(const std::string& file, bool create = false) {
+			close();
+#if defined(_WIN32)
+			fileHandle = CreateFileA(file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+			fd = create ? ::open(file.c_str(), O_RDWR | O_CREAT, 0644) : ::open(file.c_str(), O_RDWR);
+#endif
+			return isOpen();
+		}
 
-			// rewrite key data
-			keyInfo().dataLength = valueData.size(); // new length
-			filePtr->seekg(keyInfo.pos);
-			filePtr << keyInfo();
+		void close() {
+#if defined(_WIN32)
+			if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+			fileHandle = INVALID_HANDLE_VALUE;
+#else
+			if (fd >= 0) ::close(fd);
+			fd = -1;
+#endif
 		}
 
-		void earsePair(TKeyEntryInfo& keyInfo) {
-			// rewrite key data
-			keyInfo().dataLength = 0; // new length
-			filePtr->seekg(keyInfo.pos);
-			filePtr << keyInfo();
+		bool isOpen() const {
+#if defined(_WIN32)
+			return fileHandle != INVALID_HANDLE_VALUE;
+#else
+			return fd >= 0;
+#endif
+		}
 
-			deletedKeyList.insert(keyInfo);
-			dataMap.erase(keyInfo().freeKeyData);
+		ulong64 size() const {
+#if defined(_WIN32)
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(fileHandle, &fileSize)) return 0;
+			return (ulong64)fileSize.QuadPart;
+#else
+			struct stat st;
+			if (fstat(fd, &st) != 0) return 0;
+			return (ulong64)st.st_size;
+#endif
 		}
 
-		void expandValueData(const TValueData& valueDataSrc, TValueData& valueDataNew) {
-			valueDataNew.resize(reservedValueSize);
-			for (uint32 i = 0; i < reservedValueSize; i++){
-				if(i < valueDataSrc.size()){
-					valueDataNew[i] = valueDataSrc[i];	
-				} else {
-					valueDataNew[i] = 0;	
-				}
+		bool readAt(ulong64 pos, void* buffer, ulong64 length) const {
+			readOps.fetch_add(1, std::memory_order_relaxed);
+			readBytes.fetch_add(length, std::memory_order_relaxed);
+
+			byte* ptr = (byte*)buffer;
+			while (length > 0) {
+#if defined(_WIN32)
+				OVERLAPPED ov = {};
+				ov.Offset = (DWORD)(pos & 0xFFFFFFFF);
+				ov.OffsetHigh = (DWORD)(pos >> 32);
+				DWORD chunk = (length > 0x40000000) ? 0x40000000 : (DWORD)length;
+				DWORD res = 0;
+				if (!ReadFile(fileHandle, ptr, chunk, &res, &ov) || res == 0) return false;
+#else
+				ssize_t res = ::pread(fd, ptr, (size_t)length, (off_t)pos);
+				if (res <= 0) return false;
+#endif
+				ptr += res;
+				pos += res;
+				length -= res;
 			}
+
+			return true;
 		}
 
-		void newPairFromReserved(const TKeyData& keyData, const TValueData& valueData) {
-			// has reserved key slots
-			TKeyEntryInfo& keyInfo = reservedKeyList.front();
-			TValueData valueDataExp;
-			
-			if(valueData.size() < reservedValueSize){
-				expandValueData(valueData, valueDataExp);
-			} else {
-				valueDataExp = std::move(valueData);
+		bool writeAt(ulong64 pos, const void* buffer, ulong64 length) {
+			writeOps.fetch_add(1, std::memory_order_relaxed);
+			writeBytes.fetch_add(length, std::memory_order_relaxed);
+
+			const byte* ptr = (const byte*)buffer;
+			while (length > 0) {
+#if defined(_WIN32)
+				OVERLAPPED ov = {};
+				ov.Offset = (DWORD)(pos & 0xFFFFFFFF);
+				ov.OffsetHigh = (DWORD)(pos >> 32);
+				DWORD chunk = (length > 0x40000000) ? 0x40000000 : (DWORD)length;
+				DWORD res = 0;
+				if (!WriteFile(fileHandle, ptr, chunk, &res, &ov) || res == 0) return false;
+#else
+				ssize_t res = ::pwrite(fd, ptr, (size_t)length, (off_t)pos);
+				if (res <= 0) return false;
+#endif
+				ptr += res;
+				pos += res;
+				length -= res;
 			}
 
-			filePtr->seekg(0, std::ios::end); // to end-of-file
-			ulong64 endFile = (ulong64)(filePtr->tellp());
-			filePtr->write((char*)valueDataExp.data(), valueDataExp.size());
+			return true;
+		}
 
-			// fill key data
-			keyInfo().dataLength = valueData.size(); // length
-			keyInfo().initialDataLength = valueDataExp.size(); // length
-			keyInfo().dataPos = endFile;
-			keyInfo().freeKeyData = keyData;
+		// flush file data to disk
+		bool sync() {
+			syncOps.fetch_add(1, std::memory_order_relaxed);
+#if defined(_WIN32)
+			return FlushFileBuffers(fileHandle) != 0;
+#else
+			return fsync(fd) == 0;
+#endif
+		}
 
-			filePtr->seekg(keyInfo.pos);
-			filePtr << keyInfo();
+		bool truncate(ulong64 length) {
+#if defined(_WIN32)
+			LARGE_INTEGER pos;
+			pos.QuadPart = (LONGLONG)length;
+			if (!SetFilePointerEx(fileHandle, pos, NULL, FILE_BEGIN)) return false;
+			return SetEndOfFile(fileHandle) != 0;
+#else
+			return ftruncate(fd, (off_t)length) == 0;
+#endif
+		}
 
-			// add new pair to table 
-			dataMap.insert({ keyInfo().freeKeyData, keyInfo });
-			reservedKeyList.pop_front();
+		template <typename T>
+		bool readObj(ulong64 pos, T& obj) const {
+			return readAt(pos, &obj, sizeof(T));
 		}
 
-		ulong64 readTable() {
-			ulong64 tablePos = (ulong64)filePtr->tellp();
+		// counters survive reopen
+		TIoStats getStats() const {
+			TIoStats stats;
+			stats.readOps = readOps.load(std::memory_order_relaxed);
+			stats.readBytes = readBytes.load(std::memory_order_relaxed);
+			stats.writeOps = writeOps.load(std::memory_order_relaxed);
+			stats.writeBytes = writeBytes.load(std::memory_order_relaxed);
+			stats.syncOps = syncOps.load(std::memory_order_relaxed);
+			return stats;
+		}
 
-			TTableHeader tableHeader;
-			filePtr >> tableHeader;
+		void resetStats() {
+			readOps.store(0, std::memory_order_relaxed);
+			readBytes.store(0, std::memory_order_relaxed);
+			writeOps.store(0, std::memory_order_relaxed);
+			writeBytes.store(0, std::memory_order_relaxed);
+			syncOps.store(0, std::memory_order_relaxed);
+		}
 
-			for (unsigned int i = 0; i < tableHeader.recordCount; i++) {
-				ulong64 pos = (ulong64)filePtr->tellp();
+		template <typename T>
+		bool writeObj(ulong64 pos, const T& obj) {
+			return writeAt(pos, &obj, sizeof(T));
+		}
+	};
 
-				TKeyEntry keyEntry;
-				filePtr >> keyEntry;
+	//============================================================================
+	// Read-only memory mapping of whole file
+	//============================================================================
+	class TFileMapping {
 
-				TKeyEntryInfo keyInfo(keyEntry, pos);
+	private:
+		byte* basePtr = nullptr;
+		ulong64 mappedLength = 0;
 
-				if (keyInfo().dataLength > 0) {
-					dataMap.insert({ keyEntry.freeKeyData, keyInfo });
-				} else {
-					if (keyInfo().initialDataLength == 0) {
-						// reserved key slot
-						reservedKeyList.push_back(keyInfo);
-					} else {
-						// marked as deleted pair
-						deletedKeyList.insert(keyInfo);
-					}
-				}
-			}
+	public:
+		TFileMapping() {};
 
-			tableList.push_back(TTableHeaderInfo(tableHeader, tablePos));
-			return tableHeader.nextTable;
-		}
+		TFileMapping(const TFileMapping&) = delete;
 
-		void createNewTable() {
-			filePtr->seekg(0, std::ios::end); // to end-of-file
-			ulong64 newTablePos = (ulong64)filePtr->tellp();
+		TFileMapping& operator=(const TFileMapping&) = delete;
 
-			// write new table
-			TTableHeader newTable;
-			newTable.recordCount = reservedKeys;
-			newTable.nextTable = 0;
-			filePtr << newTable;
+		~TFileMapping() {
+			if (basePtr == nullptr) return;
+#if defined(_WIN32)
+			UnmapViewOfFile(basePtr);
+#else
+			munmap(basePtr, mappedLength);
+#endif
+		}
 
-			// write reserved keys
-			for (uint32 i = 0; i < reservedKeys; i++) {
-				uint32 newReservedKeyPos = (uint32)filePtr->tellp();
+		// map current content of file. mapping stays valid after file handle closed
+		bool map(const std::string& file) {
+#if defined(_WIN32)
+			HANDLE fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE) return false;
 
-				TKeyEntry newReservedKey;
-				filePtr << newReservedKey;
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+				CloseHandle(fileHandle);
+				return false;
+			}
 
-				TKeyEntryInfo keyInfo(newReservedKey, newReservedKeyPos);
-				reservedKeyList.push_back(keyInfo);
+			HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mappingHandle != NULL) {
+				basePtr = (byte*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mappingHandle);
 			}
 
-			// read previous last table 
-			TTableHeaderInfo& lastTable = tableList.back();
-			filePtr->seekg(lastTable.pos);
+			CloseHandle(fileHandle);
+			if (basePtr == nullptr) return false;
 
-			// add link to new table
-			lastTable().nextTable = newTablePos;
+			mappedLength = (ulong64)fileSize.QuadPart;
+#else
+			int fd = ::open(file.c_str(), O_RDONLY);
+			if (fd < 0) return false;
 
-			// rewrite previous last table
-			filePtr << lastTable();
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size == 0) {
+				::close(fd);
+				return false;
+			}
 
-			// add new table to internal list
-			tableList.push_back(TTableHeaderInfo(newTable, newTablePos));
-		}
+			void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (ptr == MAP_FAILED) return false;
 
-		bool hasReserved() {
-			return reservedKeyList.size() > 0;
+			basePtr = (byte*)ptr;
+			mappedLength = (ulong64)st.st_size;
+#endif
+			return true;
 		}
 
-		bool tryWriteToSuitableDeletedPair(const TKeyData& keyData, const TValueData& valueData) {
-			for (auto itr = deletedKeyList.begin(); itr != deletedKeyList.end();) {
-				TKeyEntryInfo keyInfo = *itr;
-				if (keyInfo().initialDataLength >= valueData.size()) {
-					TKeyEntryInfo keyInfo = *itr;
-					keyInfo().freeKeyData = keyData;
-					rewritePair(keyInfo, valueData);
-					dataMap.insert({ keyInfo().freeKeyData, keyInfo });
-					itr = deletedKeyList.erase(itr);
+		const byte* data() const { return basePtr; }
 
-					return true;
-				} else {
-					++itr;
-				}
-			}
+		ulong64 size() const { return mappedLength; }
 
-			return false;
+		bool contains(ulong64 pos, ulong64 length) const {
+			return basePtr != nullptr && pos + length <= mappedLength;
 		}
+	};
 
-		void addNew(const TKeyData& keyData, const TValueData& valueData) {
-			if (valueData.size() == 0) {
-				return;
-			}
+	typedef std::shared_ptr<TFileMapping> TFileMappingPtr;
 
-			if (!tryWriteToSuitableDeletedPair(keyData, valueData)) {
-				if (hasReserved()) {
-					newPairFromReserved(keyData, valueData);
-				} else {
-					createNewTable();
-					newPairFromReserved(keyData, valueData);
-				}
-			}
-		}
+	//============================================================================
+	// Value extents read by live views of memory mapped file.
+	// Pinned extent is neither rewritten in place nor reused until its last view is released
+	//============================================================================
+	class TExtentPins {
 
-		void change(const TKeyData& keyData, const TValueData& valueData) {
-			TKeyEntryInfo keyInfo = dataMap[keyData];
-			if (valueData.size() > 0) {
-				if (keyInfo().initialDataLength >= valueData.size()) {
-					rewritePair(keyInfo, valueData);
-				} else {
-					//remove old and create new
-					earsePair(keyInfo);
-					addNew(keyData, valueData);
-				}
-			} else {
-				// erase
-				earsePair(keyInfo);
-			}
-		}
+	private:
+		mutable std::mutex pinMutex;
+		std::unordered_map<ulong64, std::pair<uint32, ulong64>> pinMap; // pos -> (view count, capacity)
+		std::atomic<uint32> pinCount { 0 };
 
 	public:
-
-		KvFile() {
-			assert(sizeof(K) <= KVDB_KEY_SIZE);
-		}
-        
-        ~KvFile() {
-			close();
-		}
-		
-		void setReservedValueSize(uint32 val){
-			reservedValueSize = val;
+		void pin(ulong64 pos, ulong64 capacity) {
+			std::unique_lock<std::mutex> lock(pinMutex);
+			std::pair<uint32, ulong64>& p = pinMap[pos];
+			p.first++;
+			p.second = capacity;
+			pinCount.fetch_add(1, std::memory_order_relaxed);
 		}
 
-		void close() {
-			if (!filePtr || !filePtr->is_open()) return;
+		void unpin(ulong64 pos) {
+			std::unique_lock<std::mutex> lock(pinMutex);
+			auto got = pinMap.find(pos);
+			if (got == pinMap.end()) return;
 
-			filePtr->close();
-			dataMap.clear();
-			reservedKeyList.clear();
-			deletedKeyList.clear();
-			tableList.clear();
+			if (--got->second.first == 0) pinMap.erase(got);
+			pinCount.fetch_sub(1, std::memory_order_relaxed);
 		}
 
-		bool open(const std::string& file) {
-			filePtr = new std::fstream(file, std::ios::in | std::ios::out | std::ios::binary);
-
-			if (!filePtr->is_open()) return false;
-
-			TFileHeader fileHeader;
-			filePtr >> fileHeader;
+		bool isPinned(ulong64 pos) const {
+			if (pinCount.load(std::memory_order_relaxed) == 0) return false;
 
-			ulong64 nextTablePos = readTable();
-			while (nextTablePos > 0) {
-				filePtr->seekg(nextTablePos);
-				nextTablePos = readTable();
-			}
-            
-			return true;
+			std::unique_lock<std::mutex> lock(pinMutex);
+			return pinMap.find(pos) != pinMap.end();
 		}
 
-		int size() {
-			if (!filePtr->is_open()) {
-				return 0;
-			} else {
-				return dataMap.size();
-			}
+		// (pos, capacity) of pinned extents
+		std::vector<std::pair<ulong64, ulong64>> list() const {
+			std::unique_lock<std::mutex> lock(pinMutex);
+			std::vector<std::pair<ulong64, ulong64>> extentList;
+			extentList.reserve(pinMap.size());
+			for (const auto& it : pinMap) extentList.push_back({ it.first, it.second.second });
+			return extentList;
 		}
+	};
 
-		bool isExist(const K& k) {
-			TKeyData keyData = toKeyData(k);
-			if (!filePtr->is_open()) return nullptr;
-			std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
-			return !(dataMap.find(keyData) == dataMap.end());
+	typedef std::shared_ptr<TExtentPins> TExtentPinsPtr;
+
+	// owner of zero-copy view. keeps mapping and pin of value extent
+	typedef struct TPinnedMapping {
+		TFileMappingPtr mapping;
+		TExtentPinsPtr pins;
+		ulong64 pos = 0;
+
+		~TPinnedMapping() {
+			if (pins != nullptr) pins->unpin(pos);
 		}
+	} TPinnedMapping;
 
+	//============================================================================
+	// Read-only view of value data. 
+	// Holds reference to owner (file mapping or buffer), so data stays valid while view exists
+	//============================================================================
+	class TValueView {
 
-		TValueDataPtr loadData(const K& k) {
-			TKeyData keyData = toKeyData(k);
+	private:
+		std::shared_ptr<const void> holder;
+		const byte* dataPtr = nullptr;
+		ulong64 length = 0;
 
-			if (!filePtr->is_open()) return nullptr;
-            std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+	public:
+		TValueView() {};
 
-			auto got = dataMap.find(keyData);
-			if (got == dataMap.end()) {
-				return nullptr;
+		TValueView(std::shared_ptr<const void> h, const byte* d, ulong64 l) : holder(h), dataPtr(d), length(l) {};
+
+		explicit TValueView(TValueDataPtr buffer) : holder(buffer) {
+			if (buffer != nullptr) {
+				dataPtr = buffer->data();
+				length = buffer->size();
 			}
+		};
 
-			TKeyEntryInfo& i = dataMap[keyData];
-			const TKeyEntry& e = i();
+		const byte* data() const { return dataPtr; }
 
-			filePtr->seekg(e.dataPos);
+		ulong64 size() const { return length; }
 
-			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
-			dataPtr->resize(e.dataLength);
+		bool empty() const { return length == 0; }
 
-			if (filePtr->read((char*)dataPtr->data(), e.dataLength)) {
-				return dataPtr;
-			}
+		explicit operator bool() const { return dataPtr != nullptr && length > 0; }
 
-			return nullptr;
+		// part of value, holds the same buffer
+		TValueView slice(ulong64 offset, ulong64 sliceLength) const {
+			if (offset + sliceLength > length) return TValueView();
+			return TValueView(holder, dataPtr + offset, sliceLength);
 		}
+	};
 
-		std::shared_ptr<V> load(const K& k) {
-			return valueFromData(loadData(k));
-		}
-        
-        
-        std::shared_ptr<V> operator[] (const K& k) {
-            return valueFromData(loadData(k));
-        }
+	//============================================================================
+	// Record codecs
+	//============================================================================
 
-		void erase(const K& k) {
-			TKeyData keyData = toKeyData(k);
+	#define KVDB_MAX_CODECS 256
+
+	// codec id is stored with every record. user codecs start from CODEC_USER
+	enum TCodecType {
+		CODEC_NONE = 0,
+		CODEC_LZ = 1,		// fast LZ77, hash table match finder
+		CODEC_LZ_HIGH = 2,	// same format, hash chain match finder. slower save, smaller file
+		CODEC_USER = 16
+	};
+
+	class TCodec {
+	public:
+		virtual ~TCodec() { }
+
+		// returns false if data is not compressible
+		virtual bool encode(const byte* src, size_t length, TValueData& dst) const = 0;
+
+		// rawLength is exact decoded size
+		virtual bool decode(const byte* src, size_t length, byte* dst, size_t rawLength) const = 0;
+	};
+
+	typedef std::shared_ptr<TCodec> TCodecPtr;
+
+	namespace lz {
+
+		// LZ77 block: sequences of [token][literal length][literals][offset][match length]
+		// token high 4 bits - literal length, low 4 bits - match length minus minMatch, 15 means extended by bytes
+		// last sequence is literals only
 
-			if (!filePtr->is_open()) return;
-            std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+		static const size_t minMatch = 4;
+		static const size_t maxOffset = 65535;
+		static const uint32 hashBits = 16;
+		static const uint32 noPos = 0xFFFFFFFF;
 
-			auto got = dataMap.find(keyData);
-			if (got != dataMap.end()) {
-				TKeyEntryInfo keyInfo = dataMap[keyData];
-				earsePair(keyInfo);
+		inline uint32 read32(const byte* p) {
+			uint32 v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline uint32 hash(uint32 v) {
+			return (v * 2654435761U) >> (32 - hashBits);
+		}
+
+		inline size_t matchLength(const byte* src, size_t length, size_t pos, size_t candidate) {
+			size_t m = 0;
+			while (pos + m < length && src[candidate + m] == src[pos + m]) m++;
+			return m;
+		}
+
+		inline void writeLength(TValueData& dst, size_t length) {
+			while (length >= 255) {
+				dst.push_back(255);
+				length -= 255;
 			}
+			dst.push_back((byte)length);
 		}
 
-		void save(const K& k, const V& v) {
-			TKeyData keyData = toKeyData(k);
-			TValueData valueData;
+		inline bool readLength(const byte* src, size_t srcLength, size_t& ip, size_t& length) {
+			byte b;
+			do {
+				if (ip >= srcLength) return false;
+				b = src[ip++];
+				length += b;
+			} while (b == 255);
+			return true;
+		}
 
-			if constexpr(std::is_same_v<V, TValueData>) {
-				valueData = std::move((TValueData)v);
-			} else {
-				toValueData(v, valueData);
+		// match length 0 for last sequence
+		inline void writeSequence(TValueData& dst, const byte* literals, size_t literalLength, size_t offset, size_t match) {
+			const size_t matchCode = (match > 0) ? match - minMatch : 0;
+			dst.push_back((byte)(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+			if (literalLength >= 15) writeLength(dst, literalLength - 15);
+
+			dst.insert(dst.end(), literals, literals + literalLength);
+
+			if (match > 0) {
+				dst.push_back((byte)(offset & 0xFF));
+				dst.push_back((byte)(offset >> 8));
+				if (matchCode >= 15) writeLength(dst, matchCode - 15);
 			}
+		}
 
-			if (!filePtr->is_open()) return;
-            std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+		inline bool decode(const byte* src, size_t srcLength, byte* dst, size_t dstLength) {
+			size_t ip = 0;
+			size_t op = 0;
 
-			std::unordered_map<TKeyData, TKeyEntryInfo>::const_iterator got = dataMap.find(keyData);
-			if (got == dataMap.end()) {
-				// pair not found  
-				addNew(keyData, valueData);
-			} else {
-				// pair found  
-				change(keyData, valueData);
+			while (true) {
+				if (ip >= srcLength) return false;
+				const byte token = src[ip++];
+
+				size_t literalLength = token >> 4;
+				if (literalLength == 15 && !readLength(src, srcLength, ip, literalLength)) return false;
+				if (literalLength > srcLength - ip || literalLength > dstLength - op) return false;
+
+				std::memcpy(dst + op, src + ip, literalLength);
+				ip += literalLength;
+				op += literalLength;
+
+				if (ip == srcLength) return op == dstLength;
+
+				if (srcLength - ip < 2) return false;
+				const size_t offset = src[ip] | (src[ip + 1] << 8);
+				ip += 2;
+				if (offset == 0 || offset > op) return false;
+
+				size_t match = token & 15;
+				if (match == 15 && !readLength(src, srcLength, ip, match)) return false;
+				match += minMatch;
+				if (match > dstLength - op) return false;
+
+				if (offset >= match) {
+					std::memcpy(dst + op, dst + op - offset, match);
+				} else {
+					// overlapped copy repeats last bytes
+					for (size_t i = 0; i < match; i++) dst[op + i] = dst[op - offset + i];
+				}
+
+				op += match;
 			}
 		}
 
-		static bool create(const std::string& file, const std::unordered_map<K, V>& test) {
-			std::ofstream outFile(file, std::ios::out | std::ios::binary);
+		// single candidate per hash. skips faster over incompressible data
+		inline void encodeFast(const byte* src, size_t length, TValueData& dst) {
+			std::vector<uint32> table((size_t)1 << hashBits, noPos);
+			size_t anchor = 0;
+			size_t pos = 0;
 
-			if (!outFile) return false;
+			while (pos + minMatch <= length) {
+				const uint32 v = read32(src + pos);
+				const uint32 h = hash(v);
+				const uint32 candidate = table[h];
+				table[h] = (uint32)pos;
 
-			std::ofstream* outFilePtr = &outFile;
+				if (candidate != noPos && pos - candidate <= maxOffset && read32(src + candidate) == v) {
+					const size_t match = minMatch + matchLength(src, length, pos + minMatch, candidate + minMatch);
+					writeSequence(dst, src + anchor, pos - anchor, pos - candidate, match);
+					pos += match;
+					anchor = pos;
+				} else {
+					pos += 1 + ((pos - anchor) >> 6);
+				}
+			}
 
-			static const ulong64 max_key_records = KVDB_RESERVED_TABLE_SIZE;
-			const ulong64 keyRecords = (test.size() > max_key_records) ? test.size() : max_key_records;
+			writeSequence(dst, src + anchor, length - anchor, 0, 0);
+		}
 
-			// save file header
-			TFileHeader fileHeader;
-			fileHeader.keySize = KVDB_KEY_SIZE;
-			fileHeader.endOfHeaderOffset = sizeof(fileHeader);
+		// longest of up to maxChain candidates
+		inline void encodeHigh(const byte* src, size_t length, TValueData& dst) {
+			static const uint32 maxChain = 64;
+			static const size_t windowMask = maxOffset;
 
-			outFilePtr << fileHeader;
+			std::vector<uint32> head((size_t)1 << hashBits, noPos);
+			std::vector<uint32> chain(windowMask + 1, noPos);
 
-			TTableHeader tableHeader;
-			tableHeader.recordCount = keyRecords;
-			outFilePtr << tableHeader;
+			auto insert = [&](size_t pos) {
+				const uint32 h = hash(read32(src + pos));
+				chain[pos & windowMask] = head[h];
+				head[h] = (uint32)pos;
+			};
 
-			ulong64 bodyDataOffset = (ulong64)(outFile.tellp()) + sizeof(TKeyEntry) * keyRecords;
+			size_t anchor = 0;
+			size_t pos = 0;
 
-			std::vector<byte> dataBody;
+			while (pos + minMatch <= length) {
+				size_t bestMatch = 0;
+				size_t bestOffset = 0;
 
-			for (auto& e : test) {
-				TKeyEntry entry;
-				entry.freeKeyData = toKeyData(e.first);
-				entry.dataPos = dataBody.size() + bodyDataOffset;
+				uint32 candidate = head[hash(read32(src + pos))];
+				for (uint32 i = 0; i < maxChain && candidate != noPos && pos - candidate <= maxOffset; i++) {
+					if (pos + bestMatch < length && src[candidate + bestMatch] == src[pos + bestMatch]) {
+						const size_t match = matchLength(src, length, pos, candidate);
+						if (match > bestMatch) {
+							bestMatch = match;
+							bestOffset = pos - candidate;
+						}
+					}
 
-				TValueData valueData;
-				if constexpr (std::is_same_v<V, TValueData>) {
-					valueData = std::move((TValueData)e.second);
+					const uint32 next = chain[candidate & windowMask];
+					if (next == noPos || next >= candidate) break;
+					candidate = next;
+				}
+
+				if (bestMatch >= minMatch) {
+					writeSequence(dst, src + anchor, pos - anchor, bestOffset, bestMatch);
+					const size_t end = pos + bestMatch;
+					for (; pos < end; pos++) {
+						if (pos + minMatch <= length) insert(pos);
+					}
+					anchor = pos;
 				} else {
-					toValueData(e.second, valueData);
+					insert(pos);
+					pos++;
 				}
+			}
 
-				entry.dataLength = valueData.size();
-				entry.initialDataLength = valueData.size();
-				dataBody.insert(std::end(dataBody), std::begin(valueData), std::end(valueData));
+			writeSequence(dst, src + anchor, length - anchor, 0, 0);
+		}
 
-				outFilePtr << entry;
+	} // namespace lz
+
+	class TLzCodec : public TCodec {
+	private:
+		bool bHighCompression;
+
+	public:
+		TLzCodec(bool highCompression) : bHighCompression(highCompression) { }
+
+		bool encode(const byte* src, size_t length, TValueData& dst) const override {
+			dst.clear();
+			dst.reserve(length / 2);
+
+			if (bHighCompression) {
+				lz::encodeHigh(src, length, dst);
+			} else {
+				lz::encodeFast(src, length, dst);
 			}
 
-			if (test.size() < max_key_records) {
-				// add empty records
-				const ulong64 emptyRecords = max_key_records - test.size();
-				for (int i = 0; i < emptyRecords; i++) {
-					TKeyEntry entry;
-					outFilePtr << entry;
+			return dst.size() < length;
+		}
+
+		bool decode(const byte* src, size_t length, byte* dst, size_t rawLength) const override {
+			return lz::decode(src, length, dst, rawLength);
+		}
+	};
+
+	class TCodecRegistry {
+	private:
+		std::array<TCodecPtr, KVDB_MAX_CODECS> codecList;
+		mutable std::shared_mutex registryMutex;
+
+		TCodecRegistry() {
+			codecList[CODEC_LZ] = std::make_shared<TLzCodec>(false);
+			codecList[CODEC_LZ_HIGH] = std::make_shared<TLzCodec>(true);
+		}
+
+	public:
+		static TCodecRegistry& instance() {
+			static TCodecRegistry registry;
+			return registry;
+		}
+
+		// codec must be registered before any file with its records is opened
+		bool registerCodec(uint32 id, TCodecPtr codec) {
+			if (id < CODEC_USER || id >= KVDB_MAX_CODECS) return false;
+			std::unique_lock<std::shared_mutex> lock(registryMutex);
+			codecList[id] = codec;
+			return true;
+		}
+
+		TCodecPtr get(uint32 id) const {
+			if (id >= KVDB_MAX_CODECS) return nullptr;
+			std::shared_lock<std::shared_mutex> lock(registryMutex);
+			return codecList[id];
+		}
+	};
+
+	// stored in front of every value in version 2 files
+	typedef struct TRecordHeader {
+		uint32 rawLength = 0;
+		uint32 codec = CODEC_NONE;
+	} TRecordHeader;
+
+	// empty value stays empty, it means erase
+	inline void encodeRecord(uint32 codecId, const TValueData& valueData, TValueData& record) {
+		record.clear();
+		if (valueData.empty()) return;
+
+		TRecordHeader header;
+		header.rawLength = (uint32)valueData.size();
+
+		TValueData encoded;
+		TCodecPtr codec = (codecId != CODEC_NONE) ? TCodecRegistry::instance().get(codecId) : nullptr;
+		if (codec != nullptr && codec->encode(valueData.data(), valueData.size(), encoded)) {
+			header.codec = codecId;
+		} else {
+			encoded.clear();
+		}
+
+		const TValueData& body = (header.codec != CODEC_NONE) ? encoded : valueData;
+		record.resize(sizeof(TRecordHeader) + body.size());
+		std::memcpy(record.data(), &header, sizeof(TRecordHeader));
+		std::memcpy(record.data() + sizeof(TRecordHeader), body.data(), body.size());
+	}
+
+	inline bool decodeRecord(const byte* record, size_t length, TValueData& valueData) {
+		if (length < sizeof(TRecordHeader)) return false;
+
+		TRecordHeader header;
+		std::memcpy(&header, record, sizeof(TRecordHeader));
+		const byte* body = record + sizeof(TRecordHeader);
+		const size_t bodyLength = length - sizeof(TRecordHeader);
+
+		valueData.resize(header.rawLength);
+		if (header.codec == CODEC_NONE) {
+			if (bodyLength != header.rawLength) return false;
+			std::memcpy(valueData.data(), body, bodyLength);
+			return true;
+		}
+
+		TCodecPtr codec = TCodecRegistry::instance().get(header.codec);
+		return codec != nullptr && codec->decode(body, bodyLength, valueData.data(), header.rawLength);
+	}
+
+	//============================================================================
+	// File header
+	//============================================================================
+
+	// version 1 - raw values, version 2 - values with TRecordHeader
+	#define KVDB_FILE_VERSION 2
+
+	typedef struct TFileHeader {
+		uint32 version = KVDB_FILE_VERSION;
+		uint32 keySize = 0;
+		ulong64 timestamp = 0;
+		uint32  endOfHeaderOffset = 0;
+		uint32 codec = CODEC_NONE; // default codec of new records. was padding in version 1
+	} TFileHeader;
+
+	inline std::ostream* operator << (std::ostream* os, const TFileHeader& obj) {
+		write(os, obj);
+		return os;
+	}
+
+	inline std::istream* operator >> (std::istream* is, TFileHeader& obj) {
+		read(is, obj);
+		return is;
+	}
+
+	//============================================================================
+	// Table header
+	//============================================================================
+	typedef struct TTableHeader {
+		ulong64 recordCount = 0;
+		ulong64 nextTable = 0;
+	} TTableHeader;
+
+	typedef TPosWrapper<TTableHeader> TTableHeaderInfo;
+
+	inline std::ostream* operator << (std::ostream* os, const TTableHeader& obj) {
+		write(os, obj);
+		return os;
+	}
+
+	inline std::istream* operator >> (std::istream* is, TTableHeader& obj) {
+		read(is, obj);
+		return is;
+	}
+
+	//============================================================================
+	// Key Entry
+	//============================================================================
+	typedef struct TKeyEntry {
+		ulong64 dataPos = 0;
+		ulong64 dataLength = 0;
+		ulong64 initialDataLength = 0;
+
+		TKeyData freeKeyData = {};
+	} TKeyEntry;
+
+	typedef TPosWrapper<TKeyEntry> TKeyEntryInfo;
+
+	inline std::ostream* operator << (std::ostream* os, const TKeyEntry& obj) {
+		write(os, obj);
+		return os;
+	}
+
+	inline std::istream* operator >> (std::istream* is, TKeyEntry& obj) {
+		read(is, obj);
+		return is;
+	}
+
+	//============================================================================
+	// Key index. 
+	// Open addressing with 1 control byte per slot, probed by groups of 16
+	//============================================================================
+
+	#define KVDB_INDEX_GROUP_SIZE 16
+
+	// lengths of index entry are 32 bit, as raw length of record header. save rejects longer records
+	#define KVDB_MAX_RECORD_LENGTH 0xFFFFFFFFULL
+
+	// positions of index entry are 40 bit and slots are 24 bit. open refuses larger files, save refuses to pass limits
+	#define KVDB_MAX_FILE_SIZE (1ULL << 40)
+	#define KVDB_MAX_SLOTS (1ULL << 24)
+
+	// in-memory entry of live pair, 24 bytes. value extent is exactly dataLength bytes,
+	// tail of shrunk value goes to free space. slot is global number of key slot in chain of key tables
+	typedef struct TIndexEntry {
+		TKeyData key = {};
+		uint32 dataLength = 0;
+		ulong64 dataPos : 40;
+		ulong64 slot : 24;
+
+		TIndexEntry() : dataPos(0), slot(0) { }
+	} TIndexEntry;
+
+	static_assert(sizeof(TIndexEntry) == 24, "index entry must stay 24 bytes");
+
+	class TKeyIndex {
+
+	private:
+		static constexpr signed char CTRL_EMPTY = (signed char)0x80;
+		static constexpr signed char CTRL_DELETED = (signed char)0xFE;
+
+		std::vector<signed char> ctrlList; // empty, deleted or 7 bits of hash
+		std::vector<TIndexEntry> entryList;
+		size_t groupMask = 0;
+		size_t count = 0;
+		size_t deleted = 0;
+
+		static size_t keyHash(const TKeyData& keyData) {
+			return std::hash<TKeyData>{}(keyData);
+		}
+
+		static signed char h2(size_t h) {
+			return (signed char)(h & 0x7F);
+		}
+
+		// bit i is set if control byte i of group equals value
+		static uint32 matchGroup(const signed char* group, signed char value) {
+#ifdef KVDB_SSE2
+			const __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+			return (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+#else
+			uint32 mask = 0;
+			for (uint32 i = 0; i < KVDB_INDEX_GROUP_SIZE; i++) {
+				if (group[i] == value) mask |= (1u << i);
+			}
+			return mask;
+#endif
+		}
+
+		// empty or deleted slots of group
+		static uint32 matchFree(const signed char* group) {
+#ifdef KVDB_SSE2
+			const __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+			return (uint32)_mm_movemask_epi8(ctrl);
+#else
+			uint32 mask = 0;
+			for (uint32 i = 0; i < KVDB_INDEX_GROUP_SIZE; i++) {
+				if (group[i] < 0) mask |= (1u << i);
+			}
+			return mask;
+#endif
+		}
+
+		static uint32 lowestBit(uint32 mask) {
+			uint32 i = 0;
+			while ((mask & 1) == 0) {
+				mask >>= 1;
+				i++;
+			}
+			return i;
+		}
+
+		size_t findSlot(const TKeyData& keyData) const {
+			if (count == 0) return SIZE_MAX;
+
+			const size_t h = keyHash(keyData);
+			size_t group = (h >> 7) & groupMask;
+			for (size_t step = 1; step <= groupMask + 1; step++) {
+				const signed char* ctrl = ctrlList.data() + group * KVDB_INDEX_GROUP_SIZE;
+				uint32 mask = matchGroup(ctrl, h2(h));
+				while (mask != 0) {
+					const uint32 i = lowestBit(mask);
+					const size_t slot = group * KVDB_INDEX_GROUP_SIZE + i;
+					if (entryList[slot].key == keyData) return slot;
+					mask &= mask - 1;
 				}
+
+				if (matchGroup(ctrl, CTRL_EMPTY) != 0) return SIZE_MAX;
+				group = (group + step) & groupMask; // triangular probing visits every group
 			}
 
-			outFilePtr->write((char*)dataBody.data(), dataBody.size());
-			outFile.close();
+			return SIZE_MAX;
+		}
+
+		size_t findFree(size_t h) const {
+			size_t group = (h >> 7) & groupMask;
+			for (size_t step = 1;; step++) {
+				const uint32 mask = matchFree(ctrlList.data() + group * KVDB_INDEX_GROUP_SIZE);
+				if (mask != 0) return group * KVDB_INDEX_GROUP_SIZE + lowestBit(mask);
+				group = (group + step) & groupMask;
+			}
+		}
+
+		void rehash(size_t groupCount) {
+			std::vector<signed char> oldCtrlList(groupCount * KVDB_INDEX_GROUP_SIZE, CTRL_EMPTY);
+			std::vector<TIndexEntry> oldEntryList(groupCount * KVDB_INDEX_GROUP_SIZE);
+			oldCtrlList.swap(ctrlList);
+			oldEntryList.swap(entryList);
+			groupMask = groupCount - 1;
+			deleted = 0;
+
+			for (size_t i = 0; i < oldCtrlList.size(); i++) {
+				if (oldCtrlList[i] >= 0) {
+					const size_t h = keyHash(oldEntryList[i].key);
+					const size_t slot = findFree(h);
+					ctrlList[slot] = h2(h);
+					entryList[slot] = oldEntryList[i];
+				}
+			}
+		}
+
+		// max load is 7/8 of slots, deleted slots included
+		static size_t groupsFor(size_t n) {
+			size_t groupCount = 1;
+			while (groupCount * KVDB_INDEX_GROUP_SIZE * 7 < n * 8) {
+				groupCount <<= 1;
+			}
+			return groupCount;
+		}
+
+	public:
+
+		size_t size() const {
+			return count;
+		}
+
+		// bytes used by table
+		size_t memoryUsage() const {
+			return ctrlList.size() * (sizeof(signed char) + sizeof(TIndexEntry));
+		}
+
+		void reserve(size_t n) {
+			const size_t groupCount = groupsFor(n);
+			if (groupCount * KVDB_INDEX_GROUP_SIZE > ctrlList.size()) {
+				rehash(groupCount);
+			}
+		}
+
+		void clear() {
+			ctrlList.clear();
+			entryList.clear();
+			groupMask = 0;
+			count = 0;
+			deleted = 0;
+		}
+
+		// pointer is valid until next insert
+		const TIndexEntry* find(const TKeyData& keyData) const {
+			const size_t slot = findSlot(keyData);
+			return (slot == SIZE_MAX) ? nullptr : &entryList[slot];
+		}
+
+		bool contains(const TKeyData& keyData) const {
+			return findSlot(keyData) != SIZE_MAX;
+		}
+
+		// insert or replace
+		void insert(const TIndexEntry& entry) {
+			const size_t found = findSlot(entry.key);
+			if (found != SIZE_MAX) {
+				entryList[found] = entry;
+				return;
+			}
+
+			if ((count + deleted + 1) * 8 > ctrlList.size() * 7) {
+				// grow, or only drop deleted slots if table is sparse enough
+				const size_t groupCount = groupsFor((count + 1) * 2);
+				rehash(std::max(groupCount, ctrlList.size() / KVDB_INDEX_GROUP_SIZE));
+			}
 
+			const size_t h = keyHash(entry.key);
+			const size_t slot = findFree(h);
+			if (ctrlList[slot] == CTRL_DELETED) deleted--;
+			ctrlList[slot] = h2(h);
+			entryList[slot] = entry;
+			count++;
+		}
+
+		bool erase(const TKeyData& keyData) {
+			const size_t slot = findSlot(keyData);
+			if (slot == SIZE_MAX) return false;
+
+			// slot may stay empty if group never was full, so probing of other keys does not pass it
+			const signed char* ctrl = ctrlList.data() + (slot / KVDB_INDEX_GROUP_SIZE) * KVDB_INDEX_GROUP_SIZE;
+			if (matchGroup(ctrl, CTRL_EMPTY) != 0) {
+				ctrlList[slot] = CTRL_EMPTY;
+			} else {
+				ctrlList[slot] = CTRL_DELETED;
+				deleted++;
+			}
+
+			entryList[slot] = TIndexEntry();
+			count--;
 			return true;
 		}
+
+		template <typename F>
+		void forEach(F func) const {
+			for (size_t i = 0; i < ctrlList.size(); i++) {
+				if (ctrlList[i] >= 0) func(entryList[i]);
+			}
+		}
+	};
+
+	//============================================================================
+	// Free space of data file. 
+	// Best-fit allocation and coalescing of neighbour extents, both O(log n)
+	//============================================================================
+	class TFreeSpace {
+
+	private:
+		std::map<ulong64, ulong64> extentByPos; // pos -> length
+		std::set<std::pair<ulong64, ulong64>> extentBySize; // (length, pos)
+		ulong64 totalFree = 0;
+
+		void insertExtent(ulong64 pos, ulong64 length) {
+			extentByPos[pos] = length;
+			extentBySize.insert({ length, pos });
+			totalFree += length;
+		}
+
+		void eraseExtent(std::map<ulong64, ulong64>::iterator itr) {
+			extentBySize.erase({ itr->second, itr->first });
+			totalFree -= itr->second;
+			extentByPos.erase(itr);
+		}
+
+	public:
+		void clear() {
+			extentByPos.clear();
+			extentBySize.clear();
+			totalFree = 0;
+		}
+
+		// smallest extent which fits length. remainder stays free
+		bool allocate(ulong64 length, ulong64& pos) {
+			if (length == 0) return false;
+
+			auto fit = extentBySize.lower_bound({ length, 0 });
+			if (fit == extentBySize.end()) return false;
+
+			const ulong64 extentLength = fit->first;
+			pos = fit->second;
+			eraseExtent(extentByPos.find(pos));
+
+			if (extentLength > length) {
+				insertExtent(pos + length, extentLength - length);
+			}
+
+			return true;
+		}
+
+		// take length bytes at start of free extent at pos, so value before it grows in place
+		bool allocateAt(ulong64 pos, ulong64 length) {
+			auto itr = extentByPos.find(pos);
+			if (itr == extentByPos.end() || itr->second < length) return false;
+
+			const ulong64 extentLength = itr->second;
+			eraseExtent(itr);
+
+			if (extentLength > length) {
+				insertExtent(pos + length, extentLength - length);
+			}
+
+			return true;
+		}
+
+		// take range out of free space wherever it is, for used extents found after free space is built
+		void reserve(ulong64 pos, ulong64 length) {
+			const ulong64 end = pos + length;
+			auto itr = extentByPos.upper_bound(pos);
+			if (itr != extentByPos.begin()) --itr;
+
+			while (itr != extentByPos.end() && itr->first < end) {
+				const ulong64 extentPos = itr->first;
+				const ulong64 extentEnd = itr->first + itr->second;
+				auto next = std::next(itr);
+
+				if (extentEnd > pos) {
+					eraseExtent(itr);
+					if (extentPos < pos) insertExtent(extentPos, pos - extentPos);
+					if (extentEnd > end) insertExtent(end, extentEnd - end);
+				}
+
+				itr = next;
+			}
+		}
+
+		void release(ulong64 pos, ulong64 length) {
+			if (length == 0) return;
+
+			// merge with next extent
+			auto next = extentByPos.find(pos + length);
+			if (next != extentByPos.end()) {
+				length += next->second;
+				eraseExtent(next);
+			}
+
+			// merge with previous extent
+			auto prev = extentByPos.lower_bound(pos);
+			if (prev != extentByPos.begin()) {
+				--prev;
+				if (prev->first + prev->second == pos) {
+					pos = prev->first;
+					length += prev->second;
+					eraseExtent(prev);
+				}
+			}
+
+			insertExtent(pos, length);
+		}
+
+		ulong64 freeBytes() const {
+			return totalFree;
+		}
+
+		size_t extentCount() const {
+			return extentByPos.size();
+		}
+	};
+
+	// atomically replace file
+	inline bool replaceFile(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	//============================================================================
+	// Compaction result
+	//============================================================================
+	typedef struct TCompactionStats {
+		bool bSuccess = false;
+		ulong64 records = 0;
+		ulong64 sizeBefore = 0;
+		ulong64 sizeAfter = 0;
+		ulong64 reclaimedBytes = 0;
+	} TCompactionStats;
+
+	//============================================================================
+	// Spatial placement
+	//============================================================================
+
+	#define KVDB_RANGE_MAX_GAP (64 * 1024) // range load reads through holes up to this size
+	#define KVDB_RANGE_MAX_READ (16 * 1024 * 1024)
+	#define KVDB_PRELOAD_CHUNK 64 // keys taken by preload worker at once
+
+	enum TPlacement {
+		PLACEMENT_DEFAULT = 0,	// new records go to free space or end of file
+		PLACEMENT_MORTON = 1	// batches, checkpoints and compaction write records in Z-order of key
+	};
+
+	// key is 3 x int32 (X, Y, Z)
+	inline void keyToCoords(const TKeyData& keyData, int32_t coords[3]) {
+		std::memcpy(coords, keyData.data(), 3 * sizeof(int32_t));
+	}
+
+	inline TKeyData coordsToKey(int32_t x, int32_t y, int32_t z) {
+		const int32_t coords[3] = { x, y, z };
+		TKeyData keyData = {};
+		std::memcpy(keyData.data(), coords, sizeof(coords));
+		return keyData;
+	}
+
+	// lower 21 bits of value to every third bit
+	inline ulong64 spreadBits(ulong64 v) {
+		v &= 0x1FFFFF;
+		v = (v | v << 32) & 0x1F00000000FFFFULL;
+		v = (v | v << 16) & 0x1F0000FF0000FFULL;
+		v = (v | v << 8) & 0x100F00F00F00F00FULL;
+		v = (v | v << 4) & 0x10C30C30C30C30C3ULL;
+		v = (v | v << 2) & 0x1249249249249249ULL;
+		return v;
+	}
+
+	// Z-order code. coordinates are biased, so negative indexes keep their order
+	inline ulong64 mortonCode(const TKeyData& keyData) {
+		int32_t coords[3];
+		keyToCoords(keyData, coords);
+
+		static const int32_t bias = 1 << 20;
+		return spreadBits((uint32)(coords[0] + bias)) | (spreadBits((uint32)(coords[1] + bias)) << 1) | (spreadBits((uint32)(coords[2] + bias)) << 2);
+	}
+
+	//============================================================================
+	// I/O thread pool
+	//============================================================================
+
+	#define KVDB_IO_THREADS 4
+
+	// runs async loads and saves. may be shared between files
+	class TIoThreadPool {
+
+	private:
+		std::vector<std::thread> threadList;
+		std::deque<std::function<void()>> taskList;
+		std::mutex queueMutex;
+		std::condition_variable queueCondition;
+		bool bStop = false;
+
+		void run() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(queueMutex);
+					queueCondition.wait(lock, [&] { return bStop || !taskList.empty(); });
+					if (taskList.empty()) return; // stopped and drained
+					task = std::move(taskList.front());
+					taskList.pop_front();
+				}
+
+				task();
+			}
+		}
+
+	public:
+		TIoThreadPool(uint32 threadCount = KVDB_IO_THREADS) {
+			if (threadCount == 0) threadCount = 1;
+			for (uint32 i = 0; i < threadCount; i++) {
+				threadList.emplace_back([this] { run(); });
+			}
+		}
+
+		// queued tasks are finished before exit
+		~TIoThreadPool() {
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				bStop = true;
+			}
+
+			queueCondition.notify_all();
+			for (std::thread& thread : threadList) {
+				thread.join();
+			}
+		}
+
+		void push(std::function<void()> task) {
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				taskList.push_back(std::move(task));
+			}
+
+			queueCondition.notify_one();
+		}
+	};
+
+	typedef std::shared_ptr<TIoThreadPool> TIoThreadPoolPtr;
+
+	//============================================================================
+	// Value cache
+	//============================================================================
+
+	#define KVDB_CACHE_ENTRY_OVERHEAD 64 // approx. list node, map node and value header
+
+	typedef struct TCacheStats {
+		ulong64 hits = 0;
+		ulong64 misses = 0;
+		ulong64 entries = 0;
+		ulong64 usedBytes = 0;
+		ulong64 capacity = 0;
+	} TCacheStats;
+
+	inline void addCache(TCacheStats& sum, const TCacheStats& cache) {
+		sum.hits += cache.hits;
+		sum.misses += cache.misses;
+		sum.entries += cache.entries;
+		sum.usedBytes += cache.usedBytes;
+		sum.capacity += cache.capacity;
+	}
+
+	// byte limited LRU cache of loaded values. cached values are shared and must not be modified
+	class TValueCache {
+
+	private:
+		typedef std::list<std::pair<TKeyData, TValueDataPtr>> TLruList;
+
+		TLruList lruList; // most recently used first
+		std::unordered_map<TKeyData, TLruList::iterator> cacheMap;
+		ulong64 capacity = 0;
+		ulong64 usedBytes = 0;
+		ulong64 hits = 0;
+		ulong64 misses = 0;
+		mutable std::mutex cacheMutex;
+
+		static ulong64 entrySize(const TValueDataPtr& dataPtr) {
+			return dataPtr->size() + KVDB_CACHE_ENTRY_OVERHEAD;
+		}
+
+		void removeLocked(std::unordered_map<TKeyData, TLruList::iterator>::iterator itr) {
+			usedBytes -= entrySize(itr->second->second);
+			lruList.erase(itr->second);
+			cacheMap.erase(itr);
+		}
+
+		void evictLocked() {
+			while (usedBytes > capacity && !lruList.empty()) {
+				removeLocked(cacheMap.find(lruList.back().first));
+			}
+		}
+
+	public:
+		// zero capacity disables cache
+		void setCapacity(ulong64 bytes) {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			capacity = bytes;
+			evictLocked();
+		}
+
+		bool isEnabled() const {
+			return capacity > 0;
+		}
+
+		TValueDataPtr get(const TKeyData& keyData) {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			auto got = cacheMap.find(keyData);
+			if (got == cacheMap.end()) {
+				misses++;
+				return nullptr;
+			}
+
+			hits++;
+			lruList.splice(lruList.begin(), lruList, got->second);
+			return got->second->second;
+		}
+
+		void put(const TKeyData& keyData, TValueDataPtr dataPtr) {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			auto got = cacheMap.find(keyData);
+			if (got != cacheMap.end()) {
+				removeLocked(got);
+			}
+
+			if (dataPtr == nullptr || entrySize(dataPtr) > capacity) return;
+
+			lruList.emplace_front(keyData, dataPtr);
+			cacheMap.insert({ keyData, lruList.begin() });
+			usedBytes += entrySize(dataPtr);
+			evictLocked();
+		}
+
+		void erase(const TKeyData& keyData) {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			auto got = cacheMap.find(keyData);
+			if (got != cacheMap.end()) {
+				removeLocked(got);
+			}
+		}
+
+		void clear() {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			lruList.clear();
+			cacheMap.clear();
+			usedBytes = 0;
+		}
+
+		TCacheStats getStats() const {
+			std::unique_lock<std::mutex> lock(cacheMutex);
+			TCacheStats stats;
+			stats.hits = hits;
+			stats.misses = misses;
+			stats.entries = cacheMap.size();
+			stats.usedBytes = usedBytes;
+			stats.capacity = capacity;
+			return stats;
+		}
+	};
+
+	//============================================================================
+	// Write-ahead log
+	//============================================================================
+
+	#define KVDB_WAL_MAGIC 0x4C41574B
+	#define KVDB_WAL_GROUP_COMMIT_SIZE 64
+	#define KVDB_WAL_CHECKPOINT_SIZE (64 * 1024 * 1024)
+
+	enum TWalRecordType {
+		WAL_SAVE = 1,
+		WAL_ERASE = 2,
+		WAL_COMMIT = 3,	// end of group. only committed groups are replayed
+		WAL_PATCH = 4	// ulong64 value offset and bytes written there
+	};
+
+	// when log is flushed to disk
+	enum TDurability {
+		DURABILITY_NONE = 0,	// never fsync. survives process crash but not OS crash
+		DURABILITY_GROUP = 1,	// fsync on each group commit
+		DURABILITY_FULL = 2		// commit and fsync on each record
+	};
+
+	typedef struct TWalRecordHeader {
+		uint32 magic = KVDB_WAL_MAGIC;
+		uint32 type = 0;
+		TKeyData keyData = {};
+		ulong64 length = 0;
+		ulong64 checksum = 0;
+	} TWalRecordHeader;
+
+	// position of logged value in log file
+	typedef struct TWalEntry {
+		ulong64 dataPos = 0;
+		ulong64 dataLength = 0;
+		bool bErased = false;
+	} TWalEntry;
+
+	// bytes written over stored value at offset
+	typedef struct TPatch {
+		ulong64 offset = 0;
+		TValueData data;
+	} TPatch;
+
+	// FNV-1a
+	inline ulong64 checksum(const void* data, ulong64 length, ulong64 h = 14695981039346656037ULL) {
+		const byte* ptr = (const byte*)data;
+		for (ulong64 i = 0; i < length; i++) {
+			h ^= ptr[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	inline ulong64 walRecordChecksum(const TWalRecordHeader& header, const byte* data) {
+		ulong64 h = checksum(&header.type, sizeof(header.type));
+		h = checksum(header.keyData.data(), header.keyData.size(), h);
+		h = checksum(&header.length, sizeof(header.length), h);
+		return checksum(data, header.length, h);
+	}
+
+	//============================================================================
+	// Snapshots
+	//============================================================================
+
+	// point-in-time view of file. release all snapshots before file is destroyed
+	typedef struct TSnapshot {
+		ulong64 version = 0;
+	} TSnapshot;
+
+	typedef std::shared_ptr<const TSnapshot> TSnapshotPtr;
+
+	// state of pair before write of endVersion. visible to snapshots older than endVersion
+	typedef struct TRetiredVersion {
+		ulong64 endVersion = 0;
+		bool bExists = false;
+		ulong64 dataPos = 0; // value extent of data file, not reused while retired
+		ulong64 dataLength = 0;
+		bool bInWal = false; // extent is in write-ahead log
+		std::vector<TWalEntry> patchList; // logged patches over extent
+		TValueDataPtr recordPtr; // copy of record, made only if extent is dropped: log checkpoint or compaction
+	} TRetiredVersion;
+
+	// extent which value of other pair referred to (column value of row). kept while snapshots older than endVersion 
+	// may read it, in write-ahead log mode also until log is checkpointed
+	typedef struct TRetiredExtent {
+		ulong64 endVersion = 0;
+		ulong64 pos = 0;
+		ulong64 length = 0;
+		bool bLogged = false;
+	} TRetiredExtent;
+
+	// visits extents of data file which value refers to. visit returns new position of extent, it is written back to value
+	typedef std::function<void(byte* value, ulong64 length, const std::function<ulong64(ulong64, ulong64)>& visit)> TValueExtentsFunc;
+
+	//============================================================================
+	// File statistics
+	//============================================================================
+
+	typedef struct TFileStats {
+		TIoStats dataIo; // memory mapped reads are not counted
+		TIoStats walIo;
+		TLatencyStats load; // loadData, loadView
+		TLatencyStats save; // save, erase, saveBatch, patch
+		TLatencyStats lockWait; // contended lock acquisitions of loads and saves
+		TCacheStats cache;
+
+		ulong64 fileSize = 0;
+		ulong64 walSize = 0;
+		ulong64 liveBytes = 0; // stored records
+		ulong64 deadBytes = 0; // free extents, reclaimed by compaction
+		ulong64 freeExtents = 0;
+		ulong64 retiredBytes = 0; // old values kept for snapshots
+
+		ulong64 pairs = 0;
+		ulong64 keySlots = 0;
+		ulong64 reservedSlots = 0; // free key slots
+		ulong64 deletedSlots = 0; // free key slots of erased pairs
+		ulong64 tableCount = 0; // length of key table chain
+	} TFileStats;
+
+	inline std::string statsCsvHeader() {
+		return "name,time,fileSize,walSize,liveBytes,deadBytes,freeExtents,retiredBytes,pairs,keySlots,reservedSlots,deletedSlots,tableCount,"
+			"readOps,readBytes,writeOps,writeBytes,syncOps,walWriteOps,walWriteBytes,walSyncOps,"
+			"loads,loadAvgUs,loadP50Us,loadP90Us,loadP99Us,loadMaxUs,"
+			"saves,saveAvgUs,saveP50Us,saveP90Us,saveP99Us,saveMaxUs,"
+			"lockWaits,lockWaitTotalUs,lockWaitP99Us,lockWaitMaxUs,"
+			"cacheHits,cacheMisses,cacheBytes";
+	}
+
+	inline std::string statsCsvRow(const std::string& name, const TFileStats& stats) {
+		std::string row = name;
+		auto add = [&](ulong64 value) {
+			row += ",";
+			row += std::to_string(value);
+		};
+
+		auto addLatency = [&](const TLatencyStats& latency) {
+			add(latency.count);
+			add((latency.count > 0) ? latency.totalUs / latency.count : 0);
+			add(latency.p50Us);
+			add(latency.p90Us);
+			add(latency.p99Us);
+			add(latency.maxUs);
+		};
+
+		add((ulong64)std::time(nullptr));
+		add(stats.fileSize);
+		add(stats.walSize);
+		add(stats.liveBytes);
+		add(stats.deadBytes);
+		add(stats.freeExtents);
+		add(stats.retiredBytes);
+		add(stats.pairs);
+		add(stats.keySlots);
+		add(stats.reservedSlots);
+		add(stats.deletedSlots);
+		add(stats.tableCount);
+
+		add(stats.dataIo.readOps);
+		add(stats.dataIo.readBytes);
+		add(stats.dataIo.writeOps);
+		add(stats.dataIo.writeBytes);
+		add(stats.dataIo.syncOps);
+		add(stats.walIo.writeOps);
+		add(stats.walIo.writeBytes);
+		add(stats.walIo.syncOps);
+
+		addLatency(stats.load);
+		addLatency(stats.save);
+
+		add(stats.lockWait.count);
+		add(stats.lockWait.totalUs);
+		add(stats.lockWait.p99Us);
+		add(stats.lockWait.maxUs);
+
+		add(stats.cache.hits);
+		add(stats.cache.misses);
+		add(stats.cache.usedBytes);
+		return row;
+	}
+
+	//============================================================================
+	// Incremental backup
+	//============================================================================
+
+	#define KVDB_BACKUP_MAGIC 0x4B55424B
+	#define KVDB_BACKUP_BATCH_SIZE (16 * 1024 * 1024)
+
+	// one backup of chain. backup file has pairs, erased keys follow entry in manifest
+	typedef struct TBackupEntry {
+		uint32 magic = KVDB_BACKUP_MAGIC;
+		uint32 seq = 0;
+		uint32 bFull = 0; // full backup starts new chain
+		uint32 reserved = 0;
+		ulong64 timestamp = 0;
+		ulong64 pairCount = 0;
+		ulong64 erasedCount = 0;
+		ulong64 checksum = 0;
+	} TBackupEntry;
+
+	typedef std::vector<std::pair<TBackupEntry, std::vector<TKeyData>>> TBackupManifest;
+
+	typedef struct TBackupStats {
+		bool bSuccess = false;
+		bool bFull = false;
+		uint32 seq = 0;
+		ulong64 pairs = 0;
+		ulong64 erased = 0;
+		ulong64 bytes = 0;
+	} TBackupStats;
+
+	inline std::string backupManifestFile(const std::string& backupFile) {
+		return backupFile + ".manifest";
+	}
+
+	inline std::string backupStepFile(const std::string& backupFile, uint32 seq) {
+		return backupFile + "." + std::to_string(seq);
+	}
+
+	inline ulong64 backupEntryChecksum(TBackupEntry entry, const std::vector<TKeyData>& erasedList) {
+		entry.checksum = 0;
+		ulong64 h = checksum(&entry, sizeof(entry));
+		return checksum(erasedList.data(), erasedList.size() * sizeof(TKeyData), h);
+	}
+
+	// backups in manifest order. broken tail of interrupted backup is dropped. returns end of valid entries
+	inline ulong64 readBackupManifest(const std::string& backupFile, TBackupManifest& manifest) {
+		TFileIO io;
+		if (!io.open(backupManifestFile(backupFile))) return 0;
+
+		const ulong64 size = io.size();
+		ulong64 pos = 0;
+		while (pos + sizeof(TBackupEntry) <= size) {
+			TBackupEntry entry;
+			if (!io.readObj(pos, entry) || entry.magic != KVDB_BACKUP_MAGIC) break;
+
+			const ulong64 keysPos = pos + sizeof(TBackupEntry);
+			if (entry.erasedCount > (size - keysPos) / sizeof(TKeyData)) break;
+
+			std::vector<TKeyData> erasedList(entry.erasedCount);
+			if (entry.erasedCount > 0 && !io.readAt(keysPos, erasedList.data(), erasedList.size() * sizeof(TKeyData))) break;
+			if (backupEntryChecksum(entry, erasedList) != entry.checksum) break;
+
+			manifest.push_back({ entry, std::move(erasedList) });
+			pos = keysPos + entry.erasedCount * sizeof(TKeyData);
+		}
+
+		return pos;
+	}
+
+	// backup exists only after its entry is on disk
+	inline bool appendBackupManifest(const std::string& backupFile, ulong64 pos, TBackupEntry entry, const std::vector<TKeyData>& erasedList) {
+		TFileIO io;
+		if (!io.open(backupManifestFile(backupFile), true)) return false;
+
+		entry.erasedCount = erasedList.size();
+		entry.checksum = backupEntryChecksum(entry, erasedList);
+
+		const ulong64 end = pos + sizeof(TBackupEntry) + erasedList.size() * sizeof(TKeyData);
+		if (!io.writeObj(pos, entry)) return false;
+		if (!erasedList.empty() && !io.writeAt(pos + sizeof(TBackupEntry), erasedList.data(), erasedList.size() * sizeof(TKeyData))) return false;
+		return io.truncate(end) && io.sync();
+	}
+
+	template <typename K>
+	class KvColumnFile;
+
+	template <typename K>
+	class KvRegionFile;
+
+	// key slot without pair, never used or deleted. slot is its global number
+	typedef struct TReservedKey {
+		TKeyEntryInfo keyInfo;
+		uint32 slot = 0;
+	} TReservedKey;
+
+	//============================================================================
+	// File db
+	//============================================================================
+	template <typename K, typename V>
+	class KvFile {
+
+		template <typename> friend class KvColumnFile;
+		template <typename> friend class KvRegionFile;
+
+	private:
+
+		TKeyIndex dataMap;
+		std::vector<std::pair<uint32, ulong64>> slotTableList; // (first slot, pos of first key entry) of each key table
+		uint32 slotCount = 0;
+		TFileIO fileIO;
+		ulong64 endOfFile = 0;
+		std::list<TReservedKey> reservedKeyList;
+		TFreeSpace freeSpace;
+		std::list<TTableHeaderInfo> tableList;
+		mutable std::shared_mutex fileSharedMutex;
+		std::mutex writeMutex; // serializes writers. compaction holds it while readers continue
+		std::string fileName;
+		std::atomic<bool> bOpen{ false }; // stays set while compaction swaps file, readers wait for lock then
+
+		// memory mapped read mode
+		bool bUseMemoryMapping = false;
+		std::mutex mappingMutex;
+		TFileMappingPtr mappingPtr;
+		TExtentPinsPtr extentPins = std::make_shared<TExtentPins>();
+		std::vector<std::pair<ulong64, ulong64>> pinnedFreeList; // released extents which views still read
+		
+		uint32 reservedKeys = KVDB_RESERVED_TABLE_SIZE;
+		uint32 reservedValueSize = 0;
+
+		// write-ahead log mode
+		bool bUseWal = false;
+		TDurability durability = DURABILITY_GROUP;
+		uint32 groupCommitSize = KVDB_WAL_GROUP_COMMIT_SIZE;
+		TFileIO walIO;
+		ulong64 walEnd = 0;
+		uint32 uncommittedRecords = 0;
+		std::unordered_map<TKeyData, TWalEntry> walMap; // logged but not yet applied to data file
+		std::unordered_map<TKeyData, std::vector<TWalEntry>> walPatchMap; // logged patches in log order
+
+		// batch write mode. appends and key entries are collected and written at once
+		bool bBatchWrite = false;
+		TValueData batchAppendBuffer;
+		TValueData batchWalBuffer;
+		std::vector<TKeyEntryInfo> batchKeyList;
+
+		// loaded values, write-through
+		TValueCache valueCache;
+
+		uint32 placement = PLACEMENT_DEFAULT;
+
+		// async mode. saves run one after another in call order
+		TIoThreadPoolPtr ioPool;
+		std::mutex asyncMutex;
+		std::condition_variable asyncCondition;
+		uint32 pendingAsync = 0;
+		std::deque<std::function<void()>> saveQueue;
+		bool bSaveQueueRunning = false;
+
+		// record format
+		uint32 fileVersion = KVDB_FILE_VERSION;
+		uint32 codecId = CODEC_NONE;
+		bool bCodecSet = false;
+
+		// snapshots. each save, erase or batch makes new version
+		ulong64 version = 0;
+		std::multiset<ulong64> snapshotSet; // versions of live snapshots
+		mutable std::mutex snapshotMutex;
+		std::unordered_map<TKeyData, std::vector<TRetiredVersion>> retiredMap;
+
+		// values which refer to other extents of data file (rows of column file). 
+		// such extents are used space, are moved by compaction and are released by retireExtent()
+		TValueExtentsFunc valueExtents;
+		std::vector<TRetiredExtent> retiredExtentList;
+
+		// telemetry
+		TLatencyHistogram loadHistogram;
+		TLatencyHistogram saveHistogram;
+		TLatencyHistogram lockWaitHistogram;
+
+		// incremental backup. keys written since last backup, tracked after first backup
+		bool bTrackChanges = false;
+		std::unordered_set<TKeyData> changedKeySet;
+		std::string lastBackupFile; // changes are relative to this backup
+		uint32 lastBackupSeq = 0;
+
+	private:
+
+		std::shared_ptr<V> valueFromData(TValueDataPtr dataPtr) {
+			if (dataPtr == nullptr) return nullptr;
+
+			if constexpr (std::is_same_v<V, TValueData>) {
+				return std::static_pointer_cast<TValueData>(dataPtr);
+			} else {
+				V* temp = new V();
+				memcpy(temp, dataPtr->data(), dataPtr->size());
+				return std::shared_ptr<V>(temp);
+			}
+		}
+
+		static TKeyData toKeyData(K key) {
+			byte temp[KVDB_KEY_SIZE];
+			for (int i = 0; i < KVDB_KEY_SIZE; i++) temp[i] = 0;
+
+			memcpy(&temp, &key, sizeof(K));
+
+			TKeyData arrayOfByte;
+			for (int i = 0; i < KVDB_KEY_SIZE; i++) arrayOfByte[i] = temp[i];
+
+			return arrayOfByte;
+		}
+
+		static K fromKeyData(const TKeyData& keyData) {
+			alignas(K) byte temp[sizeof(K)];
+			memcpy(temp, keyData.data(), sizeof(K));
+			return *reinterpret_cast<K*>(temp);
+		}
+
+		static void toValueData(V value, TValueData& valueData) {
+			if (valueData.size() < sizeof(value)) valueData.resize(sizeof(value));
+			std::memcpy(valueData.data(), &value, sizeof(value));
+		}
+
+		static void valueToData(const V& v, TValueData& valueData) {
+			if constexpr (std::is_same_v<V, TValueData>) {
+				valueData = v;
+			} else {
+				toValueData(v, valueData);
+			}
+		}
+
+		//========================================================================
+		// key index
+		//========================================================================
+
+		void addSlotTable(ulong64 entryListPos, ulong64 recordCount) {
+			slotTableList.push_back({ slotCount, entryListPos });
+			slotCount += (uint32)recordCount;
+		}
+
+		ulong64 slotToPos(uint32 slot) const {
+			auto it = std::upper_bound(slotTableList.begin(), slotTableList.end(), slot, [](uint32 s, const std::pair<uint32, ulong64>& t) { return s < t.first; });
+			--it;
+			return it->second + (ulong64)(slot - it->first) * sizeof(TKeyEntry);
+		}
+
+		TKeyEntry toKeyEntry(const TIndexEntry& entry) const {
+			TKeyEntry keyEntry;
+			keyEntry.dataPos = entry.dataPos;
+			keyEntry.dataLength = entry.dataLength;
+			keyEntry.initialDataLength = entry.dataLength;
+			keyEntry.freeKeyData = entry.key;
+			return keyEntry;
+		}
+
+		TKeyEntryInfo toKeyInfo(const TIndexEntry& entry) const {
+			return TKeyEntryInfo(toKeyEntry(entry), slotToPos(entry.slot));
+		}
+
+		void indexPair(const TKeyEntry& keyEntry, uint32 slot) {
+			TIndexEntry entry;
+			entry.key = keyEntry.freeKeyData;
+			entry.dataLength = (uint32)keyEntry.dataLength;
+			entry.dataPos = keyEntry.dataPos;
+			entry.slot = slot;
+			dataMap.insert(entry);
+		}
+
+		//========================================================================
+		// batch write
+		//========================================================================
+
+		void writeKeyEntry(const TKeyEntryInfo& keyInfo) {
+			if (bBatchWrite) {
+				batchKeyList.push_back(keyInfo);
+			} else {
+				fileIO.writeObj(keyInfo.pos, keyInfo());
+			}
+		}
+
+		// returns position of appended value
+		ulong64 appendValue(const TValueData& valueData) {
+			ulong64 pos = endOfFile;
+			if (bBatchWrite) {
+				batchAppendBuffer.insert(batchAppendBuffer.end(), valueData.begin(), valueData.end());
+			} else {
+				fileIO.writeAt(pos, valueData.data(), valueData.size());
+			}
+
+			endOfFile += valueData.size();
+			return pos;
+		}
+
+		// in-place write. value may be partially or fully in append buffer
+		void writeValueAt(ulong64 pos, const TValueData& valueData) {
+			const ulong64 bufferPos = endOfFile - batchAppendBuffer.size();
+			const ulong64 end = pos + valueData.size();
+
+			if (pos < bufferPos) {
+				const ulong64 fileLength = (end < bufferPos) ? valueData.size() : bufferPos - pos;
+				fileIO.writeAt(pos, valueData.data(), fileLength);
+			}
+
+			if (end > bufferPos) {
+				const ulong64 skip = (pos < bufferPos) ? bufferPos - pos : 0;
+				std::memcpy(batchAppendBuffer.data() + (pos + skip - bufferPos), valueData.data() + skip, valueData.size() - skip);
+			}
+		}
+
+		// append buffer is always a tail of file
+		void flushBatchAppend() {
+			if (batchAppendBuffer.empty()) return;
+
+			fileIO.writeAt(endOfFile - batchAppendBuffer.size(), batchAppendBuffer.data(), batchAppendBuffer.size());
+			batchAppendBuffer.clear();
+		}
+
+		// write collected key entries, contiguous entries with one write
+		void flushBatchKeys() {
+			if (batchKeyList.empty()) return;
+
+			// the last write of the same entry wins
+			std::stable_sort(batchKeyList.begin(), batchKeyList.end(), [](const TKeyEntryInfo& a, const TKeyEntryInfo& b) { return a.pos < b.pos; });
+
+			std::vector<TKeyEntryInfo> uniqueList;
+			uniqueList.reserve(batchKeyList.size());
+			for (const TKeyEntryInfo& keyInfo : batchKeyList) {
+				if (!uniqueList.empty() && uniqueList.back().pos == keyInfo.pos) {
+					uniqueList.back() = keyInfo;
+				} else {
+					uniqueList.push_back(keyInfo);
+				}
+			}
+
+			std::vector<TKeyEntry> run;
+			ulong64 runPos = 0;
+			for (const TKeyEntryInfo& keyInfo : uniqueList) {
+				if (!run.empty() && keyInfo.pos != runPos + run.size() * sizeof(TKeyEntry)) {
+					fileIO.writeAt(runPos, run.data(), run.size() * sizeof(TKeyEntry));
+					run.clear();
+				}
+
+				if (run.empty()) runPos = keyInfo.pos;
+				run.push_back(keyInfo());
+			}
+
+			fileIO.writeAt(runPos, run.data(), run.size() * sizeof(TKeyEntry));
+			batchKeyList.clear();
+		}
+
+		void beginBatchWrite() {
+			bBatchWrite = true;
+		}
+
+		void endBatchWrite() {
+			// values first, so key entries never point to unwritten data
+			flushBatchAppend();
+			flushBatchKeys();
+			bBatchWrite = false;
+		}
+
+		void rewritePair(TKeyEntryInfo& keyInfo, const TValueData& valueData) {
+			// rewrite value data
+			writeValueAt(keyInfo().dataPos, valueData);
+
+			// tail of shorter value is free
+			if (valueData.size() < keyInfo().dataLength) {
+				freeSpace.release(keyInfo().dataPos + valueData.size(), keyInfo().dataLength - valueData.size());
+			}
+
+			// rewrite key data
+			keyInfo().dataLength = valueData.size(); // new length
+			keyInfo().initialDataLength = valueData.size();
+			writeKeyEntry(keyInfo);
+		}
+
+		void earsePair(TKeyEntryInfo& keyInfo, bool bKeepOld = false) {
+			TKeyData keyData = keyInfo().freeKeyData; // keyInfo may refer to erased map element
+
+			// release value space
+			if (!bKeepOld) {
+				releaseExtent(keyInfo().dataPos, keyInfo().dataLength);
+			}
+
+			// key slot becomes reserved. position is kept to tell deleted slot from never used one
+			TKeyEntry deletedEntry;
+			deletedEntry.dataPos = keyInfo().dataPos;
+			TReservedKey reserved;
+			reserved.keyInfo = TKeyEntryInfo(deletedEntry, keyInfo.pos);
+			reserved.slot = (uint32)dataMap.find(keyData)->slot;
+			writeKeyEntry(reserved.keyInfo);
+			reservedKeyList.push_back(reserved);
+
+			dataMap.erase(keyData);
+		}
+
+		void expandValueData(const TValueData& valueDataSrc, TValueData& valueDataNew) {
+			valueDataNew.resize(reservedValueSize);
+			for (uint32 i = 0; i < reservedValueSize; i++){
+				if(i < valueDataSrc.size()){
+					valueDataNew[i] = valueDataSrc[i];	
+				} else {
+					valueDataNew[i] = 0;	
+				}
+			}
+		}
+
+		// extent read by view goes to free space after its last view
+		void releaseExtent(ulong64 pos, ulong64 length) {
+			if (extentPins->isPinned(pos)) {
+				pinnedFreeList.push_back({ pos, length });
+			} else {
+				freeSpace.release(pos, length);
+			}
+		}
+
+		void reclaimPinned() {
+			if (pinnedFreeList.empty()) return;
+
+			auto it = std::remove_if(pinnedFreeList.begin(), pinnedFreeList.end(), [&](const std::pair<ulong64, ulong64>& extent) {
+				if (extentPins->isPinned(extent.first)) return false;
+				freeSpace.release(extent.first, extent.second);
+				return true;
+			});
+
+			pinnedFreeList.erase(it, pinnedFreeList.end());
+		}
+
+		// write value to best-fit free extent or to end-of-file. 
+		// reserved value size is left free after value, so value can grow in place while nothing else takes it
+		ulong64 allocateValue(const TValueData& valueData) {
+			reclaimPinned();
+			const ulong64 length = (valueData.size() < reservedValueSize) ? reservedValueSize : valueData.size();
+
+			ulong64 pos = 0;
+			if (freeSpace.allocate(length, pos)) {
+				writeValueAt(pos, valueData);
+			} else if (valueData.size() < length) {
+				TValueData valueDataExp;
+				expandValueData(valueData, valueDataExp);
+				pos = appendValue(valueDataExp);
+			} else {
+				pos = appendValue(valueData);
+			}
+
+			if (valueData.size() < length) {
+				freeSpace.release(pos + valueData.size(), length - valueData.size());
+			}
+
+			return pos;
+		}
+
+		void newPairFromReserved(const TKeyData& keyData, const TValueData& valueData) {
+			// has reserved key slots
+			TReservedKey& reserved = reservedKeyList.front();
+			TKeyEntryInfo& keyInfo = reserved.keyInfo;
+
+			ulong64 dataPos = allocateValue(valueData);
+
+			// fill key data
+			keyInfo().dataLength = valueData.size(); // length
+			keyInfo().initialDataLength = valueData.size(); // length
+			keyInfo().dataPos = dataPos;
+			keyInfo().freeKeyData = keyData;
+
+			writeKeyEntry(keyInfo);
+
+			// add new pair to table 
+			indexPair(keyInfo(), reserved.slot);
+			reservedKeyList.pop_front();
+		}
+
+		// called under file lock, so writer sees pin before it rewrites extent
+		TValueView pinnedView(const TFileMappingPtr& mapping, const TIndexEntry& e, const byte* data, ulong64 length) {
+			return pinnedView(mapping, e.dataPos, e.dataLength, data, length);
+		}
+
+		TValueView pinnedView(const TFileMappingPtr& mapping, ulong64 extentPos, ulong64 extentLength, const byte* data, ulong64 length) {
+			std::shared_ptr<TPinnedMapping> owner = std::make_shared<TPinnedMapping>();
+			owner->mapping = mapping;
+			owner->pins = extentPins;
+			owner->pos = extentPos;
+			extentPins->pin(extentPos, extentLength);
+			return TValueView(owner, data, length);
+		}
+
+		// returns mapping which contains requested range. remap file if range is out of current mapping
+		TFileMappingPtr getMapping(ulong64 pos, ulong64 length) {
+			std::unique_lock<std::mutex> lock(mappingMutex);
+			if (mappingPtr == nullptr || !mappingPtr->contains(pos, length)) {
+				TFileMappingPtr newMappingPtr = std::make_shared<TFileMapping>();
+				if (!newMappingPtr->map(fileName) || !newMappingPtr->contains(pos, length)) {
+					return nullptr;
+				}
+
+				// previous mapping will be released after last view
+				mappingPtr = newMappingPtr;
+			}
+
+			return mappingPtr;
+		}
+
+		//========================================================================
+		// write-ahead log
+		//========================================================================
+
+		void appendWalRecord(uint32 type, const TKeyData& keyData, const TValueData* valueData) {
+			TWalRecordHeader header;
+			header.type = type;
+			header.keyData = keyData;
+			header.length = (valueData != nullptr) ? valueData->size() : 0;
+			header.checksum = walRecordChecksum(header, (valueData != nullptr) ? valueData->data() : nullptr);
+
+			if (bBatchWrite) {
+				const byte* headerPtr = (const byte*)&header;
+				batchWalBuffer.insert(batchWalBuffer.end(), headerPtr, headerPtr + sizeof(header));
+				if (header.length > 0) {
+					batchWalBuffer.insert(batchWalBuffer.end(), valueData->begin(), valueData->end());
+				}
+			} else {
+				walIO.writeObj(walEnd, header);
+				if (header.length > 0) {
+					walIO.writeAt(walEnd + sizeof(header), valueData->data(), header.length);
+				}
+			}
+
+			if (type == WAL_SAVE) {
+				TWalEntry entry;
+				entry.dataPos = walEnd + sizeof(header);
+				entry.dataLength = header.length;
+				walMap[keyData] = entry;
+				walPatchMap.erase(keyData);
+			}
+
+			if (type == WAL_ERASE) {
+				TWalEntry entry;
+				entry.bErased = true;
+				walMap[keyData] = entry;
+				walPatchMap.erase(keyData);
+			}
+
+			if (type == WAL_PATCH) {
+				TWalEntry entry;
+				entry.dataPos = walEnd + sizeof(header);
+				entry.dataLength = header.length;
+				walPatchMap[keyData].push_back(entry);
+			}
+
+			walEnd += sizeof(header) + header.length;
+
+			if (type != WAL_COMMIT) {
+				uncommittedRecords++;
+			}
+		}
+
+		// batch buffer is always a tail of log
+		void flushBatchWal() {
+			if (batchWalBuffer.empty()) return;
+
+			walIO.writeAt(walEnd - batchWalBuffer.size(), batchWalBuffer.data(), batchWalBuffer.size());
+			batchWalBuffer.clear();
+		}
+
+		void commitWal() {
+			if (uncommittedRecords == 0) return;
+
+			TKeyData empty = {};
+			appendWalRecord(WAL_COMMIT, empty, nullptr);
+			uncommittedRecords = 0;
+
+			if (durability != DURABILITY_NONE) {
+				walIO.sync();
+			}
+		}
+
+		void logRecord(uint32 type, const TKeyData& keyData, const TValueData* valueData) {
+			appendWalRecord(type, keyData, valueData);
+
+			endWalRecords();
+		}
+
+		void endWalRecords() {
+			if (durability == DURABILITY_FULL || uncommittedRecords >= groupCommitSize) {
+				commitWal();
+			}
+
+			if (walEnd >= KVDB_WAL_CHECKPOINT_SIZE) {
+				checkpointWal();
+			}
+		}
+
+		bool isLogged(const TKeyData& keyData) const {
+			return bUseWal && (walMap.find(keyData) != walMap.end() || walPatchMap.find(keyData) != walPatchMap.end());
+		}
+
+		// value starts after record header in version 2 files
+		ulong64 recordValueOffset() const {
+			return (fileVersion < KVDB_FILE_VERSION) ? 0 : sizeof(TRecordHeader);
+		}
+
+		// write logged patches of key over its record
+		void overlayPatches(const TKeyData& keyData, TValueData& record) const {
+			auto got = walPatchMap.find(keyData);
+			if (got == walPatchMap.end()) return;
+
+			overlayPatches(got->second, record);
+		}
+
+		void overlayPatches(const std::vector<TWalEntry>& patchList, TValueData& record) const {
+			for (const TWalEntry& entry : patchList) {
+				ulong64 offset = 0;
+				if (entry.dataLength < sizeof(offset) || !walIO.readObj(entry.dataPos, offset)) continue;
+
+				const ulong64 pos = recordValueOffset() + offset;
+				const ulong64 length = entry.dataLength - sizeof(offset);
+				if (pos + length > record.size()) continue;
+
+				walIO.readAt(entry.dataPos + sizeof(offset), record.data() + pos, length);
+			}
+		}
+
+		// apply all logged records to data file and reset log
+		void checkpointWal() {
+			commitWal();
+
+			if (walMap.empty() && walPatchMap.empty()) return;
+
+			// log is dropped below
+			detachRetired(true);
+
+			std::vector<std::pair<TKeyData, TWalEntry>> walList(walMap.begin(), walMap.end());
+			if (placement == PLACEMENT_MORTON) {
+				std::sort(walList.begin(), walList.end(), [](const std::pair<TKeyData, TWalEntry>& a, const std::pair<TKeyData, TWalEntry>& b) { return mortonCode(a.first) < mortonCode(b.first); });
+			}
+
+			beginBatchWrite();
+			for (auto& it : walList) {
+				const TWalEntry& entry = it.second;
+				const bool bKeepOld = isRetiredExtent(it.first);
+				if (entry.bErased) {
+					applyErase(it.first, bKeepOld);
+				} else {
+					TValueData valueData(entry.dataLength);
+					if (walIO.readAt(entry.dataPos, valueData.data(), entry.dataLength)) {
+						overlayPatches(it.first, valueData);
+						applySave(it.first, valueData, bKeepOld);
+					}
+				}
+			}
+
+			// patches of pairs which are only in data file go in place
+			for (auto& it : walPatchMap) {
+				if (walMap.find(it.first) != walMap.end()) continue;
+
+				const TIndexEntry* e = dataMap.find(it.first);
+				if (e == nullptr) continue;
+
+				TValueData record(e->dataLength);
+				if (!fileIO.readAt(e->dataPos, record.data(), e->dataLength)) continue;
+				overlayPatches(it.first, record);
+				const bool bKeepOld = isRetiredExtent(it.first);
+				if (bKeepOld || extentPins->isPinned(e->dataPos)) {
+					applySave(it.first, record, bKeepOld);
+				} else {
+					writeValueAt(e->dataPos, record);
+				}
+			}
+			endBatchWrite();
+
+			// data file must be on disk before log is dropped
+			fileIO.sync();
+
+			walMap.clear();
+			walPatchMap.clear();
+			walIO.truncate(0);
+			walIO.sync();
+			walEnd = 0;
+
+			// no log record refers to retired extents now
+			if (!retiredExtentList.empty()) {
+				for (TRetiredExtent& retired : retiredExtentList) retired.bLogged = false;
+				reclaimRetired();
+			}
+		}
+
+		// read committed groups after crash. incomplete or broken tail is dropped
+		void replayWal() {
+			const ulong64 walSize = walIO.size();
+			std::vector<std::pair<TWalRecordHeader, ulong64>> group;
+			ulong64 pos = 0;
+			walEnd = 0;
+
+			while (pos + sizeof(TWalRecordHeader) <= walSize) {
+				TWalRecordHeader header;
+				if (!walIO.readObj(pos, header) || header.magic != KVDB_WAL_MAGIC) break;
+
+				const ulong64 dataPos = pos + sizeof(TWalRecordHeader);
+				if (dataPos + header.length > walSize) break;
+
+				TValueData valueData(header.length);
+				if (header.length > 0 && !walIO.readAt(dataPos, valueData.data(), header.length)) break;
+				if (walRecordChecksum(header, valueData.data()) != header.checksum) break;
+
+				pos = dataPos + header.length;
+
+				if (header.type == WAL_COMMIT) {
+					for (auto& record : group) {
+						TWalEntry entry;
+						entry.dataPos = record.second;
+						entry.dataLength = record.first.length;
+
+						if (record.first.type == WAL_PATCH) {
+							walPatchMap[record.first.keyData].push_back(entry);
+						} else {
+							entry.bErased = (record.first.type == WAL_ERASE);
+							walMap[record.first.keyData] = entry;
+							walPatchMap.erase(record.first.keyData);
+						}
+					}
+
+					group.clear();
+					walEnd = pos;
+				} else {
+					group.push_back({ header, dataPos });
+				}
+			}
+
+			// logged values refer to extents which were written before commit
+			if (valueExtents) {
+				std::vector<std::pair<ulong64, ulong64>> extentList;
+				for (const auto& it : walMap) {
+					if (!it.second.bErased) listValueExtents(walIO, it.second.dataPos, it.second.dataLength, extentList);
+				}
+
+				for (const auto& extent : extentList) {
+					freeSpace.reserve(extent.first, extent.second);
+				}
+			}
+
+			checkpointWal();
+
+			if (walIO.size() > 0) {
+				walIO.truncate(0);
+			}
+		}
+
+		// false if table is out of file, overlaps other table or has too many slots for index entry
+		bool readTable(ulong64 tablePos, std::map<ulong64, ulong64>& tableExtentMap, ulong64& nextTablePos) {
+			TTableHeader tableHeader;
+			if (tablePos + sizeof(TTableHeader) > endOfFile || !fileIO.readObj(tablePos, tableHeader)) return false;
+
+			const ulong64 entryListPos = tablePos + sizeof(TTableHeader);
+			const ulong64 tableEnd = entryListPos + tableHeader.recordCount * sizeof(TKeyEntry);
+			if (tableEnd > endOfFile || (ulong64)slotCount + tableHeader.recordCount > KVDB_MAX_SLOTS) return false;
+
+			// chain of tables must not loop or overlap
+			auto next = tableExtentMap.lower_bound(tablePos);
+			if (next != tableExtentMap.end() && next->first < tableEnd) return false;
+			if (next != tableExtentMap.begin() && std::prev(next)->second > tablePos) return false;
+			tableExtentMap[tablePos] = tableEnd;
+
+			// whole table with one read
+			std::vector<TKeyEntry> entryList(tableHeader.recordCount);
+			if (!fileIO.readAt(entryListPos, entryList.data(), entryList.size() * sizeof(TKeyEntry))) return false;
+
+			dataMap.reserve(dataMap.size() + entryList.size());
+			const uint32 firstSlot = slotCount;
+			addSlotTable(entryListPos, entryList.size());
+
+			for (size_t i = 0; i < entryList.size(); i++) {
+				const TKeyEntry& keyEntry = entryList[i];
+
+				if (keyEntry.dataLength > 0) {
+					if (keyEntry.dataPos + keyEntry.dataLength > endOfFile || keyEntry.dataLength > KVDB_MAX_RECORD_LENGTH) return false;
+					indexPair(keyEntry, firstSlot + (uint32)i);
+				} else {
+					// reserved key slot or deleted pair (older files). 
+					// space of deleted pair is found by buildFreeSpace()
+					TReservedKey reserved;
+					reserved.keyInfo = TKeyEntryInfo(keyEntry, entryListPos + i * sizeof(TKeyEntry));
+					reserved.slot = firstSlot + (uint32)i;
+					reservedKeyList.push_back(reserved);
+				}
+			}
+
+			tableList.push_back(TTableHeaderInfo(tableHeader, tablePos));
+			nextTablePos = tableHeader.nextTable;
+			return true;
+		}
+
+		// false if file is damaged or too large for index entry
+		bool readIndex() {
+			endOfFile = fileIO.size();
+			if (endOfFile > KVDB_MAX_FILE_SIZE) return false;
+
+			TFileHeader fileHeader;
+			if (!fileIO.readObj(0, fileHeader)) return false;
+
+			fileVersion = fileHeader.version;
+			if (!bCodecSet) {
+				codecId = (fileVersion >= KVDB_FILE_VERSION) ? (uint32)fileHeader.codec : (uint32)CODEC_NONE;
+			}
+
+			std::map<ulong64, ulong64> tableExtentMap;
+			ulong64 nextTablePos = sizeof(TFileHeader);
+			while (nextTablePos > 0) {
+				if (!readTable(nextTablePos, tableExtentMap, nextTablePos)) {
+					clearIndex();
+					return false;
+				}
+			}
+
+			buildFreeSpace();
+			return true;
+		}
+
+		// closed file state. log must be checkpointed before
+		void releaseFile() {
+			bOpen = false;
+			walIO.close();
+			fileIO.close();
+			mappingPtr = nullptr;
+			valueCache.clear();
+			retiredMap.clear();
+			retiredExtentList.clear();
+			changedKeySet.clear();
+			bTrackChanges = false;
+			clearIndex();
+		}
+
+		void clearIndex() {
+			dataMap.clear();
+			slotTableList.clear();
+			slotCount = 0;
+			reservedKeyList.clear();
+			freeSpace.clear();
+			pinnedFreeList.clear();
+			tableList.clear();
+		}
+
+		// write live values to new file one after another, with single key table
+		bool writeCompacted(const std::string& file, ulong64& recordCount) {
+			std::vector<TKeyEntry> entryList;
+			entryList.reserve(dataMap.size());
+			dataMap.forEach([&](const TIndexEntry& entry) {
+				entryList.push_back(toKeyEntry(entry));
+			});
+
+			if (placement == PLACEMENT_MORTON) {
+				std::sort(entryList.begin(), entryList.end(), [](const TKeyEntry& a, const TKeyEntry& b) { return mortonCode(a.freeKeyData) < mortonCode(b.freeKeyData); });
+			} else {
+				// sequential read of old file
+				std::sort(entryList.begin(), entryList.end(), [](const TKeyEntry& a, const TKeyEntry& b) { return a.dataPos < b.dataPos; });
+			}
+
+			const ulong64 tableSize = (entryList.size() > KVDB_RESERVED_TABLE_SIZE) ? entryList.size() : KVDB_RESERVED_TABLE_SIZE;
+			const ulong64 dataStart = sizeof(TFileHeader) + sizeof(TTableHeader) + tableSize * sizeof(TKeyEntry);
+
+			TFileIO newFileIO;
+			std::remove(file.c_str());
+			if (!newFileIO.open(file, true)) return false;
+
+			TFileHeader fileHeader;
+			fileHeader.keySize = KVDB_KEY_SIZE;
+			fileHeader.endOfHeaderOffset = sizeof(fileHeader);
+			fileHeader.codec = codecId;
+
+			TTableHeader tableHeader;
+			tableHeader.recordCount = tableSize;
+
+			bool bIsOk = newFileIO.writeObj(0, fileHeader);
+			bIsOk = bIsOk && newFileIO.writeObj(sizeof(TFileHeader), tableHeader);
+
+			// copy values with large sequential writes. version 1 values are encoded on the way
+			static const ulong64 chunkSize = 4 * 1024 * 1024;
+			std::vector<TKeyEntry> newEntryList(tableSize);
+			TValueData chunk;
+			chunk.reserve(chunkSize);
+			ulong64 chunkPos = dataStart;
+			for (size_t i = 0; i < entryList.size() && bIsOk; i++) {
+				const TKeyEntry& entry = entryList[i];
+				size_t offset = chunk.size();
+
+				if (valueExtents && fileVersion >= KVDB_FILE_VERSION) {
+					// extents of value go right before it, value gets their new positions
+					TValueData record(entry.dataLength);
+					bIsOk = fileIO.readAt(entry.dataPos, record.data(), record.size());
+					if (bIsOk && record.size() > sizeof(TRecordHeader)) {
+						valueExtents(record.data() + sizeof(TRecordHeader), record.size() - sizeof(TRecordHeader), [&](ulong64 pos, ulong64 length) {
+							const size_t extentOffset = chunk.size();
+							chunk.resize(extentOffset + length);
+							bIsOk = bIsOk && fileIO.readAt(pos, chunk.data() + extentOffset, length);
+							return chunkPos + extentOffset;
+						});
+					}
+
+					offset = chunk.size();
+					chunk.insert(chunk.end(), record.begin(), record.end());
+				} else if (fileVersion >= KVDB_FILE_VERSION) {
+					chunk.resize(offset + entry.dataLength);
+					bIsOk = fileIO.readAt(entry.dataPos, chunk.data() + offset, entry.dataLength);
+				} else {
+					TValueData valueData(entry.dataLength);
+					TValueData record;
+					bIsOk = fileIO.readAt(entry.dataPos, valueData.data(), valueData.size());
+					encodeRecord(codecId, valueData, record);
+					chunk.insert(chunk.end(), record.begin(), record.end());
+				}
+
+				TKeyEntry& newEntry = newEntryList[i];
+				newEntry = entry;
+				newEntry.dataPos = chunkPos + offset;
+				newEntry.dataLength = chunk.size() - offset;
+				newEntry.initialDataLength = newEntry.dataLength; // reserved padding is dropped
+
+				if (chunk.size() >= chunkSize) {
+					bIsOk = bIsOk && newFileIO.writeAt(chunkPos, chunk.data(), chunk.size());
+					chunkPos += chunk.size();
+					chunk.clear();
+				}
+			}
+
+			if (!chunk.empty()) {
+				bIsOk = bIsOk && newFileIO.writeAt(chunkPos, chunk.data(), chunk.size());
+			}
+
+			bIsOk = bIsOk && newFileIO.writeAt(sizeof(TFileHeader) + sizeof(TTableHeader), newEntryList.data(), tableSize * sizeof(TKeyEntry));
+
+			bIsOk = bIsOk && newFileIO.sync();
+			newFileIO.close();
+
+			if (!bIsOk) {
+				std::remove(file.c_str());
+			}
+
+			recordCount = entryList.size();
+			return bIsOk;
+		}
+
+		// extents which stored record refers to, see valueExtents
+		void listValueExtents(const TFileIO& io, ulong64 recordPos, ulong64 recordLength, std::vector<std::pair<ulong64, ulong64>>& extentList) const {
+			const ulong64 valueOffset = recordValueOffset();
+			if (recordLength <= valueOffset) return;
+
+			TValueData record(recordLength);
+			if (!io.readAt(recordPos, record.data(), record.size())) return;
+
+			valueExtents(record.data() + valueOffset, record.size() - valueOffset, [&](ulong64 pos, ulong64 length) {
+				extentList.push_back({ pos, length });
+				return pos;
+			});
+		}
+
+		// free space is everything between header, key tables, live values and extents they refer to
+		void buildFreeSpace() {
+			std::vector<std::pair<ulong64, ulong64>> usedList;
+			usedList.reserve(dataMap.size() + tableList.size() + 1);
+			usedList.push_back({ 0, sizeof(TFileHeader) });
+
+			for (const TTableHeaderInfo& table : tableList) {
+				usedList.push_back({ table.pos, sizeof(TTableHeader) + table().recordCount * sizeof(TKeyEntry) });
+			}
+
+			dataMap.forEach([&](const TIndexEntry& entry) {
+				usedList.push_back({ entry.dataPos, entry.dataLength });
+				if (valueExtents) listValueExtents(fileIO, entry.dataPos, entry.dataLength, usedList);
+			});
+
+			// extents of replaced values which views of reopened file still read
+			std::vector<std::pair<ulong64, ulong64>> pinnedList = extentPins->list();
+			if (!pinnedList.empty()) {
+				std::unordered_set<ulong64> livePosSet;
+				dataMap.forEach([&](const TIndexEntry& entry) {
+					livePosSet.insert(entry.dataPos);
+				});
+
+				for (const auto& pinned : pinnedList) {
+					if (livePosSet.find(pinned.first) != livePosSet.end()) continue;
+					usedList.push_back(pinned);
+					pinnedFreeList.push_back(pinned);
+				}
+			}
+
+			std::sort(usedList.begin(), usedList.end());
+
+			freeSpace.clear();
+			ulong64 pos = 0;
+			for (const auto& used : usedList) {
+				if (used.first > pos) {
+					freeSpace.release(pos, used.first - pos);
+				}
+
+				if (used.first + used.second > pos) {
+					pos = used.first + used.second;
+				}
+			}
+
+			if (endOfFile > pos) {
+				freeSpace.release(pos, endOfFile - pos);
+			}
+		}
+
+		void createNewTable() {
+			// table goes after already collected values
+			flushBatchAppend();
+
+			// append to end-of-file
+			ulong64 newTablePos = endOfFile;
+
+			// write new table with reserved keys at once
+			TTableHeader newTable;
+			newTable.recordCount = reservedKeys;
+			newTable.nextTable = 0;
+
+			TValueData tableData(sizeof(TTableHeader) + reservedKeys * sizeof(TKeyEntry));
+			std::memcpy(tableData.data(), &newTable, sizeof(TTableHeader));
+
+			TKeyEntry newReservedKey;
+			for (uint32 i = 0; i < reservedKeys; i++) {
+				ulong64 newReservedKeyPos = newTablePos + sizeof(TTableHeader) + i * sizeof(TKeyEntry);
+				std::memcpy(tableData.data() + sizeof(TTableHeader) + i * sizeof(TKeyEntry), &newReservedKey, sizeof(TKeyEntry));
+
+				TReservedKey reserved;
+				reserved.keyInfo = TKeyEntryInfo(newReservedKey, newReservedKeyPos);
+				reserved.slot = slotCount + i;
+				reservedKeyList.push_back(reserved);
+			}
+
+			fileIO.writeAt(newTablePos, tableData.data(), tableData.size());
+
+			endOfFile = newTablePos + sizeof(TTableHeader) + reservedKeys * sizeof(TKeyEntry);
+			addSlotTable(newTablePos + sizeof(TTableHeader), reservedKeys);
+
+			// read previous last table 
+			TTableHeaderInfo& lastTable = tableList.back();
+
+			// add link to new table
+			lastTable().nextTable = newTablePos;
+
+			// rewrite previous last table
+			fileIO.writeObj(lastTable.pos, lastTable());
+
+			// add new table to internal list
+			tableList.push_back(TTableHeaderInfo(newTable, newTablePos));
+		}
+
+		bool hasReserved() {
+			return reservedKeyList.size() > 0;
+		}
+
+		// record of batch, under write lock. empty record erases key. see saveBatch
+		void writeRecordLocked(const TKeyData& keyData, const TValueData& record) {
+			const bool bKeepOld = retirePair(keyData);
+			trackChange(keyData);
+			if (bUseWal) {
+				appendWalRecord(record.size() > 0 ? WAL_SAVE : WAL_ERASE, keyData, &record);
+			} else if (record.size() > 0) {
+				applySave(keyData, record, bKeepOld);
+			} else {
+				applyErase(keyData, bKeepOld);
+			}
+		}
+
+		// bExtentsWritten - batch wrote extents which logged values refer to, they must be on disk before log commit
+		void endBatchLocked(bool bExtentsWritten) {
+			if (bUseWal) {
+				if (bExtentsWritten) {
+					flushBatchAppend();
+					if (durability != DURABILITY_NONE) fileIO.sync();
+				}
+
+				flushBatchWal();
+				bBatchWrite = false;
+				commitWal();
+
+				if (walEnd >= KVDB_WAL_CHECKPOINT_SIZE) {
+					checkpointWal();
+				}
+			} else {
+				endBatchWrite();
+			}
+
+			// whole batch is one version
+			version++;
+		}
+
+		// whether file stays inside limits of index entry after appendLength bytes and keyCount new keys.
+		// write-ahead log counts as appended, it is checkpointed to the end of file in the worst case
+		bool hasRoom(ulong64 appendLength, ulong64 keyCount) const {
+			const ulong64 newSlots = keyCount + (bUseWal ? walMap.size() : 0);
+			const ulong64 newTables = newSlots / reservedKeys + 1;
+			const ulong64 tableLength = newTables * (sizeof(TTableHeader) + reservedKeys * sizeof(TKeyEntry));
+			const ulong64 pendingLength = bUseWal ? walEnd : 0;
+
+			return endOfFile + pendingLength + appendLength + tableLength <= KVDB_MAX_FILE_SIZE &&
+				slotCount + newTables * reservedKeys <= KVDB_MAX_SLOTS;
+		}
+
+		void addNew(const TKeyData& keyData, const TValueData& valueData) {
+			if (valueData.size() == 0) {
+				return;
+			}
+
+			if (!hasReserved()) {
+				createNewTable();
+			}
+
+			newPairFromReserved(keyData, valueData);
+		}
+
+		// bKeepOld - old value is retired, so it is neither rewritten nor released
+		void change(const TKeyData& keyData, const TValueData& valueData, bool bKeepOld = false) {
+			const TIndexEntry entry = *dataMap.find(keyData);
+			TKeyEntryInfo keyInfo = toKeyInfo(entry);
+			if (valueData.size() > 0) {
+				// in place if value fits or free extent right after it takes the rest
+				const ulong64 oldLength = keyInfo().dataLength;
+				const bool bInPlace = !bKeepOld && !extentPins->isPinned(keyInfo().dataPos) &&
+					(valueData.size() <= oldLength || freeSpace.allocateAt(keyInfo().dataPos + oldLength, valueData.size() - oldLength));
+
+				if (bInPlace) {
+					rewritePair(keyInfo, valueData);
+				} else {
+					// move value to new place, keep key slot. old space is released after new is written
+					const ulong64 oldPos = keyInfo().dataPos;
+
+					keyInfo().dataPos = allocateValue(valueData);
+					keyInfo().dataLength = valueData.size();
+					keyInfo().initialDataLength = valueData.size();
+					writeKeyEntry(keyInfo);
+
+					if (!bKeepOld) {
+						releaseExtent(oldPos, oldLength);
+					}
+				}
+
+				indexPair(keyInfo(), entry.slot);
+			} else {
+				// erase
+				earsePair(keyInfo, bKeepOld);
+			}
+		}
+
+		void applySave(const TKeyData& keyData, const TValueData& valueData, bool bKeepOld = false) {
+			if (!dataMap.contains(keyData)) {
+				// pair not found  
+				addNew(keyData, valueData);
+			} else {
+				// pair found  
+				change(keyData, valueData, bKeepOld);
+			}
+		}
+
+		void applyErase(const TKeyData& keyData, bool bKeepOld = false) {
+			const TIndexEntry* entry = dataMap.find(keyData);
+			if (entry != nullptr) {
+				TKeyEntryInfo keyInfo = toKeyInfo(*entry);
+				earsePair(keyInfo, bKeepOld);
+			}
+		}
+
+		//========================================================================
+		// telemetry
+		//========================================================================
+
+		// uncontended lock is not timed
+		template <typename L>
+		void lockTimed(L& lock) {
+			if (lock.try_lock()) return;
+
+			TLatencyTimer timer(lockWaitHistogram);
+			lock.lock();
+		}
+
+		//========================================================================
+		// backup
+		//========================================================================
+
+		void trackChange(const TKeyData& keyData) {
+			if (bTrackChanges) changedKeySet.insert(keyData);
+		}
+
+		//========================================================================
+		// snapshots
+		//========================================================================
+
+		bool hasSnapshots() const {
+			std::unique_lock<std::mutex> lock(snapshotMutex);
+			return !snapshotSet.empty();
+		}
+
+		// keep state of pair before it is written in next version, if any snapshot may read it
+		// returns true if value extent of data file must stay as is
+		bool retirePair(const TKeyData& keyData) {
+			if (!hasSnapshots()) return false;
+
+			std::vector<TRetiredVersion>& versionList = retiredMap[keyData];
+			if (!versionList.empty() && versionList.back().endVersion > version) {
+				// already kept by this version (the same key twice in batch)
+				return false;
+			}
+
+			TRetiredVersion retired;
+			retired.endVersion = version + 1;
+
+			// extent of data file or of log, with logged patches. nothing is copied here:
+			// log extents are copied on checkpoint, data extent is kept by checkpoint
+			auto logged = bUseWal ? walMap.find(keyData) : walMap.end();
+			if (logged != walMap.end()) {
+				if (!logged->second.bErased) {
+					retired.bExists = true;
+					retired.bInWal = true;
+					retired.dataPos = logged->second.dataPos;
+					retired.dataLength = logged->second.dataLength;
+				}
+			} else {
+				const TIndexEntry* entry = dataMap.find(keyData);
+				if (entry != nullptr) {
+					retired.bExists = true;
+					retired.dataPos = entry->dataPos;
+					retired.dataLength = entry->dataLength;
+				}
+			}
+
+			auto patched = bUseWal ? walPatchMap.find(keyData) : walPatchMap.end();
+			if (retired.bExists && patched != walPatchMap.end()) {
+				retired.patchList = patched->second;
+			}
+
+			versionList.push_back(retired);
+			return retired.bExists && !bUseWal;
+		}
+
+		// extent which value referred to. released when no snapshot can read it and no log record refers to it
+		void retireExtent(ulong64 pos, ulong64 length) {
+			if (!bUseWal && !hasSnapshots()) {
+				releaseExtent(pos, length);
+				return;
+			}
+
+			TRetiredExtent retired;
+			retired.endVersion = version + 1;
+			retired.pos = pos;
+			retired.length = length;
+			retired.bLogged = bUseWal;
+			retiredExtentList.push_back(retired);
+		}
+
+		// live extent of pair is read by retired version, so it is moved instead of rewritten
+		bool isRetiredExtent(const TKeyData& keyData) const {
+			auto got = retiredMap.find(keyData);
+			const TIndexEntry* entry = dataMap.find(keyData);
+			if (got == retiredMap.end() || entry == nullptr) return false;
+
+			for (const TRetiredVersion& retired : got->second) {
+				if (isExtentRef(retired) && retired.dataPos == entry->dataPos) return true;
+			}
+
+			return false;
+		}
+
+		static bool isExtentRef(const TRetiredVersion& retired) {
+			return retired.bExists && !retired.bInWal && retired.recordPtr == nullptr;
+		}
+
+		// release versions which no snapshot can read
+		void reclaimRetired() {
+			ulong64 oldest = ULLONG_MAX;
+			{
+				std::unique_lock<std::mutex> lock(snapshotMutex);
+				if (!snapshotSet.empty()) oldest = *snapshotSet.begin();
+			}
+
+			for (auto it = retiredMap.begin(); it != retiredMap.end();) {
+				std::vector<TRetiredVersion>& versionList = it->second;
+				const TIndexEntry* entry = dataMap.find(it->first);
+				size_t count = 0;
+				while (count < versionList.size() && versionList[count].endVersion <= oldest) {
+					const TRetiredVersion& retired = versionList[count];
+					count++;
+
+					// extent which is still live (log is not checkpointed yet) or read by newer version stays
+					if (!isExtentRef(retired) || (entry != nullptr && entry->dataPos == retired.dataPos)) continue;
+
+					const bool bShared = std::any_of(versionList.begin() + count, versionList.end(), [&](const TRetiredVersion& newer) {
+						return isExtentRef(newer) && newer.dataPos == retired.dataPos;
+					});
+
+					if (!bShared) {
+						releaseExtent(retired.dataPos, retired.dataLength);
+					}
+				}
+
+				versionList.erase(versionList.begin(), versionList.begin() + count);
+				if (versionList.empty()) {
+					it = retiredMap.erase(it);
+				} else {
+					++it;
+				}
+			}
+
+			auto last = std::remove_if(retiredExtentList.begin(), retiredExtentList.end(), [&](const TRetiredExtent& retired) {
+				if (retired.bLogged || retired.endVersion > oldest) return false;
+				releaseExtent(retired.pos, retired.length);
+				return true;
+			});
+			retiredExtentList.erase(last, retiredExtentList.end());
+		}
+
+		// copy retired extents before data file is replaced, 
+		// or only ones which read log (bLogged) before log is truncated
+		void detachRetired(bool bLogged = false) {
+			for (auto& it : retiredMap) {
+				for (TRetiredVersion& retired : it.second) {
+					if (!retired.bExists || retired.recordPtr != nullptr) continue;
+					if (bLogged && !retired.bInWal && retired.patchList.empty()) continue;
+
+					retired.recordPtr = loadRetiredRecord(retired);
+					retired.bExists = retired.recordPtr != nullptr;
+					retired.bInWal = false;
+					retired.patchList.clear();
+				}
+			}
+		}
+
+		void releaseSnapshot(ulong64 snapshotVersion) {
+			std::unique_lock<std::mutex> writeLock(writeMutex);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			{
+				std::unique_lock<std::mutex> snapshotLock(snapshotMutex);
+				auto got = snapshotSet.find(snapshotVersion);
+				if (got != snapshotSet.end()) snapshotSet.erase(got);
+			}
+
+			if (fileIO.isOpen()) {
+				reclaimRetired();
+			}
+		}
+
+		// retired version which snapshot sees. nullptr - pair was not written after snapshot
+		const TRetiredVersion* findRetired(const TKeyData& keyData, ulong64 snapshotVersion) const {
+			auto got = retiredMap.find(keyData);
+			if (got == retiredMap.end()) return nullptr;
+
+			// ordered by version, the first one written after snapshot
+			for (const TRetiredVersion& retired : got->second) {
+				if (retired.endVersion > snapshotVersion) return &retired;
+			}
+
+			return nullptr;
+		}
+
+		TValueDataPtr loadRetired(const TRetiredVersion& retired) const {
+			return fromRecord(loadRetiredRecord(retired));
+		}
+
+		TValueDataPtr loadRetiredRecord(const TRetiredVersion& retired) const {
+			if (!retired.bExists) return nullptr;
+			if (retired.recordPtr != nullptr) return retired.recordPtr;
+
+			const TFileIO& io = retired.bInWal ? walIO : fileIO;
+			TValueDataPtr recordPtr = TValueDataPtr(new TValueData(retired.dataLength));
+			if (!io.readAt(retired.dataPos, recordPtr->data(), retired.dataLength)) return nullptr;
+
+			overlayPatches(retired.patchList, *recordPtr);
+			return recordPtr;
+		}
+
+		// stored record to value
+		TValueDataPtr fromRecord(TValueDataPtr recordPtr) const {
+			if (recordPtr == nullptr || fileVersion < KVDB_FILE_VERSION) return recordPtr;
+
+			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+			if (!decodeRecord(recordPtr->data(), recordPtr->size(), *dataPtr)) {
+				return nullptr;
+			}
+
+			return dataPtr;
+		}
+
+		TValueDataPtr fromRecord(const byte* record, ulong64 length) const {
+			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+			if (fileVersion < KVDB_FILE_VERSION) {
+				dataPtr->assign(record, record + length);
+			} else if (!decodeRecord(record, length, *dataPtr)) {
+				return nullptr;
+			}
+
+			return dataPtr;
+		}
+
+		// value to stored record. version 1 files keep raw values
+		void toRecord(const TValueData& valueData, TValueData& record) const {
+			if (fileVersion < KVDB_FILE_VERSION) {
+				record = valueData;
+			} else {
+				encodeRecord(codecId, valueData, record);
+			}
+		}
+
+		TValueDataPtr loadDataLocked(const TKeyData& keyData) {
+			return fromRecord(loadRecordLocked(keyData));
+		}
+
+		TValueDataPtr loadRecordLocked(const TKeyData& keyData) {
+			if (bUseWal) {
+				auto logged = walMap.find(keyData);
+				if (logged != walMap.end()) {
+					const TWalEntry& entry = logged->second;
+					if (entry.bErased) {
+						return nullptr;
+					}
+
+					TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+					dataPtr->resize(entry.dataLength);
+					if (walIO.readAt(entry.dataPos, dataPtr->data(), entry.dataLength)) {
+						overlayPatches(keyData, *dataPtr);
+						return dataPtr;
+					}
+
+					return nullptr;
+				}
+			}
+
+			const TIndexEntry* e = dataMap.find(keyData);
+			if (e == nullptr) {
+				return nullptr;
+			}
+
+			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+			dataPtr->resize(e->dataLength);
+
+			// positional read, so loads of other threads are not blocked
+			if (fileIO.readAt(e->dataPos, dataPtr->data(), e->dataLength)) {
+				if (bUseWal) overlayPatches(keyData, *dataPtr);
+				return dataPtr;
+			}
+
+			return nullptr;
+		}
+
+		// length of value if its record can be written in place: uncompressed and not erased
+		bool patchableLength(const TKeyData& keyData, ulong64& valueLength) const {
+			ulong64 recordPos = 0;
+			ulong64 recordLength = 0;
+			const TFileIO* io = &fileIO;
+
+			auto logged = bUseWal ? walMap.find(keyData) : walMap.end();
+			if (logged != walMap.end()) {
+				if (logged->second.bErased) return false;
+				recordPos = logged->second.dataPos;
+				recordLength = logged->second.dataLength;
+				io = &walIO;
+			} else {
+				const TIndexEntry* e = dataMap.find(keyData);
+				if (e == nullptr) return false;
+				recordPos = e->dataPos;
+				recordLength = e->dataLength;
+			}
+
+			if (fileVersion < KVDB_FILE_VERSION) {
+				valueLength = recordLength;
+				return true;
+			}
+
+			TRecordHeader recordHeader;
+			if (recordLength < sizeof(TRecordHeader) || !io->readObj(recordPos, recordHeader)) return false;
+			if (recordHeader.codec != CODEC_NONE || recordHeader.rawLength != recordLength - sizeof(TRecordHeader)) return false;
+
+			valueLength = recordHeader.rawLength;
+			return true;
+		}
+
+		bool isExistLocked(const TKeyData& keyData) const {
+			if (bUseWal) {
+				auto logged = walMap.find(keyData);
+				if (logged != walMap.end()) {
+					return !logged->second.bErased;
+				}
+			}
+
+			return dataMap.contains(keyData);
+		}
+
+		// read records in position order, neighbour records at once. func gets decoded values
+		template <typename F>
+		void readEntries(std::vector<TKeyEntry>& entryList, F func) {
+			std::sort(entryList.begin(), entryList.end(), [](const TKeyEntry& a, const TKeyEntry& b) { return a.dataPos < b.dataPos; });
+
+			TValueData buffer;
+			size_t first = 0;
+			while (first < entryList.size()) {
+				const ulong64 start = entryList[first].dataPos;
+				ulong64 end = start + entryList[first].dataLength;
+				size_t last = first;
+				while (last + 1 < entryList.size()) {
+					const TKeyEntry& next = entryList[last + 1];
+					const ulong64 nextEnd = std::max(end, next.dataPos + next.dataLength);
+					if (next.dataPos > end + KVDB_RANGE_MAX_GAP || nextEnd - start > KVDB_RANGE_MAX_READ) break;
+					end = nextEnd;
+					last++;
+				}
+
+				const byte* data = nullptr;
+				TFileMappingPtr mapping = bUseMemoryMapping ? getMapping(start, end - start) : nullptr;
+				if (mapping != nullptr) {
+					data = mapping->data() + start;
+				} else {
+					buffer.resize(end - start);
+					if (fileIO.readAt(start, buffer.data(), buffer.size())) data = buffer.data();
+				}
+
+				for (size_t i = first; data != nullptr && i <= last; i++) {
+					const TKeyEntry& e = entryList[i];
+					TValueDataPtr dataPtr = fromRecord(data + (e.dataPos - start), e.dataLength);
+					if (dataPtr != nullptr) {
+						func(e.freeKeyData, dataPtr);
+					}
+				}
+
+				first = last + 1;
+			}
+		}
+
+		//========================================================================
+		// async
+		//========================================================================
+
+		void runAsync(std::function<void()> task) {
+			TIoThreadPoolPtr pool;
+			{
+				std::unique_lock<std::mutex> lock(asyncMutex);
+				if (ioPool == nullptr) {
+					ioPool = std::make_shared<TIoThreadPool>();
+				}
+
+				pool = ioPool;
+				pendingAsync++;
+			}
+
+			pool->push([this, task] {
+				task();
+
+				std::unique_lock<std::mutex> lock(asyncMutex);
+				pendingAsync--;
+				asyncCondition.notify_all();
+			});
+		}
+
+		void runSaveQueue() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(asyncMutex);
+					if (saveQueue.empty()) {
+						bSaveQueueRunning = false;
+						return;
+					}
+
+					task = std::move(saveQueue.front());
+					saveQueue.pop_front();
+				}
+
+				task();
+			}
+		}
+
+		void pushSave(std::function<void()> task) {
+			bool bStart = false;
+			{
+				std::unique_lock<std::mutex> lock(asyncMutex);
+				saveQueue.push_back(std::move(task));
+				bStart = !bSaveQueueRunning;
+				bSaveQueueRunning = true;
+			}
+
+			if (bStart) {
+				runAsync([this] { runSaveQueue(); });
+			}
+		}
+
+		void waitAsync() {
+			std::unique_lock<std::mutex> lock(asyncMutex);
+			asyncCondition.wait(lock, [&] { return pendingAsync == 0; });
+		}
+
+		// call with write lock held
+		void updateCache(const TKeyData& keyData, TValueData& valueData) {
+			if (!valueCache.isEnabled()) return;
+
+			if (valueData.size() > 0) {
+				valueCache.put(keyData, std::make_shared<TValueData>(std::move(valueData)));
+			} else {
+				valueCache.erase(keyData);
+			}
+		}
+
+	public:
+
+		KvFile() {
+			assert(sizeof(K) <= KVDB_KEY_SIZE);
+		}
+        
+        ~KvFile() {
+			close();
+		}
+		
+		void setReservedValueSize(uint32 val){
+			reservedValueSize = val;
+		}
+
+		// codec of new records, overrides codec from file header. must be set before open()
+		// version 1 files keep raw values until compacted
+		void setCodec(uint32 codec) {
+			codecId = codec;
+			bCodecSet = true;
+		}
+
+		uint32 getCodec() const {
+			return codecId;
+		}
+
+		// counters and latencies since open or reset, layout of file. walks index
+		TFileStats getStats() {
+			TFileStats stats;
+			stats.dataIo = fileIO.getStats();
+			stats.walIo = walIO.getStats();
+			stats.load = loadHistogram.getStats();
+			stats.save = saveHistogram.getStats();
+			stats.lockWait = lockWaitHistogram.getStats();
+			stats.cache = valueCache.getStats();
+
+			if (!bOpen) return stats;
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			dataMap.forEach([&](const TIndexEntry& entry) {
+				stats.liveBytes += entry.dataLength;
+			});
+
+			for (const auto& it : retiredMap) {
+				for (const TRetiredVersion& retired : it.second) {
+					if (retired.recordPtr != nullptr) {
+						stats.retiredBytes += retired.recordPtr->size();
+					} else if (retired.bExists) {
+						stats.retiredBytes += retired.dataLength;
+					}
+				}
+			}
+
+			for (const TRetiredExtent& retired : retiredExtentList) {
+				stats.retiredBytes += retired.length;
+			}
+
+			for (const TReservedKey& reserved : reservedKeyList) {
+				if (reserved.keyInfo().dataPos != 0) stats.deletedSlots++;
+			}
+
+			stats.fileSize = endOfFile;
+			stats.walSize = walEnd;
+			stats.deadBytes = freeSpace.freeBytes();
+			stats.freeExtents = freeSpace.extentCount();
+			stats.pairs = dataMap.size();
+			stats.keySlots = slotCount;
+			stats.reservedSlots = reservedKeyList.size();
+			stats.tableCount = tableList.size();
+			return stats;
+		}
+
+		void resetStats() {
+			fileIO.resetStats();
+			walIO.resetStats();
+			loadHistogram.reset();
+			saveHistogram.reset();
+			lockWaitHistogram.reset();
+		}
+
+		void setPlacement(TPlacement val) {
+			placement = val;
+		}
+
+		// share one pool between files. by default pool is created on first async call
+		void setIoThreadPool(TIoThreadPoolPtr pool) {
+			std::unique_lock<std::mutex> lock(asyncMutex);
+			ioPool = pool;
+		}
+
+		// keep recently loaded values in memory. zero disables cache
+		// memory mapped views of uncompressed records bypass cache, page cache does the same job
+		void setCacheSize(ulong64 bytes) {
+			valueCache.setCapacity(bytes);
+		}
+
+		TCacheStats getCacheStats() const {
+			return valueCache.getStats();
+		}
+
+		// read values directly from memory mapped file. see loadView()
+		void setMemoryMapping(bool val) {
+			bUseMemoryMapping = val;
+		}
+
+		// log saves to write-ahead log before they are applied to data file
+		// must be set before open()
+		void setWriteAheadLog(bool val, TDurability durabilityLevel = DURABILITY_GROUP, uint32 groupSize = KVDB_WAL_GROUP_COMMIT_SIZE) {
+			bUseWal = val;
+			durability = durabilityLevel;
+			groupCommitSize = (groupSize > 0) ? groupSize : 1;
+		}
+
+		// finish current group of logged saves
+		void commit() {
+			if (!bOpen || !bUseWal) return;
+			std::unique_lock<std::mutex> writeLock(writeMutex);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+			commitWal();
+		}
+
+		// apply write-ahead log to data file
+		void checkpoint() {
+			if (!bOpen || !bUseWal) return;
+			std::unique_lock<std::mutex> writeLock(writeMutex);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+			checkpointWal();
+		}
+
+		void close() {
+			waitAsync();
+
+			if (!bOpen) return;
+
+			if (bUseWal) {
+				std::unique_lock<std::mutex> writeLock(writeMutex);
+				std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+				checkpointWal();
+			}
+
+			releaseFile();
+		}
+
+		bool open(const std::string& file) {
+			// views of previous file don't pin extents of this one
+			if (file != fileName) {
+				extentPins = std::make_shared<TExtentPins>();
+			}
+
+			fileName = file;
+
+			if (!fileIO.open(file)) return false;
+
+			// damaged key tables or file beyond limits of index entry
+			if (!readIndex()) {
+				releaseFile();
+				return false;
+			}
+
+			if (bUseWal) {
+				if (!walIO.open(file + ".wal", true)) {
+					releaseFile();
+					return false;
+				}
+
+				replayWal();
+			}
+            
+			bOpen = true;
+			return true;
+		}
+
+		bool isOpen() const {
+			return bOpen;
+		}
+
+		int size() {
+			if (!bOpen) {
+				return 0;
+			} else {
+				std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+				int count = dataMap.size();
+				for (auto& it : walMap) {
+					const bool bInDataFile = dataMap.contains(it.first);
+					if (it.second.bErased && bInDataFile) count--;
+					if (!it.second.bErased && !bInDataFile) count++;
+				}
+				return count;
+			}
+		}
+
+		bool isExist(const K& k) {
+			TKeyData keyData = toKeyData(k);
+			if (!bOpen) return false;
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+			return isExistLocked(keyData);
+		}
+
+
+		// with cache enabled returned value is shared, treat it as read-only
+		TValueDataPtr loadData(const K& k) {
+			TKeyData keyData = toKeyData(k);
+
+			if (!bOpen) return nullptr;
+			TLatencyTimer timer(loadHistogram);
+
+			if (valueCache.isEnabled()) {
+				TValueDataPtr cachedPtr = valueCache.get(keyData);
+				if (cachedPtr != nullptr) return cachedPtr;
+			}
+
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(lock);
+
+			TValueDataPtr dataPtr = loadDataLocked(keyData);
+			if (dataPtr != nullptr && valueCache.isEnabled()) {
+				// under read lock, so writer can't replace value in between
+				valueCache.put(keyData, dataPtr);
+			}
+
+			return dataPtr;
+		}
+
+		// pins current state of file. replaced values are kept in place until no snapshot can read them.
+		// in write-ahead log mode values which snapshot reads from log are copied to memory on checkpoint
+		TSnapshotPtr snapshot() {
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			TSnapshot* snapshotPtr = new TSnapshot();
+			snapshotPtr->version = version;
+
+			{
+				std::unique_lock<std::mutex> snapshotLock(snapshotMutex);
+				snapshotSet.insert(version);
+			}
+
+			return TSnapshotPtr(snapshotPtr, [this](const TSnapshot* s) {
+				releaseSnapshot(s->version);
+				delete s;
+			});
+		}
+
+		// value as it was when snapshot was taken. runs concurrently with writers
+		TValueDataPtr loadData(const K& k, const TSnapshotPtr& snapshot) {
+			if (snapshot == nullptr) return loadData(k);
+
+			TKeyData keyData = toKeyData(k);
+			if (!bOpen) return nullptr;
+
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			const TRetiredVersion* retired = findRetired(keyData, snapshot->version);
+			if (retired != nullptr) {
+				return loadRetired(*retired);
+			}
+
+			// not written after snapshot. cache is write-through, so it holds the same value
+			if (valueCache.isEnabled()) {
+				TValueDataPtr cachedPtr = valueCache.get(keyData);
+				if (cachedPtr != nullptr) return cachedPtr;
+			}
+
+			return loadDataLocked(keyData);
+		}
+
+		bool isExist(const K& k, const TSnapshotPtr& snapshot) {
+			if (snapshot == nullptr) return isExist(k);
+
+			TKeyData keyData = toKeyData(k);
+			if (!bOpen) return false;
+
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			const TRetiredVersion* retired = findRetired(keyData, snapshot->version);
+			if (retired != nullptr) {
+				return retired->bExists;
+			}
+
+			return isExistLocked(keyData);
+		}
+
+		// zero-copy read in memory mapped mode. otherwise view holds loaded copy of value.
+		// cached value is served first in both modes, see prefetch.
+		// view content doesn't change while view exists: its extent is pinned, 
+		// so saves and patches of the same key write to new extent
+		TValueView loadView(const K& k) {
+			if (!bUseMemoryMapping) {
+				return TValueView(loadData(k));
+			}
+
+			TKeyData keyData = toKeyData(k);
+
+			if (!bOpen) return TValueView();
+			TLatencyTimer timer(loadHistogram);
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(lock);
+
+			if (valueCache.isEnabled()) {
+				TValueDataPtr cachedPtr = valueCache.get(keyData);
+				if (cachedPtr != nullptr) return TValueView(cachedPtr);
+			}
+
+			if (isLogged(keyData)) {
+				// not applied to data file yet
+				return TValueView(loadDataLocked(keyData));
+			}
+
+			const TIndexEntry* got = dataMap.find(keyData);
+			if (got == nullptr) {
+				return TValueView();
+			}
+
+			const TIndexEntry& e = *got;
+			TFileMappingPtr mapping = getMapping(e.dataPos, e.dataLength);
+			if (mapping == nullptr) {
+				return TValueView();
+			}
+
+			const byte* record = mapping->data() + e.dataPos;
+			if (fileVersion < KVDB_FILE_VERSION) {
+				return pinnedView(mapping, e, record, e.dataLength);
+			}
+
+			TRecordHeader recordHeader;
+			if (e.dataLength < sizeof(TRecordHeader)) return TValueView();
+			std::memcpy(&recordHeader, record, sizeof(TRecordHeader));
+
+			if (recordHeader.codec == CODEC_NONE) {
+				if (recordHeader.rawLength != e.dataLength - sizeof(TRecordHeader)) return TValueView();
+				return pinnedView(mapping, e, record + sizeof(TRecordHeader), recordHeader.rawLength);
+			}
+
+			// compressed record. view holds decoded copy
+			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+			if (!decodeRecord(record, e.dataLength, *dataPtr)) {
+				return TValueView();
+			}
+
+			if (valueCache.isEnabled()) {
+				valueCache.put(keyData, dataPtr);
+			}
+
+			return TValueView(dataPtr);
+		}
+
+		// all pairs inside index box, bounds included. result is in file order
+		// records close to each other are read at once, see PLACEMENT_MORTON
+		std::vector<std::pair<K, TValueDataPtr>> loadRange(const K& min, const K& max) {
+			std::vector<std::pair<K, TValueDataPtr>> result;
+			if (!bOpen) return result;
+
+			int32_t lo[3];
+			int32_t hi[3];
+			keyToCoords(toKeyData(min), lo);
+			keyToCoords(toKeyData(max), hi);
+			if (lo[0] > hi[0] || lo[1] > hi[1] || lo[2] > hi[2]) return result;
+
+			auto isInside = [&](const TKeyData& keyData) {
+				int32_t c[3];
+				keyToCoords(keyData, c);
+				return c[0] >= lo[0] && c[0] <= hi[0] && c[1] >= lo[1] && c[1] <= hi[1] && c[2] >= lo[2] && c[2] <= hi[2];
+			};
+
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			std::vector<TKeyEntry> entryList;
+			auto collect = [&](const TKeyData& keyData) {
+				if (isLogged(keyData)) {
+					TValueDataPtr dataPtr = loadDataLocked(keyData);
+					if (dataPtr != nullptr) result.push_back({ fromKeyData(keyData), dataPtr });
+					return;
+				}
+
+				const TIndexEntry* got = dataMap.find(keyData);
+				if (got == nullptr) return;
+
+				if (valueCache.isEnabled()) {
+					TValueDataPtr cachedPtr = valueCache.get(keyData);
+					if (cachedPtr != nullptr) {
+						result.push_back({ fromKeyData(keyData), cachedPtr });
+						return;
+					}
+				}
+
+				entryList.push_back(toKeyEntry(*got));
+			};
+
+			// small box - lookup every index, large box - scan index
+			const ulong64 volume = (ulong64)(hi[0] - lo[0] + 1) * (ulong64)(hi[1] - lo[1] + 1) * (ulong64)(hi[2] - lo[2] + 1);
+			if (volume <= dataMap.size() + walMap.size()) {
+				for (int32_t x = lo[0]; x <= hi[0]; x++) {
+					for (int32_t y = lo[1]; y <= hi[1]; y++) {
+						for (int32_t z = lo[2]; z <= hi[2]; z++) {
+							collect(coordsToKey(x, y, z));
+						}
+					}
+				}
+			} else {
+				dataMap.forEach([&](const TIndexEntry& entry) {
+					if (isInside(entry.key)) collect(entry.key);
+				});
+
+				for (const auto& it : walMap) {
+					if (!dataMap.contains(it.first) && isInside(it.first)) collect(it.first);
+				}
+			}
+
+			readEntries(entryList, [&](const TKeyData& keyData, TValueDataPtr dataPtr) {
+				if (valueCache.isEnabled()) {
+					valueCache.put(keyData, dataPtr);
+				}
+
+				result.push_back({ fromKeyData(keyData), dataPtr });
+			});
+
+			return result;
+		}
+
+		// live keys. disk order - by value position in data file, keys not yet checkpointed from log are last
+		std::vector<K> keys(bool bDiskOrder = false) {
+			std::vector<K> keyList;
+			if (!bOpen) return keyList;
+
+			std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+
+			std::vector<std::pair<ulong64, TKeyData>> posList;
+			posList.reserve(dataMap.size() + walMap.size());
+			dataMap.forEach([&](const TIndexEntry& entry) {
+				if (!bUseWal || walMap.find(entry.key) == walMap.end()) {
+					posList.push_back({ entry.dataPos, entry.key });
+				}
+			});
+
+			if (bDiskOrder) {
+				std::sort(posList.begin(), posList.end(), [](const std::pair<ulong64, TKeyData>& a, const std::pair<ulong64, TKeyData>& b) { return a.first < b.first; });
+			}
+
+			for (const auto& it : walMap) {
+				if (!it.second.bErased) posList.push_back({ 0, it.first });
+			}
+
+			keyList.reserve(posList.size());
+			for (const auto& it : posList) {
+				keyList.push_back(fromKeyData(it.second));
+			}
+
+			return keyList;
+		}
+
+		// stream values of keys to workers. workers take chunks of list in turn, 
+		// so list in disk order is read mostly sequentially. missing keys get nullptr
+		// callback runs on worker threads (calling thread is one of them) without file lock. values are not cached
+		void preload(const std::vector<K>& keyList, uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			if (!bOpen || keyList.empty()) return;
+			if (workerCount == 0) workerCount = 1;
+
+			std::atomic<size_t> nextChunk(0);
+			auto work = [&]() {
+				std::vector<std::pair<K, TValueDataPtr>> loadedList;
+				std::vector<TKeyEntry> entryList;
+
+				while (true) {
+					const size_t first = nextChunk.fetch_add(KVDB_PRELOAD_CHUNK);
+					if (first >= keyList.size()) break;
+					const size_t last = std::min(first + KVDB_PRELOAD_CHUNK, keyList.size());
+
+					loadedList.clear();
+					entryList.clear();
+
+					{
+						std::shared_lock<std::shared_mutex> lock(fileSharedMutex);
+						for (size_t i = first; i < last; i++) {
+							const TKeyData keyData = toKeyData(keyList[i]);
+							if (isLogged(keyData)) {
+								loadedList.push_back({ keyList[i], loadDataLocked(keyData) });
+								continue;
+							}
+
+							const TIndexEntry* got = dataMap.find(keyData);
+							if (got == nullptr) {
+								loadedList.push_back({ keyList[i], nullptr });
+								continue;
+							}
+
+							entryList.push_back(toKeyEntry(*got));
+						}
+
+						readEntries(entryList, [&](const TKeyData& keyData, TValueDataPtr dataPtr) {
+							loadedList.push_back({ fromKeyData(keyData), dataPtr });
+						});
+					}
+
+					for (const auto& loaded : loadedList) {
+						callback(loaded.first, loaded.second);
+					}
+				}
+			};
+
+			std::vector<std::thread> workerList;
+			for (uint32 i = 1; i < workerCount; i++) {
+				workerList.emplace_back(work);
+			}
+
+			work();
+
+			for (std::thread& worker : workerList) {
+				worker.join();
+			}
+		}
+
+		// all live pairs in disk order
+		void preload(uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			preload(keys(true), workerCount, callback);
+		}
+
+		// load on I/O thread
+		std::future<TValueDataPtr> loadAsync(const K& k) {
+			auto promise = std::make_shared<std::promise<TValueDataPtr>>();
+			std::future<TValueDataPtr> future = promise->get_future();
+			runAsync([this, k, promise] { promise->set_value(loadData(k)); });
+			return future;
+		}
+
+		// callback is invoked on I/O thread
+		void loadAsync(const K& k, std::function<void(const K&, TValueDataPtr)> callback) {
+			runAsync([this, k, callback] { callback(k, loadData(k)); });
+		}
+
+		// load value into cache on I/O thread, loadData and loadView take it from there. nothing to do without cache
+		void prefetch(const K& k) {
+			if (!valueCache.isEnabled()) return;
+			runAsync([this, k] { loadData(k); });
+		}
+
+		// saves are applied in call order. loads see the save when its future is ready
+		std::future<void> saveAsync(const K& k, const V& v) {
+			auto promise = std::make_shared<std::promise<void>>();
+			std::future<void> future = promise->get_future();
+			pushSave([this, k, v, promise] {
+				save(k, v);
+				promise->set_value();
+			});
+			return future;
+		}
+
+		std::shared_ptr<V> load(const K& k) {
+			return valueFromData(loadData(k));
+		}
+
+		std::shared_ptr<V> load(const K& k, const TSnapshotPtr& snapshot) {
+			return valueFromData(loadData(k, snapshot));
+		}
+        
+        
+        std::shared_ptr<V> operator[] (const K& k) {
+            return valueFromData(loadData(k));
+        }
+
+		void erase(const K& k) {
+			TKeyData keyData = toKeyData(k);
+
+			if (!bOpen) return;
+			TLatencyTimer timer(saveHistogram);
+
+			std::unique_lock<std::mutex> writeLock(writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(writeLock);
+			lockTimed(lock);
+
+			const bool bKeepOld = retirePair(keyData);
+			trackChange(keyData);
+			if (bUseWal) {
+				if (isExistLocked(keyData)) {
+					logRecord(WAL_ERASE, keyData, nullptr);
+				}
+			} else {
+				applyErase(keyData, bKeepOld);
+			}
+
+			version++;
+			valueCache.erase(keyData);
+		}
+
+		// false if file is closed, value is too long or file would outgrow limits of index entry,
+		// see KVDB_MAX_RECORD_LENGTH and KVDB_MAX_FILE_SIZE
+		bool save(const K& k, const V& v) {
+			TKeyData keyData = toKeyData(k);
+			TValueData valueData;
+			valueToData(v, valueData);
+
+			if (!bOpen) return false;
+			TLatencyTimer timer(saveHistogram);
+
+			// encode before lock
+			TValueData record;
+			toRecord(valueData, record);
+			if (record.size() > KVDB_MAX_RECORD_LENGTH) return false;
+
+			std::unique_lock<std::mutex> writeLock(writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(writeLock);
+			lockTimed(lock);
+
+			if (record.size() > 0 && !hasRoom(record.size(), 1)) return false;
+
+			const bool bKeepOld = retirePair(keyData);
+			trackChange(keyData);
+			if (bUseWal) {
+				// sequential append. applied to data file on checkpoint
+				logRecord(record.size() > 0 ? WAL_SAVE : WAL_ERASE, keyData, &record);
+			} else {
+				applySave(keyData, record, bKeepOld);
+			}
+
+			version++;
+			updateCache(keyData, valueData);
+			return true;
+		}
+
+		// write parts of stored value in place, length of value stays the same.
+		// all parts are one commit group in write-ahead log mode. 
+		// false if pair is missing, record is compressed or part is out of value - save whole value then
+		bool patch(const K& k, const std::vector<TPatch>& patchList) {
+			TKeyData keyData = toKeyData(k);
+			if (!bOpen) return false;
+			TLatencyTimer timer(saveHistogram);
+
+			std::unique_lock<std::mutex> writeLock(writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(writeLock);
+			lockTimed(lock);
+
+			ulong64 valueLength = 0;
+			if (!patchableLength(keyData, valueLength)) return false;
+
+			for (const TPatch& p : patchList) {
+				if (p.offset > valueLength || p.data.size() > valueLength - p.offset) return false;
+			}
+
+			const bool bKeepOld = retirePair(keyData);
+			trackChange(keyData);
+			if (bUseWal) {
+				for (const TPatch& p : patchList) {
+					if (p.data.empty()) continue;
+
+					TValueData payload(sizeof(ulong64) + p.data.size());
+					std::memcpy(payload.data(), &p.offset, sizeof(ulong64));
+					std::memcpy(payload.data() + sizeof(ulong64), p.data.data(), p.data.size());
+					appendWalRecord(WAL_PATCH, keyData, &payload);
+				}
+
+				endWalRecords();
+			} else if (bKeepOld || extentPins->isPinned(dataMap.find(keyData)->dataPos)) {
+				// snapshot or view reads old extent, so patched record goes to new one
+				TValueDataPtr recordPtr = loadRecordLocked(keyData);
+				if (recordPtr != nullptr) {
+					for (const TPatch& p : patchList) {
+						std::copy(p.data.begin(), p.data.end(), recordPtr->begin() + (recordValueOffset() + p.offset));
+					}
+
+					applySave(keyData, *recordPtr, bKeepOld);
+				}
+			} else {
+				const TIndexEntry* e = dataMap.find(keyData);
+				for (const TPatch& p : patchList) {
+					if (!p.data.empty()) {
+						fileIO.writeAt(e->dataPos + recordValueOffset() + p.offset, p.data.data(), p.data.size());
+					}
+				}
+			}
+
+			version++;
+			valueCache.erase(keyData);
+			return true;
+		}
+
+		bool patch(const K& k, ulong64 offset, const TValueData& data) {
+			TPatch p;
+			p.offset = offset;
+			p.data = data;
+			return patch(k, { p });
+		}
+
+		// rewrite live records into new file and swap it in. 
+		// reads are served during copy, writes wait. 
+		// on windows swap fails while value views of this file exist.
+		// if file can't be opened again after swap, it is left closed.
+		// values which refer to other extents (rows of column file) are compacted only while no snapshot exists.
+		// onReload runs under write lock after index of compacted file is read
+		TCompactionStats compact(std::function<void()> onReload = nullptr) {
+			TCompactionStats stats;
+			if (!bOpen) return stats;
+
+			std::unique_lock<std::mutex> writeLock(writeMutex);
+
+			// retired extents can't be carried over to new file
+			if (valueExtents && hasSnapshots()) return stats;
+
+			if (bUseWal) {
+				std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+				checkpointWal();
+			}
+
+			const std::string compactFileName = fileName + ".compact";
+			std::shared_lock<std::shared_mutex> readLock(fileSharedMutex);
+			stats.sizeBefore = endOfFile;
+			if (!writeCompacted(compactFileName, stats.records)) {
+				return stats;
+			}
+			readLock.unlock();
+
+			// writers are still blocked, so index is the same as copied
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex);
+			detachRetired();
+			fileIO.close();
+			mappingPtr = nullptr;
+
+			stats.bSuccess = replaceFile(compactFileName, fileName);
+			if (!stats.bSuccess) {
+				std::remove(compactFileName.c_str());
+			}
+
+			if (!fileIO.open(fileName)) {
+				// index of old file must not be served without file. 
+				// data is on disk either way, compacted or not, and open() loads it again
+				stats.bSuccess = false;
+				releaseFile();
+				return stats;
+			}
+
+			// views keep mapping of replaced file
+			if (stats.bSuccess) {
+				extentPins = std::make_shared<TExtentPins>();
+			}
+
+			clearIndex();
+			retiredExtentList.clear();
+			if (!readIndex()) {
+				stats.bSuccess = false;
+				releaseFile();
+				return stats;
+			}
+
+			if (onReload) onReload();
+
+			stats.sizeAfter = endOfFile;
+			stats.reclaimedBytes = (stats.sizeBefore > stats.sizeAfter) ? stats.sizeBefore - stats.sizeAfter : 0;
+			return stats;
+		}
+
+		// write pairs changed since previous backup into next file of backup chain and add it to manifest.
+		// the first backup after open is full. writes wait only while changed keys are collected,
+		// pairs are copied from snapshot, by snapshotLoader if it is set
+		TBackupStats backup(const std::string& backupFile, bool bFull = false, std::function<TValueDataPtr(const K&, const TSnapshotPtr&)> snapshotLoader = nullptr) {
+			TBackupStats stats;
+			if (!bOpen) return stats;
+
+			TBackupManifest manifest;
+			const ulong64 manifestEnd = readBackupManifest(backupFile, manifest);
+
+			TSnapshotPtr snap;
+			std::vector<K> keyList;
+			{
+				std::unique_lock<std::mutex> writeLock(writeMutex);
+				// manifest which doesn't end with our last backup (other chain, lost entry) gets full backup
+				const bool bSameChain = !manifest.empty() && backupFile == lastBackupFile && manifest.back().first.seq == lastBackupSeq;
+				stats.bFull = bFull || !bTrackChanges || !bSameChain;
+				snap = snapshot();
+
+				if (stats.bFull) {
+					keyList = keys();
+				} else {
+					keyList.reserve(changedKeySet.size());
+					for (const TKeyData& keyData : changedKeySet) keyList.push_back(fromKeyData(keyData));
+				}
+
+				changedKeySet.clear();
+				bTrackChanges = true;
+			}
+
+			stats.seq = manifest.empty() ? 1 : manifest.back().first.seq + 1;
+			const std::string stepFile = backupStepFile(backupFile, stats.seq);
+
+			std::vector<TKeyData> erasedList;
+			bool bWritten = KvFile<K, TValueData>::create(stepFile, std::unordered_map<K, TValueData>(), codecId);
+			if (bWritten) {
+				KvFile<K, TValueData> stepKv;
+				bWritten = stepKv.open(stepFile);
+
+				std::vector<std::pair<K, TValueData>> batch;
+				ulong64 batchSize = 0;
+				for (size_t i = 0; bWritten && i < keyList.size(); i++) {
+					TValueDataPtr dataPtr = snapshotLoader ? snapshotLoader(keyList[i], snap) : loadData(keyList[i], snap);
+					if (dataPtr == nullptr) {
+						erasedList.push_back(toKeyData(keyList[i]));
+						continue;
+					}
+
+					stats.pairs++;
+					stats.bytes += dataPtr->size();
+					batchSize += dataPtr->size();
+					batch.push_back({ keyList[i], *dataPtr });
+
+					if (batchSize >= KVDB_BACKUP_BATCH_SIZE) {
+						stepKv.saveBatch(batch);
+						batch.clear();
+						batchSize = 0;
+					}
+				}
+
+				stepKv.saveBatch(batch);
+				stepKv.close();
+
+				TFileIO stepIO;
+				bWritten = bWritten && stepIO.open(stepFile) && stepIO.sync();
+			}
+
+			snap = nullptr;
+
+			TBackupEntry entry;
+			entry.seq = stats.seq;
+			entry.bFull = stats.bFull ? 1 : 0;
+			entry.timestamp = (ulong64)std::time(nullptr);
+			entry.pairCount = stats.pairs;
+
+			stats.erased = erasedList.size();
+			stats.bSuccess = bWritten && appendBackupManifest(backupFile, manifestEnd, entry, erasedList);
+
+			std::unique_lock<std::mutex> writeLock(writeMutex);
+			if (stats.bSuccess) {
+				lastBackupFile = backupFile;
+				lastBackupSeq = stats.seq;
+			} else {
+				// changes of failed backup are lost, so next one is full
+				std::remove(stepFile.c_str());
+				bTrackChanges = false;
+			}
+
+			return stats;
+		}
+
+		// rebuild file as it was at backup seq: the last full backup up to seq and incremental backups after it.
+		// any backup of manifest can be restored, so file can be rolled back or forward. file must be closed
+		static bool restoreBackup(const std::string& backupFile, const std::string& file, uint32 seq = UINT_MAX) {
+			TBackupManifest manifest;
+			readBackupManifest(backupFile, manifest);
+
+			size_t first = manifest.size();
+			size_t last = manifest.size();
+			for (size_t i = 0; i < manifest.size() && manifest[i].first.seq <= seq; i++) {
+				if (manifest[i].first.bFull) first = i;
+				last = i;
+			}
+
+			if (first == manifest.size()) return false;
+
+			const std::string restoreFile = file + ".restore";
+			KvFile<K, TValueData> target;
+			bool bSuccess = true;
+
+			for (size_t i = first; bSuccess && i <= last; i++) {
+				KvFile<K, TValueData> stepKv;
+				if (!stepKv.open(backupStepFile(backupFile, manifest[i].first.seq))) {
+					bSuccess = false;
+					break;
+				}
+
+				if (i == first) {
+					bSuccess = KvFile<K, TValueData>::create(restoreFile, std::unordered_map<K, TValueData>(), stepKv.getCodec()) && target.open(restoreFile);
+					if (!bSuccess) break;
+				}
+
+				std::vector<std::pair<K, TValueData>> batch;
+				ulong64 batchSize = 0;
+				stepKv.preload(1, [&](const K& k, TValueDataPtr dataPtr) {
+					if (dataPtr == nullptr) return;
+
+					batchSize += dataPtr->size();
+					batch.push_back({ k, *dataPtr });
+					if (batchSize >= KVDB_BACKUP_BATCH_SIZE) {
+						target.saveBatch(batch);
+						batch.clear();
+						batchSize = 0;
+					}
+				});
+
+				// empty value erases pair
+				for (const TKeyData& keyData : manifest[i].second) {
+					batch.push_back({ fromKeyData(keyData), TValueData() });
+				}
+
+				target.saveBatch(batch);
+			}
+
+			target.close();
+
+			if (bSuccess) {
+				// log of replaced file must not be replayed over restored data
+				std::remove((file + ".wal").c_str());
+				bSuccess = replaceFile(restoreFile, file);
+			}
+
+			if (!bSuccess) {
+				std::remove(restoreFile.c_str());
+			}
+
+			return bSuccess;
+		}
+
+		// save many pairs at once: one lock, one contiguous append and one pass over key tables
+		// in write-ahead log mode whole batch is one commit group.
+		// false if some values are too long, they are skipped, or whole batch would outgrow limits of index entry
+		bool saveBatch(const std::vector<std::pair<K, V>>& batch) {
+			if (!bOpen) return false;
+			if (batch.empty()) return true;
+			TLatencyTimer timer(saveHistogram);
+
+			// encode before lock
+			std::vector<TValueData> recordList(batch.size());
+			for (size_t i = 0; i < batch.size(); i++) {
+				TValueData valueData;
+				valueToData(batch[i].second, valueData);
+				toRecord(valueData, recordList[i]);
+			}
+
+			// the last write of the same key wins, so order is stable
+			std::vector<size_t> order;
+			order.reserve(batch.size());
+			for (size_t i = 0; i < batch.size(); i++) {
+				if (recordList[i].size() <= KVDB_MAX_RECORD_LENGTH) order.push_back(i);
+			}
+
+			const bool bAllSaved = order.size() == batch.size();
+			if (placement == PLACEMENT_MORTON) {
+				std::vector<ulong64> codeList(batch.size());
+				for (size_t i = 0; i < batch.size(); i++) codeList[i] = mortonCode(toKeyData(batch[i].first));
+				std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return codeList[a] < codeList[b]; });
+			}
+
+			std::unique_lock<std::mutex> writeLock(writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(fileSharedMutex, std::defer_lock);
+			lockTimed(writeLock);
+			lockTimed(lock);
+
+			ulong64 appendLength = 0;
+			for (size_t i : order) appendLength += recordList[i].size();
+			if (!hasRoom(appendLength, order.size())) return false;
+
+			beginBatchWrite();
+			for (size_t i : order) {
+				TKeyData keyData = toKeyData(batch[i].first);
+				writeRecordLocked(keyData, recordList[i]);
+
+				if (valueCache.isEnabled()) {
+					TValueData valueData;
+					valueToData(batch[i].second, valueData);
+					updateCache(keyData, valueData);
+				}
+			}
+
+			endBatchLocked(false);
+			return bAllSaved;
+		}
+
+		static bool create(const std::string& file, const std::unordered_map<K, V>& test, uint32 codec = CODEC_NONE) {
+			std::ofstream outFile(file, std::ios::out | std::ios::binary);
+
+			if (!outFile) return false;
+
+			std::ofstream* outFilePtr = &outFile;
+
+			static const ulong64 max_key_records = KVDB_RESERVED_TABLE_SIZE;
+			const ulong64 keyRecords = (test.size() > max_key_records) ? test.size() : max_key_records;
+
+			// save file header
+			TFileHeader fileHeader;
+			fileHeader.keySize = KVDB_KEY_SIZE;
+			fileHeader.endOfHeaderOffset = sizeof(fileHeader);
+			fileHeader.codec = codec;
+
+			outFilePtr << fileHeader;
+
+			TTableHeader tableHeader;
+			tableHeader.recordCount = keyRecords;
+			outFilePtr << tableHeader;
+
+			ulong64 bodyDataOffset = (ulong64)(outFile.tellp()) + sizeof(TKeyEntry) * keyRecords;
+
+			std::vector<byte> dataBody;
+
+			for (auto& e : test) {
+				TKeyEntry entry;
+				entry.freeKeyData = toKeyData(e.first);
+				entry.dataPos = dataBody.size() + bodyDataOffset;
+
+				TValueData rawData;
+				if constexpr (std::is_same_v<V, TValueData>) {
+					rawData = std::move((TValueData)e.second);
+				} else {
+					toValueData(e.second, rawData);
+				}
+
+				TValueData valueData;
+				encodeRecord(codec, rawData, valueData);
+
+				entry.dataLength = valueData.size();
+				entry.initialDataLength = valueData.size();
+				dataBody.insert(std::end(dataBody), std::begin(valueData), std::end(valueData));
+
+				outFilePtr << entry;
+			}
+
+			if (test.size() < max_key_records) {
+				// add empty records
+				const ulong64 emptyRecords = max_key_records - test.size();
+				for (ulong64 i = 0; i < emptyRecords; i++) {
+					TKeyEntry entry;
+					outFilePtr << entry;
+				}
+			}
+
+			outFilePtr->write((char*)dataBody.data(), dataBody.size());
+			outFile.close();
+
+			return true;
+		}
+	};
+
+	//============================================================================
+	// Column file
+	//============================================================================
+
+	#define KVDB_MAX_COLUMNS 8
+
+	// packed row: uint32 column count, column slots, encoded column values. format of backups of column file
+	typedef struct TColumnSlot {
+		uint32 offset = 0;
+		uint32 length = 0;
+	} TColumnSlot;
+
+	inline uint32 readColumnCount(const byte* row, ulong64 rowLength) {
+		uint32 columnCount = 0;
+		if (rowLength < sizeof(uint32)) return 0;
+		std::memcpy(&columnCount, row, sizeof(uint32));
+		return (columnCount < KVDB_MAX_COLUMNS) ? columnCount : KVDB_MAX_COLUMNS;
+	}
+
+	inline bool readColumnSlot(const byte* row, ulong64 rowLength, uint32 column, TColumnSlot& slot) {
+		if (column >= readColumnCount(row, rowLength)) return false;
+
+		const ulong64 slotPos = sizeof(uint32) + column * sizeof(TColumnSlot);
+		if (slotPos + sizeof(TColumnSlot) > rowLength) return false;
+
+		std::memcpy(&slot, row + slotPos, sizeof(TColumnSlot));
+		return slot.length > 0 && (ulong64)slot.offset + slot.length <= rowLength;
+	}
+
+	// encoded column values to packed row. empty record - no value
+	inline void packRow(const std::array<TValueData, KVDB_MAX_COLUMNS>& recordList, TValueData& row) {
+		uint32 columnCount = KVDB_MAX_COLUMNS;
+		while (columnCount > 0 && recordList[columnCount - 1].empty()) columnCount--;
+
+		row.clear();
+		if (columnCount == 0) return;
+
+		ulong64 rowLength = sizeof(uint32) + columnCount * sizeof(TColumnSlot);
+		for (uint32 c = 0; c < columnCount; c++) rowLength += recordList[c].size();
+		row.resize(rowLength);
+
+		std::memcpy(row.data(), &columnCount, sizeof(uint32));
+		uint32 offset = sizeof(uint32) + columnCount * sizeof(TColumnSlot);
+		for (uint32 c = 0; c < columnCount; c++) {
+			TColumnSlot slot;
+			if (!recordList[c].empty()) {
+				slot.offset = offset;
+				slot.length = (uint32)recordList[c].size();
+				std::memcpy(row.data() + offset, recordList[c].data(), slot.length);
+				offset += slot.length;
+			}
+
+			std::memcpy(row.data() + sizeof(uint32) + c * sizeof(TColumnSlot), &slot, sizeof(TColumnSlot));
+		}
+	}
+
+	// row index: uint32 column count with KVDB_ROW_EXTENTS flag, then extent of encoded value of each column.
+	// column values are extents of the same file, so column is written, patched and read without other ones
+	#define KVDB_ROW_EXTENTS 0x80000000
+
+	typedef struct TColumnExtent {
+		ulong64 pos = 0;
+		ulong64 length = 0; // zero - no value
+	} TColumnExtent;
+
+	typedef std::array<TColumnExtent, KVDB_MAX_COLUMNS> TColumnExtents;
+
+	// false if row is packed or damaged
+	inline bool readRowExtents(const byte* row, ulong64 rowLength, TColumnExtents& extents) {
+		uint32 header = 0;
+		extents = {};
+		if (rowLength < sizeof(uint32)) return false;
+		std::memcpy(&header, row, sizeof(uint32));
+		if ((header & KVDB_ROW_EXTENTS) == 0) return false;
+
+		const uint32 columnCount = header & ~KVDB_ROW_EXTENTS;
+		if (columnCount > KVDB_MAX_COLUMNS || sizeof(uint32) + columnCount * sizeof(TColumnExtent) > rowLength) return false;
+
+		std::memcpy(extents.data(), row + sizeof(uint32), columnCount * sizeof(TColumnExtent));
+		return true;
+	}
+
+	// empty row means no columns left
+	inline void writeRowExtents(const TColumnExtents& extents, TValueData& row) {
+		uint32 columnCount = KVDB_MAX_COLUMNS;
+		while (columnCount > 0 && extents[columnCount - 1].length == 0) columnCount--;
+
+		row.clear();
+		if (columnCount == 0) return;
+
+		const uint32 header = columnCount | KVDB_ROW_EXTENTS;
+		row.resize(sizeof(uint32) + columnCount * sizeof(TColumnExtent));
+		std::memcpy(row.data(), &header, sizeof(uint32));
+		std::memcpy(row.data() + sizeof(uint32), extents.data(), columnCount * sizeof(TColumnExtent));
+	}
+
+	// several kinds of values under one key. one file, one key index
+	// each column value is encoded separately and stored in its own extent, row of key is an index of these extents.
+	// extents of all rows are kept in memory, so columns are read without reading rows
+	template <typename K>
+	class KvColumnFile {
+
+	private:
+		typedef struct TColumnRecord {
+			TKeyData keyData = {};
+			uint32 column = 0;
+			TValueData record; // encoded, empty - erase
+		} TColumnRecord;
+
+		KvFile<K, TValueData> rowFile;
+		std::unordered_map<TKeyData, TColumnExtents> extentMap; // rows of file, guarded by file lock of row file
+		std::array<uint32, KVDB_MAX_COLUMNS> codecList = {};
+		std::array<TValueCache, KVDB_MAX_COLUMNS> cacheList;
+
+		static TKeyData toKeyData(const K& k) {
+			return KvFile<K, TValueData>::toKeyData(k);
+		}
+
+		// column extents of row for compaction and free space of row file
+		static void visitRowExtents(byte* row, ulong64 rowLength, const std::function<ulong64(ulong64, ulong64)>& visit) {
+			TColumnExtents extents;
+			if (!readRowExtents(row, rowLength, extents)) return;
+
+			for (uint32 c = 0; c < KVDB_MAX_COLUMNS; c++) {
+				TColumnExtent& extent = extents[c];
+				if (extent.length == 0) continue;
+
+				extent.pos = visit(extent.pos, extent.length);
+				std::memcpy(row + sizeof(uint32) + c * sizeof(TColumnExtent), &extent, sizeof(TColumnExtent));
+			}
+		}
+
+		// under file lock
+		bool findExtent(const TKeyData& keyData, uint32 column, TColumnExtent& extent) const {
+			if (column >= KVDB_MAX_COLUMNS) return false;
+
+			auto got = extentMap.find(keyData);
+			if (got == extentMap.end() || got->second[column].length == 0) return false;
+
+			extent = got->second[column];
+			return true;
+		}
+
+		// rows of index of row file, under write lock. returns keys of packed rows
+		std::vector<TKeyData> loadExtentsLocked() {
+			extentMap.clear();
+			std::vector<TKeyData> packedList;
+
+			auto add = [&](const TKeyData& keyData) {
+				TValueDataPtr rowPtr = rowFile.loadDataLocked(keyData);
+				if (rowPtr == nullptr) return;
+
+				TColumnExtents extents;
+				if (readRowExtents(rowPtr->data(), rowPtr->size(), extents)) {
+					extentMap[keyData] = extents;
+				} else {
+					packedList.push_back(keyData);
+				}
+			};
+
+			rowFile.dataMap.forEach([&](const TIndexEntry& e) { add(e.key); });
+			for (const auto& it : rowFile.walMap) {
+				if (!rowFile.dataMap.contains(it.first)) add(it.first);
+			}
+
+			return packedList;
+		}
+
+		// packed rows of restored backup get extent of each column
+		void unpackRowsLocked(const std::vector<TKeyData>& packedList) {
+			std::vector<TColumnRecord> recordList;
+			ulong64 batchSize = 0;
+
+			for (const TKeyData& keyData : packedList) {
+				TValueDataPtr rowPtr = rowFile.loadDataLocked(keyData);
+				if (rowPtr == nullptr) continue;
+
+				for (uint32 c = 0; c < KVDB_MAX_COLUMNS; c++) {
+					TColumnSlot slot;
+					if (!readColumnSlot(rowPtr->data(), rowPtr->size(), c, slot)) continue;
+
+					TColumnRecord columnRecord;
+					columnRecord.keyData = keyData;
+					columnRecord.column = c;
+					columnRecord.record.assign(rowPtr->data() + slot.offset, rowPtr->data() + slot.offset + slot.length);
+					batchSize += slot.length;
+					recordList.push_back(std::move(columnRecord));
+				}
+
+				if (batchSize >= KVDB_BACKUP_BATCH_SIZE) {
+					writeColumnsLocked(recordList);
+					recordList.clear();
+					batchSize = 0;
+				}
+			}
+
+			if (!recordList.empty()) {
+				writeColumnsLocked(recordList);
+			}
+		}
+
+		// one version of row file under its write lock. 
+		// new column values go to new extents, old ones are retired, then changed rows are saved
+		bool writeColumnsLocked(const std::vector<TColumnRecord>& recordList) {
+			ulong64 appendLength = 0;
+			for (const TColumnRecord& columnRecord : recordList) {
+				appendLength += columnRecord.record.size() + sizeof(TRecordHeader) + sizeof(uint32) + KVDB_MAX_COLUMNS * sizeof(TColumnExtent);
+			}
+
+			if (!rowFile.hasRoom(appendLength, recordList.size())) return false;
+
+			// the last write of the same column wins, row is saved once
+			std::unordered_map<TKeyData, TColumnExtents> changedMap;
+			std::vector<TKeyData> changedList;
+			bool bExtentsWritten = false;
+
+			rowFile.beginBatchWrite();
+			for (const TColumnRecord& columnRecord : recordList) {
+				auto got = changedMap.find(columnRecord.keyData);
+				if (got == changedMap.end()) {
+					auto current = extentMap.find(columnRecord.keyData);
+					got = changedMap.insert({ columnRecord.keyData, (current != extentMap.end()) ? current->second : TColumnExtents() }).first;
+					changedList.push_back(columnRecord.keyData);
+				}
+
+				TColumnExtent& extent = got->second[columnRecord.column];
+				if (extent.length > 0) {
+					rowFile.retireExtent(extent.pos, extent.length);
+				}
+
+				extent = TColumnExtent();
+				if (!columnRecord.record.empty()) {
+					extent.pos = rowFile.allocateValue(columnRecord.record);
+					extent.length = columnRecord.record.size();
+					bExtentsWritten = true;
+				}
+
+				cacheList[columnRecord.column].erase(columnRecord.keyData);
+			}
+
+			for (const TKeyData& keyData : changedList) {
+				const TColumnExtents& extents = changedMap[keyData];
+				TValueData row;
+				TValueData rowRecord;
+				writeRowExtents(extents, row);
+				if (!row.empty()) {
+					rowFile.toRecord(row, rowRecord);
+					extentMap[keyData] = extents;
+				} else if (extentMap.erase(keyData) == 0) {
+					// erase of missing row
+					continue;
+				}
+
+				rowFile.writeRecordLocked(keyData, rowRecord);
+			}
+
+			rowFile.endBatchLocked(bExtentsWritten);
+			return true;
+		}
+
+		bool writeColumns(const std::vector<TColumnRecord>& recordList) {
+			if (!rowFile.isOpen()) return false;
+			TLatencyTimer timer(rowFile.saveHistogram);
+
+			std::unique_lock<std::mutex> writeLock(rowFile.writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(rowFile.fileSharedMutex, std::defer_lock);
+			rowFile.lockTimed(writeLock);
+			rowFile.lockTimed(lock);
+
+			return writeColumnsLocked(recordList);
+		}
+
+		// encoded value of column, under file lock or while snapshot keeps extent
+		TValueDataPtr readRecord(const TColumnExtent& extent) const {
+			TValueDataPtr recordPtr = TValueDataPtr(new TValueData(extent.length));
+			if (!rowFile.fileIO.readAt(extent.pos, recordPtr->data(), extent.length)) return nullptr;
+			return recordPtr;
+		}
+
+		// stream values of column to workers, see KvFile::preload
+		template <typename F>
+		void readColumn(std::vector<TKeyEntry>& entryList, F func) {
+			rowFile.readEntries(entryList, func);
+		}
+
+		static TKeyEntry toKeyEntry(const TKeyData& keyData, const TColumnExtent& extent) {
+			TKeyEntry entry;
+			entry.dataPos = extent.pos;
+			entry.dataLength = extent.length;
+			entry.initialDataLength = extent.length;
+			entry.freeKeyData = keyData;
+			return entry;
+		}
+
+		// row at snapshot as packed row with all columns, for backup
+		TValueDataPtr loadPacked(const K& k, const TSnapshotPtr& snapshot) {
+			TValueDataPtr rowPtr = rowFile.loadData(k, snapshot);
+			if (rowPtr == nullptr) return nullptr;
+
+			TColumnExtents extents;
+			if (!readRowExtents(rowPtr->data(), rowPtr->size(), extents)) return rowPtr;
+
+			std::array<TValueData, KVDB_MAX_COLUMNS> recordList;
+			for (uint32 c = 0; c < KVDB_MAX_COLUMNS; c++) {
+				if (extents[c].length == 0) continue;
+
+				TValueDataPtr recordPtr = readRecord(extents[c]);
+				if (recordPtr == nullptr) return nullptr;
+				recordList[c] = std::move(*recordPtr);
+			}
+
+			TValueDataPtr packedPtr = TValueDataPtr(new TValueData);
+			packRow(recordList, *packedPtr);
+			return packedPtr;
+		}
+
+	public:
+		KvColumnFile() {
+			rowFile.valueExtents = visitRowExtents;
+		}
+
+		void setColumnCodec(uint32 column, uint32 codec) {
+			if (column < KVDB_MAX_COLUMNS) codecList[column] = codec;
+		}
+
+		void setMemoryMapping(bool val) {
+			rowFile.setMemoryMapping(val);
+		}
+
+		void setWriteAheadLog(bool val, TDurability durabilityLevel = DURABILITY_GROUP, uint32 groupSize = KVDB_WAL_GROUP_COMMIT_SIZE) {
+			rowFile.setWriteAheadLog(val, durabilityLevel, groupSize);
+		}
+
+		// cache of decoded values, budget of each column
+		void setCacheSize(ulong64 bytes) {
+			for (TValueCache& cache : cacheList) cache.setCapacity(bytes);
+		}
+
+		void setPlacement(TPlacement val) {
+			rowFile.setPlacement(val);
+		}
+
+		void setIoThreadPool(TIoThreadPoolPtr pool) {
+			rowFile.setIoThreadPool(pool);
+		}
+
+		// packed rows (restored backup) are split to column extents here
+		bool open(const std::string& file) {
+			rowFile.setCodec(CODEC_NONE);
+			if (!rowFile.open(file)) return false;
+
+			std::unique_lock<std::mutex> writeLock(rowFile.writeMutex);
+			std::unique_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+			unpackRowsLocked(loadExtentsLocked());
+			return true;
+		}
+
+		void close() {
+			rowFile.close();
+
+			std::unique_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+			extentMap.clear();
+			for (TValueCache& cache : cacheList) cache.clear();
+		}
+
+		void commit() {
+			rowFile.commit();
+		}
+
+		void checkpoint() {
+			rowFile.checkpoint();
+		}
+
+		// fails while snapshot exists
+		TCompactionStats compact() {
+			TCompactionStats stats = rowFile.compact([this] {
+				loadExtentsLocked();
+			});
+
+			if (!rowFile.isOpen()) {
+				std::unique_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+				extentMap.clear();
+				for (TValueCache& cache : cacheList) cache.clear();
+			}
+
+			return stats;
+		}
+
+		// one backup for all columns. backup has packed rows
+		TBackupStats backup(const std::string& backupFile, bool bFull = false) {
+			return rowFile.backup(backupFile, bFull, [this](const K& k, const TSnapshotPtr& snapshot) {
+				return loadPacked(k, snapshot);
+			});
+		}
+
+		// restored file has packed rows, they are split on first open
+		static bool restoreBackup(const std::string& backupFile, const std::string& file, uint32 seq = UINT_MAX) {
+			return KvFile<K, TValueData>::restoreBackup(backupFile, file, seq);
+		}
+
+		TCacheStats getCacheStats() const {
+			TCacheStats result;
+			for (const TValueCache& cache : cacheList) addCache(result, cache.getStats());
+			return result;
+		}
+
+		// live bytes include column extents
+		TFileStats getStats() {
+			TFileStats stats = rowFile.getStats();
+			stats.cache = getCacheStats();
+
+			std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+			for (const auto& it : extentMap) {
+				for (const TColumnExtent& extent : it.second) stats.liveBytes += extent.length;
+			}
+
+			return stats;
+		}
+
+		void resetStats() {
+			rowFile.resetStats();
+		}
+
+		// rows with any column
+		int size() {
+			return rowFile.size();
+		}
+
+		bool isExist(const K& k, uint32 column) {
+			std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+			TColumnExtent extent;
+			return findExtent(toKeyData(k), column, extent);
+		}
+
+		// zero-copy read of uncompressed column in memory mapped mode, see KvFile::loadView
+		TValueView loadView(const K& k, uint32 column) {
+			if (!rowFile.bUseMemoryMapping) {
+				return TValueView(loadData(k, column));
+			}
+
+			const TKeyData keyData = toKeyData(k);
+			if (column >= KVDB_MAX_COLUMNS || !rowFile.isOpen()) return TValueView();
+			TLatencyTimer timer(rowFile.loadHistogram);
+			std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex, std::defer_lock);
+			rowFile.lockTimed(lock);
+
+			TValueCache& cache = cacheList[column];
+			if (cache.isEnabled()) {
+				TValueDataPtr cachedPtr = cache.get(keyData);
+				if (cachedPtr != nullptr) return TValueView(cachedPtr);
+			}
+
+			TColumnExtent extent;
+			if (!findExtent(keyData, column, extent) || extent.length < sizeof(TRecordHeader)) return TValueView();
+
+			TFileMappingPtr mapping = rowFile.getMapping(extent.pos, extent.length);
+			if (mapping == nullptr) return TValueView();
+
+			const byte* record = mapping->data() + extent.pos;
+			TRecordHeader recordHeader;
+			std::memcpy(&recordHeader, record, sizeof(TRecordHeader));
+
+			if (recordHeader.codec == CODEC_NONE) {
+				if (recordHeader.rawLength != extent.length - sizeof(TRecordHeader)) return TValueView();
+				return rowFile.pinnedView(mapping, extent.pos, extent.length, record + sizeof(TRecordHeader), recordHeader.rawLength);
+			}
+
+			// compressed value. view holds decoded copy
+			TValueDataPtr dataPtr = TValueDataPtr(new TValueData);
+			if (!decodeRecord(record, extent.length, *dataPtr)) return TValueView();
+			if (cache.isEnabled()) cache.put(keyData, dataPtr);
+
+			return TValueView(dataPtr);
+		}
+
+		TValueDataPtr loadData(const K& k, uint32 column) {
+			const TKeyData keyData = toKeyData(k);
+			if (column >= KVDB_MAX_COLUMNS || !rowFile.isOpen()) return nullptr;
+			TLatencyTimer timer(rowFile.loadHistogram);
+
+			TValueCache& cache = cacheList[column];
+			if (cache.isEnabled()) {
+				TValueDataPtr cachedPtr = cache.get(keyData);
+				if (cachedPtr != nullptr) return cachedPtr;
+			}
+
+			std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex, std::defer_lock);
+			rowFile.lockTimed(lock);
+
+			TColumnExtent extent;
+			if (!findExtent(keyData, column, extent)) return nullptr;
+
+			TValueDataPtr dataPtr = rowFile.fromRecord(readRecord(extent));
+			if (dataPtr != nullptr && cache.isEnabled()) {
+				// under read lock, so writer can't replace value in between
+				cache.put(keyData, dataPtr);
+			}
+
+			return dataPtr;
+		}
+
+		// one snapshot for all columns
+		TSnapshotPtr snapshot() {
+			return rowFile.snapshot();
+		}
+
+		// rows with value in column, from index
+		std::vector<K> keys(uint32 column, bool bDiskOrder = false) {
+			std::vector<std::pair<ulong64, TKeyData>> posList;
+			{
+				std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+				if (column >= KVDB_MAX_COLUMNS) return std::vector<K>();
+
+				for (const auto& it : extentMap) {
+					const TColumnExtent& extent = it.second[column];
+					if (extent.length > 0) posList.push_back({ extent.pos, it.first });
+				}
+			}
+
+			if (bDiskOrder) {
+				std::sort(posList.begin(), posList.end(), [](const std::pair<ulong64, TKeyData>& a, const std::pair<ulong64, TKeyData>& b) { return a.first < b.first; });
+			}
+
+			std::vector<K> keyList;
+			keyList.reserve(posList.size());
+			for (const auto& it : posList) {
+				keyList.push_back(KvFile<K, TValueData>::fromKeyData(it.second));
+			}
+
+			return keyList;
+		}
+
+		// see KvFile::preload
+		void preload(const std::vector<K>& keyList, uint32 column, uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			if (!rowFile.isOpen() || keyList.empty()) return;
+			if (workerCount == 0) workerCount = 1;
+
+			std::atomic<size_t> nextChunk(0);
+			auto work = [&]() {
+				std::vector<std::pair<K, TValueDataPtr>> loadedList;
+				std::vector<TKeyEntry> entryList;
+
+				while (true) {
+					const size_t first = nextChunk.fetch_add(KVDB_PRELOAD_CHUNK);
+					if (first >= keyList.size()) break;
+					const size_t last = std::min(first + KVDB_PRELOAD_CHUNK, keyList.size());
+
+					loadedList.clear();
+					entryList.clear();
+
+					{
+						std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+						for (size_t i = first; i < last; i++) {
+							const TKeyData keyData = toKeyData(keyList[i]);
+							TColumnExtent extent;
+							if (findExtent(keyData, column, extent)) {
+								entryList.push_back(toKeyEntry(keyData, extent));
+							} else {
+								loadedList.push_back({ keyList[i], nullptr });
+							}
+						}
+
+						readColumn(entryList, [&](const TKeyData& keyData, TValueDataPtr dataPtr) {
+							loadedList.push_back({ KvFile<K, TValueData>::fromKeyData(keyData), dataPtr });
+						});
+					}
+
+					for (const auto& loaded : loadedList) {
+						callback(loaded.first, loaded.second);
+					}
+				}
+			};
+
+			std::vector<std::thread> workerList;
+			for (uint32 i = 1; i < workerCount; i++) {
+				workerList.emplace_back(work);
+			}
+
+			work();
+
+			for (std::thread& worker : workerList) {
+				worker.join();
+			}
+		}
+
+		// snapshot keeps extents which its rows refer to
+		TValueDataPtr loadData(const K& k, uint32 column, const TSnapshotPtr& snapshot) {
+			if (column >= KVDB_MAX_COLUMNS) return nullptr;
+
+			TValueDataPtr rowPtr = rowFile.loadData(k, snapshot);
+			if (rowPtr == nullptr) return nullptr;
+
+			TColumnExtents extents;
+			if (!readRowExtents(rowPtr->data(), rowPtr->size(), extents) || extents[column].length == 0) return nullptr;
+			return rowFile.fromRecord(readRecord(extents[column]));
+		}
+
+		bool isExist(const K& k, uint32 column, const TSnapshotPtr& snapshot) {
+			return loadData(k, column, snapshot) != nullptr;
+		}
+
+		// values of column inside index box, bounds included. result is in file order, see KvFile::loadRange
+		std::vector<std::pair<K, TValueDataPtr>> loadRange(const K& min, const K& max, uint32 column) {
+			std::vector<std::pair<K, TValueDataPtr>> result;
+			if (!rowFile.isOpen() || column >= KVDB_MAX_COLUMNS) return result;
+
+			int32_t lo[3];
+			int32_t hi[3];
+			keyToCoords(toKeyData(min), lo);
+			keyToCoords(toKeyData(max), hi);
+			if (lo[0] > hi[0] || lo[1] > hi[1] || lo[2] > hi[2]) return result;
+
+			std::shared_lock<std::shared_mutex> lock(rowFile.fileSharedMutex);
+
+			std::vector<TKeyEntry> entryList;
+			auto collect = [&](const TKeyData& keyData) {
+				TColumnExtent extent;
+				if (findExtent(keyData, column, extent)) entryList.push_back(toKeyEntry(keyData, extent));
+			};
+
+			// small box - lookup every index, large box - scan index
+			const ulong64 volume = (ulong64)(hi[0] - lo[0] + 1) * (ulong64)(hi[1] - lo[1] + 1) * (ulong64)(hi[2] - lo[2] + 1);
+			if (volume <= extentMap.size()) {
+				for (int32_t x = lo[0]; x <= hi[0]; x++) {
+					for (int32_t y = lo[1]; y <= hi[1]; y++) {
+						for (int32_t z = lo[2]; z <= hi[2]; z++) {
+							collect(coordsToKey(x, y, z));
+						}
+					}
+				}
+			} else {
+				for (const auto& it : extentMap) {
+					int32_t c[3];
+					keyToCoords(it.first, c);
+					if (c[0] >= lo[0] && c[0] <= hi[0] && c[1] >= lo[1] && c[1] <= hi[1] && c[2] >= lo[2] && c[2] <= hi[2]) collect(it.first);
+				}
+			}
+
+			TValueCache& cache = cacheList[column];
+			readColumn(entryList, [&](const TKeyData& keyData, TValueDataPtr dataPtr) {
+				if (cache.isEnabled()) {
+					cache.put(keyData, dataPtr);
+				}
+
+				result.push_back({ KvFile<K, TValueData>::fromKeyData(keyData), dataPtr });
+			});
+
+			return result;
+		}
+
+		std::future<TValueDataPtr> loadAsync(const K& k, uint32 column) {
+			auto promise = std::make_shared<std::promise<TValueDataPtr>>();
+			std::future<TValueDataPtr> future = promise->get_future();
+			rowFile.runAsync([this, k, column, promise] { promise->set_value(loadData(k, column)); });
+			return future;
+		}
+
+		// see KvFile::prefetch. owner of this file is kept until value is loaded
+		void prefetch(const K& k, uint32 column, std::shared_ptr<void> owner = nullptr) {
+			if (column >= KVDB_MAX_COLUMNS || !cacheList[column].isEnabled()) return;
+			rowFile.runAsync([this, k, column, owner] { loadData(k, column); });
+		}
+
+		bool save(const K& k, uint32 column, const TValueData& v) {
+			return saveBatch({ { k, v } }, column);
+		}
+
+		void erase(const K& k, uint32 column) {
+			saveBatch({ { k, TValueData() } }, column);
+		}
+
+		// only values of this column are written, other columns of the same keys are kept as is
+		bool saveBatch(const std::vector<std::pair<K, TValueData>>& batch, uint32 column) {
+			if (column >= KVDB_MAX_COLUMNS) return false;
+			if (batch.empty()) return true;
+
+			// encode before lock
+			std::vector<TColumnRecord> recordList(batch.size());
+			for (size_t i = 0; i < batch.size(); i++) {
+				recordList[i].keyData = toKeyData(batch[i].first);
+				recordList[i].column = column;
+				if (!batch[i].second.empty()) {
+					encodeRecord(codecList[column], batch[i].second, recordList[i].record);
+				}
+			}
+
+			return writeColumns(recordList);
+		}
+
+		// parts of uncompressed column value, see KvFile::patch. written in place unless snapshot or view reads value
+		// or write-ahead log is used, then patched copy goes to new extent, so crash never leaves half patched value
+		bool patch(const K& k, uint32 column, const std::vector<TPatch>& patchList) {
+			const TKeyData keyData = toKeyData(k);
+			if (!rowFile.isOpen()) return false;
+			TLatencyTimer timer(rowFile.saveHistogram);
+
+			std::unique_lock<std::mutex> writeLock(rowFile.writeMutex, std::defer_lock);
+			std::unique_lock<std::shared_mutex> lock(rowFile.fileSharedMutex, std::defer_lock);
+			rowFile.lockTimed(writeLock);
+			rowFile.lockTimed(lock);
+
+			TColumnExtent extent;
+			TRecordHeader recordHeader;
+			if (!findExtent(keyData, column, extent) || extent.length < sizeof(TRecordHeader)) return false;
+			if (!rowFile.fileIO.readObj(extent.pos, recordHeader)) return false;
+			if (recordHeader.codec != CODEC_NONE || recordHeader.rawLength != extent.length - sizeof(TRecordHeader)) return false;
+
+			for (const TPatch& p : patchList) {
+				if (p.offset > recordHeader.rawLength || p.data.size() > recordHeader.rawLength - p.offset) return false;
+			}
+
+			cacheList[column].erase(keyData);
+
+			if (!rowFile.bUseWal && !rowFile.hasSnapshots() && !rowFile.extentPins->isPinned(extent.pos)) {
+				for (const TPatch& p : patchList) {
+					if (!p.data.empty()) {
+						rowFile.fileIO.writeAt(extent.pos + sizeof(TRecordHeader) + p.offset, p.data.data(), p.data.size());
+					}
+				}
+
+				rowFile.trackChange(keyData);
+				rowFile.version++;
+				return true;
+			}
+
+			TColumnRecord columnRecord;
+			columnRecord.keyData = keyData;
+			columnRecord.column = column;
+			columnRecord.record.resize(extent.length);
+			if (!rowFile.fileIO.readAt(extent.pos, columnRecord.record.data(), extent.length)) return false;
+
+			for (const TPatch& p : patchList) {
+				std::copy(p.data.begin(), p.data.end(), columnRecord.record.begin() + (sizeof(TRecordHeader) + p.offset));
+			}
+
+			return writeColumnsLocked({ columnRecord });
+		}
+	};
+
+	//============================================================================
+	// Region files
+	//============================================================================
+
+	#define KVDB_REGION_LIST_MAGIC 0x4E474552
+	#define KVDB_REGION_LIST_VERSION 1
+	#define KVDB_REGION_LIST_FILE "regions.lst"
+	#define KVDB_REGION_MAX_OPEN 64
+
+	// region list: header, then coordinates of each created region
+	typedef struct TRegionListHeader {
+		uint32 magic = KVDB_REGION_LIST_MAGIC;
+		uint32 version = KVDB_REGION_LIST_VERSION;
+		int32_t regionSize = 0;
+		uint32 reserved = 0;
+	} TRegionListHeader;
+
+	// floor division, region of negative key is below zero too
+	inline int32_t regionCoord(int32_t keyCoord, int32_t regionSize) {
+		return (keyCoord >= 0) ? keyCoord / regionSize : -((-(keyCoord + 1)) / regionSize) - 1;
+	}
+
+	inline std::string regionFileName(const TKeyData& regionKey) {
+		int32_t coords[3];
+		keyToCoords(regionKey, coords);
+		return "region_" + std::to_string(coords[0]) + "_" + std::to_string(coords[1]) + "_" + std::to_string(coords[2]) + ".dat";
+	}
+
+	// column file per cube of region size keys in one directory. key is 3 x int32 (X, Y, Z)
+	// region file is created on first write, opened on first access and closed when idle or when too many are open
+	// snapshots and backups are not supported, each region file is self-contained and may be copied alone
+	template <typename K>
+	class KvRegionFile {
+
+	private:
+		typedef std::shared_ptr<KvColumnFile<K>> TRegionPtr;
+
+		typedef struct TRegion {
+			TRegionPtr file;
+			ulong64 lastUse = 0; // ms
+		} TRegion;
+
+		std::string dir;
+		int32_t regionSize = 8;
+		uint32 maxOpen = KVDB_REGION_MAX_OPEN;
+		bool bOpen = false;
+
+		// settings of each region file
+		std::array<uint32, KVDB_MAX_COLUMNS> codecList = {};
+		bool bUseMemoryMapping = false;
+		bool bUseWal = false;
+		TDurability durability = DURABILITY_GROUP;
+		uint32 walGroupSize = KVDB_WAL_GROUP_COMMIT_SIZE;
+		ulong64 cacheSize = 0;
+		TPlacement placement = PLACEMENT_DEFAULT;
+		TIoThreadPoolPtr ioPool;
+
+		std::mutex regionMutex; // guards region map and list, held while region file opens
+		std::condition_variable closedCondition;
+		std::unordered_map<TKeyData, TRegion> regionMap; // open regions
+		std::unordered_set<TKeyData> closingSet; // regions taken out of map, their files are being closed
+		std::unordered_set<TKeyData> knownRegionSet; // regions with file
+		TFileIO listIO;
+		ulong64 listEnd = 0;
+
+		static ulong64 nowMs() {
+			return (ulong64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		TKeyData regionOf(const K& k) const {
+			int32_t coords[3];
+			keyToCoords(KvFile<K, TValueData>::toKeyData(k), coords);
+			return coordsToKey(regionCoord(coords[0], regionSize), regionCoord(coords[1], regionSize), regionCoord(coords[2], regionSize));
+		}
+
+		bool readRegionList() {
+			const std::string listFile = dir + KVDB_REGION_LIST_FILE;
+			if (!listIO.open(listFile, true)) return false;
+
+			TRegionListHeader header;
+			if (listIO.size() < sizeof(TRegionListHeader)) {
+				header.regionSize = regionSize;
+				listEnd = sizeof(TRegionListHeader);
+				return listIO.writeObj(0, header) && listIO.truncate(listEnd) && listIO.sync();
+			}
+
+			if (!listIO.readObj(0, header) || header.magic != KVDB_REGION_LIST_MAGIC || header.version != KVDB_REGION_LIST_VERSION) return false;
+
+			// keys of existing files would go to other regions
+			if (header.regionSize != regionSize) return false;
+
+			// torn tail of interrupted append is dropped
+			const ulong64 count = (listIO.size() - sizeof(TRegionListHeader)) / sizeof(TKeyData);
+			std::vector<TKeyData> regionList(count);
+			if (count > 0 && !listIO.readAt(sizeof(TRegionListHeader), regionList.data(), count * sizeof(TKeyData))) return false;
+
+			knownRegionSet.insert(regionList.begin(), regionList.end());
+			listEnd = sizeof(TRegionListHeader) + count * sizeof(TKeyData);
+			return true;
+		}
+
+		// region is listed before its file is created
+		bool createRegionLocked(const TKeyData& regionKey) {
+			if (!listIO.writeObj(listEnd, regionKey) || !listIO.sync()) return false;
+			listEnd += sizeof(TKeyData);
+			knownRegionSet.insert(regionKey);
+			return true;
+		}
+
+		// least recently used regions are taken out of map first. region in use by other thread is kept.
+		// taken regions must be closed by closeRegions after lock is released, closing checkpoints write-ahead log
+		std::vector<std::pair<TKeyData, TRegionPtr>> takeRegionsLocked(ulong64 idleBefore, size_t keepCount) {
+			std::vector<std::pair<ulong64, TKeyData>> candidateList;
+			for (const auto& itm : regionMap) {
+				if (itm.second.lastUse <= idleBefore && itm.second.file.use_count() == 1) {
+					candidateList.push_back({ itm.second.lastUse, itm.first });
+				}
+			}
+
+			std::sort(candidateList.begin(), candidateList.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+			std::vector<std::pair<TKeyData, TRegionPtr>> takenList;
+			for (const auto& candidate : candidateList) {
+				if (regionMap.size() <= keepCount) break;
+				auto got = regionMap.find(candidate.second);
+				takenList.push_back({ got->first, got->second.file });
+				closingSet.insert(got->first);
+				regionMap.erase(got);
+			}
+
+			return takenList;
+		}
+
+		// region is opened again only after its file is closed
+		void closeRegions(const std::vector<std::pair<TKeyData, TRegionPtr>>& takenList) {
+			if (takenList.empty()) return;
+
+			for (const auto& taken : takenList) taken.second->close();
+
+			std::unique_lock<std::mutex> lock(regionMutex);
+			for (const auto& taken : takenList) closingSet.erase(taken.first);
+			lock.unlock();
+			closedCondition.notify_all();
+		}
+
+		TRegionPtr getRegion(const TKeyData& regionKey, bool bCreate) {
+			std::vector<std::pair<TKeyData, TRegionPtr>> takenList;
+			TRegionPtr region = getRegion(regionKey, bCreate, takenList);
+			closeRegions(takenList);
+			return region;
+		}
+
+		// least recently used regions over limit go to takenList. regions used by other threads are kept,
+		// so limit is exceeded for a while and open regions are trimmed again on next access
+		TRegionPtr getRegion(const TKeyData& regionKey, bool bCreate, std::vector<std::pair<TKeyData, TRegionPtr>>& takenList) {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			closedCondition.wait(lock, [&] { return closingSet.find(regionKey) == closingSet.end(); });
+			if (!bOpen) return nullptr;
+
+			auto got = regionMap.find(regionKey);
+			if (got != regionMap.end()) {
+				got->second.lastUse = nowMs();
+				TRegionPtr region = got->second.file;
+				if (regionMap.size() > maxOpen) {
+					takenList = takeRegionsLocked(ULLONG_MAX, maxOpen);
+				}
+
+				return region;
+			}
+
+			const bool bKnown = knownRegionSet.find(regionKey) != knownRegionSet.end();
+			if (!bKnown && !bCreate) return nullptr;
+
+			if (regionMap.size() >= maxOpen) {
+				takenList = takeRegionsLocked(ULLONG_MAX, maxOpen - 1);
+			}
+
+			const std::string file = dir + regionFileName(regionKey);
+			TRegionPtr region = std::make_shared<KvColumnFile<K>>();
+			for (uint32 column = 0; column < KVDB_MAX_COLUMNS; column++) {
+				region->setColumnCodec(column, codecList[column]);
+			}
+
+			region->setMemoryMapping(bUseMemoryMapping);
+			region->setWriteAheadLog(bUseWal, durability, walGroupSize);
+			region->setCacheSize(cacheSize / maxOpen);
+			region->setPlacement(placement);
+			region->setIoThreadPool(ioPool);
+
+			if (!region->open(file)) {
+				// listed region without file is created again, broken file is left as is
+				TFileIO probe;
+				if (!bCreate || probe.open(file)) return nullptr;
+				if (!bKnown && !createRegionLocked(regionKey)) return nullptr;
+				if (!KvFile<K, TValueData>::create(file, std::unordered_map<K, TValueData>(), CODEC_NONE)) return nullptr;
+				if (!region->open(file)) return nullptr;
+			}
+
+			regionMap[regionKey] = { region, nowMs() };
+			return region;
+		}
+
+		// regions of keys in key order of each region
+		std::vector<std::pair<TKeyData, std::vector<size_t>>> groupByRegion(const std::vector<K>& keyList) const {
+			std::vector<std::pair<TKeyData, std::vector<size_t>>> groupList;
+			std::unordered_map<TKeyData, size_t> groupIndex;
+			for (size_t i = 0; i < keyList.size(); i++) {
+				const TKeyData regionKey = regionOf(keyList[i]);
+				auto got = groupIndex.find(regionKey);
+				if (got == groupIndex.end()) {
+					got = groupIndex.insert({ regionKey, groupList.size() }).first;
+					groupList.push_back({ regionKey, std::vector<size_t>() });
+				}
+
+				groupList[got->second].second.push_back(i);
+			}
+
+			return groupList;
+		}
+
+		// regions in Z-order, so neighbour regions follow each other
+		std::vector<TKeyData> knownRegions() {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			std::vector<TKeyData> regionList(knownRegionSet.begin(), knownRegionSet.end());
+			lock.unlock();
+
+			std::sort(regionList.begin(), regionList.end(), [](const TKeyData& a, const TKeyData& b) { return mortonCode(a) < mortonCode(b); });
+			return regionList;
+		}
+
+		std::vector<TRegionPtr> openRegions() {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			std::vector<TRegionPtr> regionList;
+			for (const auto& itm : regionMap) regionList.push_back(itm.second.file);
+			return regionList;
+		}
+
+		static void addIo(TIoStats& sum, const TIoStats& io) {
+			sum.readOps += io.readOps;
+			sum.readBytes += io.readBytes;
+			sum.writeOps += io.writeOps;
+			sum.writeBytes += io.writeBytes;
+			sum.syncOps += io.syncOps;
+		}
+
+		// histograms are not merged, percentiles are the worst of regions
+		static void addLatency(TLatencyStats& sum, const TLatencyStats& latency) {
+			sum.count += latency.count;
+			sum.totalUs += latency.totalUs;
+			sum.p50Us = std::max(sum.p50Us, latency.p50Us);
+			sum.p90Us = std::max(sum.p90Us, latency.p90Us);
+			sum.p99Us = std::max(sum.p99Us, latency.p99Us);
+			sum.maxUs = std::max(sum.maxUs, latency.maxUs);
+		}
+
+	public:
+		~KvRegionFile() {
+			close();
+		}
+
+		// in keys. can't be changed for existing directory
+		void setRegionSize(int32_t size) {
+			if (size > 0) regionSize = size;
+		}
+
+		void setMaxOpenRegions(uint32 count) {
+			if (count > 0) maxOpen = count;
+		}
+
+		void setColumnCodec(uint32 column, uint32 codec) {
+			if (column < KVDB_MAX_COLUMNS) codecList[column] = codec;
+		}
+
+		void setMemoryMapping(bool val) {
+			bUseMemoryMapping = val;
+		}
+
+		void setWriteAheadLog(bool val, TDurability durabilityLevel = DURABILITY_GROUP, uint32 groupSize = KVDB_WAL_GROUP_COMMIT_SIZE) {
+			bUseWal = val;
+			durability = durabilityLevel;
+			walGroupSize = groupSize;
+		}
+
+		// total of open regions, each region gets equal part
+		void setCacheSize(ulong64 bytes) {
+			cacheSize = bytes;
+		}
+
+		void setPlacement(TPlacement val) {
+			placement = val;
+		}
+
+		void setIoThreadPool(TIoThreadPoolPtr pool) {
+			ioPool = pool;
+		}
+
+		// directory must exist. path ends with separator
+		bool open(const std::string& path) {
+			close();
+
+			std::unique_lock<std::mutex> lock(regionMutex);
+			dir = path;
+
+			// region may be released by its last prefetch on I/O thread, so pool is not owned by region
+			if (ioPool == nullptr) {
+				ioPool = std::make_shared<TIoThreadPool>();
+			}
+
+			if (!readRegionList()) {
+				listIO.close();
+				knownRegionSet.clear();
+				return false;
+			}
+
+			bOpen = true;
+			return true;
+		}
+
+		// regions in use by other threads are closed too
+		void close() {
+			std::vector<std::pair<TKeyData, TRegionPtr>> takenList;
+			std::unique_lock<std::mutex> lock(regionMutex);
+			for (auto& itm : regionMap) {
+				takenList.push_back({ itm.first, itm.second.file });
+				closingSet.insert(itm.first);
+			}
+
+			regionMap.clear();
+			knownRegionSet.clear();
+			listIO.close();
+			listEnd = 0;
+			bOpen = false;
+			lock.unlock();
+
+			closeRegions(takenList);
+		}
+
+		// closes regions not used for given time. returns count of open regions
+		size_t closeIdle(ulong64 idleMs) {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			const ulong64 now = nowMs();
+			std::vector<std::pair<TKeyData, TRegionPtr>> takenList = takeRegionsLocked((now > idleMs) ? now - idleMs : 0, 0);
+			const size_t openCount = regionMap.size();
+			lock.unlock();
+
+			closeRegions(takenList);
+			return openCount;
+		}
+
+		size_t openCount() {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			return regionMap.size();
+		}
+
+		size_t regionCount() {
+			std::unique_lock<std::mutex> lock(regionMutex);
+			return knownRegionSet.size();
+		}
+
+		void commit() {
+			for (TRegionPtr& region : openRegions()) region->commit();
+		}
+
+		void checkpoint() {
+			for (TRegionPtr& region : openRegions()) region->checkpoint();
+		}
+
+		// every region, closed regions are opened one by one
+		TCompactionStats compact() {
+			TCompactionStats result;
+			result.bSuccess = true;
+			for (const TKeyData& regionKey : knownRegions()) {
+				TRegionPtr region = getRegion(regionKey, false);
+				if (region == nullptr) continue;
+
+				TCompactionStats stats = region->compact();
+				result.bSuccess = result.bSuccess && stats.bSuccess;
+				result.records += stats.records;
+				result.sizeBefore += stats.sizeBefore;
+				result.sizeAfter += stats.sizeAfter;
+				result.reclaimedBytes += stats.reclaimedBytes;
+			}
+
+			return result;
+		}
+
+		TCacheStats getCacheStats() {
+			TCacheStats result;
+			for (TRegionPtr& region : openRegions()) addCache(result, region->getCacheStats());
+			return result;
+		}
+
+		// open regions only
+		TFileStats getStats() {
+			TFileStats result;
+			for (TRegionPtr& region : openRegions()) {
+				const TFileStats stats = region->getStats();
+				addIo(result.dataIo, stats.dataIo);
+				addIo(result.walIo, stats.walIo);
+				addLatency(result.load, stats.load);
+				addLatency(result.save, stats.save);
+				addLatency(result.lockWait, stats.lockWait);
+				addCache(result.cache, stats.cache);
+
+				result.fileSize += stats.fileSize;
+				result.walSize += stats.walSize;
+				result.liveBytes += stats.liveBytes;
+				result.deadBytes += stats.deadBytes;
+				result.freeExtents += stats.freeExtents;
+				result.retiredBytes += stats.retiredBytes;
+				result.pairs += stats.pairs;
+				result.keySlots += stats.keySlots;
+				result.reservedSlots += stats.reservedSlots;
+				result.deletedSlots += stats.deletedSlots;
+				result.tableCount += stats.tableCount;
+			}
+
+			return result;
+		}
+
+		void resetStats() {
+			for (TRegionPtr& region : openRegions()) region->resetStats();
+		}
+
+		bool isExist(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			return region != nullptr && region->isExist(k, column);
+		}
+
+		TValueView loadView(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			return (region != nullptr) ? region->loadView(k, column) : TValueView();
+		}
+
+		TValueDataPtr loadData(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			return (region != nullptr) ? region->loadData(k, column) : nullptr;
+		}
+
+		// every region, closed regions are opened one by one. disk order is region by region
+		std::vector<K> keys(uint32 column, bool bDiskOrder = false) {
+			std::vector<K> keyList;
+			for (const TKeyData& regionKey : knownRegions()) {
+				TRegionPtr region = getRegion(regionKey, false);
+				if (region == nullptr) continue;
+
+				std::vector<K> regionKeyList = region->keys(column, bDiskOrder);
+				keyList.insert(keyList.end(), regionKeyList.begin(), regionKeyList.end());
+			}
+
+			return keyList;
+		}
+
+		// region by region in order of first key. keys of missing regions get nullptr
+		void preload(const std::vector<K>& keyList, uint32 column, uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			for (const auto& group : groupByRegion(keyList)) {
+				TRegionPtr region = getRegion(group.first, false);
+				if (region == nullptr) {
+					for (size_t i : group.second) callback(keyList[i], nullptr);
+					continue;
+				}
+
+				std::vector<K> regionKeyList;
+				regionKeyList.reserve(group.second.size());
+				for (size_t i : group.second) regionKeyList.push_back(keyList[i]);
+				region->preload(regionKeyList, column, workerCount, callback);
+			}
+		}
+
+		// regions overlapping box
+		std::vector<std::pair<K, TValueDataPtr>> loadRange(const K& min, const K& max, uint32 column) {
+			int32_t lo[3];
+			int32_t hi[3];
+			keyToCoords(regionOf(min), lo);
+			keyToCoords(regionOf(max), hi);
+
+			std::vector<std::pair<K, TValueDataPtr>> result;
+			for (const TKeyData& regionKey : knownRegions()) {
+				int32_t coords[3];
+				keyToCoords(regionKey, coords);
+				if (coords[0] < lo[0] || coords[0] > hi[0] || coords[1] < lo[1] || coords[1] > hi[1] || coords[2] < lo[2] || coords[2] > hi[2]) continue;
+
+				TRegionPtr region = getRegion(regionKey, false);
+				if (region == nullptr) continue;
+
+				for (auto& itm : region->loadRange(min, max, column)) result.push_back(std::move(itm));
+			}
+
+			return result;
+		}
+
+		std::future<TValueDataPtr> loadAsync(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			if (region != nullptr) return region->loadAsync(k, column);
+
+			std::promise<TValueDataPtr> promise;
+			promise.set_value(nullptr);
+			return promise.get_future();
+		}
+
+		// region closed meanwhile drops its cache, see KvFile::prefetch
+		void prefetch(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			if (region != nullptr) region->prefetch(k, column, region);
+		}
+
+		bool save(const K& k, uint32 column, const TValueData& v) {
+			TRegionPtr region = getRegion(regionOf(k), true);
+			return region != nullptr && region->save(k, column, v);
+		}
+
+		void erase(const K& k, uint32 column) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			if (region != nullptr) region->erase(k, column);
+		}
+
+		// one batch per region. regions have own locks, batches of other threads to other regions don't wait
+		bool saveBatch(const std::vector<std::pair<K, TValueData>>& batch, uint32 column) {
+			bool bAllSaved = true;
+			std::vector<K> keyList;
+			keyList.reserve(batch.size());
+			for (const auto& itm : batch) keyList.push_back(itm.first);
+
+			for (const auto& group : groupByRegion(keyList)) {
+				std::vector<std::pair<K, TValueData>> regionBatch;
+				bool bHasValue = false;
+				regionBatch.reserve(group.second.size());
+				for (size_t i : group.second) {
+					regionBatch.push_back(batch[i]);
+					bHasValue = bHasValue || !batch[i].second.empty();
+				}
+
+				// erase only batch doesn't create region
+				TRegionPtr region = getRegion(group.first, bHasValue);
+				if (region != nullptr) {
+					bAllSaved = region->saveBatch(regionBatch, column) && bAllSaved;
+				} else if (bHasValue) {
+					bAllSaved = false;
+				}
+			}
+
+			return bAllSaved;
+		}
+
+		bool patch(const K& k, uint32 column, const std::vector<TPatch>& patchList) {
+			TRegionPtr region = getRegion(regionOf(k), false);
+			return region != nullptr && region->patch(k, column, patchList);
+		}
+	};
+
+	// one kind of values. standalone file, column of column file or column of region files
+	template <typename K>
+	class KvColumn {
+
+	private:
+		std::shared_ptr<KvFile<K, TValueData>> file;
+		std::shared_ptr<KvColumnFile<K>> columnFile;
+		std::shared_ptr<KvRegionFile<K>> regionFile;
+		uint32 column = 0;
+
+	public:
+		void bind(std::shared_ptr<KvFile<K, TValueData>> standaloneFile) {
+			file = standaloneFile;
+			columnFile = nullptr;
+			regionFile = nullptr;
+		}
+
+		void bind(std::shared_ptr<KvColumnFile<K>> sharedFile, uint32 columnIndex) {
+			file = nullptr;
+			columnFile = sharedFile;
+			regionFile = nullptr;
+			column = columnIndex;
+		}
+
+		void bind(std::shared_ptr<KvRegionFile<K>> sharedFile, uint32 columnIndex) {
+			file = nullptr;
+			columnFile = nullptr;
+			regionFile = sharedFile;
+			column = columnIndex;
+		}
+
+		// shared by several kinds of values
+		bool isColumn() const {
+			return columnFile != nullptr || regionFile != nullptr;
+		}
+
+		bool isRegion() const {
+			return regionFile != nullptr;
+		}
+
+		// closes whole column file or all region files
+		void close() {
+			if (file) file->close();
+			if (columnFile) columnFile->close();
+			if (regionFile) regionFile->close();
+		}
+
+		void commit() {
+			if (file) file->commit();
+			if (columnFile) columnFile->commit();
+			if (regionFile) regionFile->commit();
+		}
+
+		// closes region files not used for given time, other files stay open
+		void closeIdle(ulong64 idleMs) {
+			if (regionFile) regionFile->closeIdle(idleMs);
+		}
+
+		TCompactionStats compact() {
+			if (file) return file->compact();
+			if (columnFile) return columnFile->compact();
+			if (regionFile) return regionFile->compact();
+			return TCompactionStats();
+		}
+
+		// backup of column file covers all columns. region files can't be backed up, bSuccess is false then
+		TBackupStats backup(const std::string& backupFile, bool bFull = false) {
+			if (file) return file->backup(backupFile, bFull);
+			if (columnFile) return columnFile->backup(backupFile, bFull);
+			if (regionFile) logError("kvdb: backup of region files is not supported: " + backupFile);
+			return TBackupStats();
+		}
+
+		// region files have no snapshots and backups
+		bool hasSnapshots() const {
+			return regionFile == nullptr;
+		}
+
+		TCacheStats getCacheStats() const {
+			if (file) return file->getCacheStats();
+			if (columnFile) return columnFile->getCacheStats();
+			if (regionFile) return regionFile->getCacheStats();
+			return TCacheStats();
+		}
+
+		// stats of column file cover all columns
+		TFileStats getStats() {
+			if (file) return file->getStats();
+			if (columnFile) return columnFile->getStats();
+			if (regionFile) return regionFile->getStats();
+			return TFileStats();
+		}
+
+		void resetStats() {
+			if (file) file->resetStats();
+			if (columnFile) columnFile->resetStats();
+			if (regionFile) regionFile->resetStats();
+		}
+
+		bool isExist(const K& k) {
+			if (file) return file->isExist(k);
+			if (columnFile) return columnFile->isExist(k, column);
+			if (regionFile) return regionFile->isExist(k, column);
+			return false;
+		}
+
+		TValueView loadView(const K& k) {
+			if (file) return file->loadView(k);
+			if (columnFile) return columnFile->loadView(k, column);
+			if (regionFile) return regionFile->loadView(k, column);
+			return TValueView();
+		}
+
+		TValueDataPtr loadData(const K& k) {
+			if (file) return file->loadData(k);
+			if (columnFile) return columnFile->loadData(k, column);
+			if (regionFile) return regionFile->loadData(k, column);
+			return nullptr;
+		}
+
+		std::vector<K> keys(bool bDiskOrder = false) {
+			if (file) return file->keys(bDiskOrder);
+			if (columnFile) return columnFile->keys(column, bDiskOrder);
+			if (regionFile) return regionFile->keys(column, bDiskOrder);
+			return std::vector<K>();
+		}
+
+		void preload(const std::vector<K>& keyList, uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			if (file) file->preload(keyList, workerCount, callback);
+			if (columnFile) columnFile->preload(keyList, column, workerCount, callback);
+			if (regionFile) regionFile->preload(keyList, column, workerCount, callback);
+		}
+
+		void preload(uint32 workerCount, std::function<void(const K&, TValueDataPtr)> callback) {
+			preload(keys(true), workerCount, callback);
+		}
+
+		// snapshot of column file covers all columns. region files have no snapshots: nullptr, see hasSnapshots
+		TSnapshotPtr snapshot() {
+			if (file) return file->snapshot();
+			if (columnFile) return columnFile->snapshot();
+			if (regionFile) logError("kvdb: snapshot of region files is not supported");
+			return nullptr;
+		}
+
+		// nullptr snapshot reads current data. snapshot of other file can't be read by region files: false
+		bool isExist(const K& k, const TSnapshotPtr& snapshot) {
+			if (file) return file->isExist(k, snapshot);
+			if (columnFile) return columnFile->isExist(k, column, snapshot);
+			if (regionFile && snapshot == nullptr) return regionFile->isExist(k, column);
+			if (regionFile) logError("kvdb: snapshot read of region files is not supported");
+			return false;
+		}
+
+		// nullptr snapshot reads current data. snapshot of other file can't be read by region files: nullptr
+		TValueDataPtr loadData(const K& k, const TSnapshotPtr& snapshot) {
+			if (file) return file->loadData(k, snapshot);
+			if (columnFile) return columnFile->loadData(k, column, snapshot);
+			if (regionFile && snapshot == nullptr) return regionFile->loadData(k, column);
+			if (regionFile) logError("kvdb: snapshot read of region files is not supported");
+			return nullptr;
+		}
+
+		std::vector<std::pair<K, TValueDataPtr>> loadRange(const K& min, const K& max) {
+			if (file) return file->loadRange(min, max);
+			if (columnFile) return columnFile->loadRange(min, max, column);
+			if (regionFile) return regionFile->loadRange(min, max, column);
+			return std::vector<std::pair<K, TValueDataPtr>>();
+		}
+
+		std::future<TValueDataPtr> loadAsync(const K& k) {
+			if (file) return file->loadAsync(k);
+			if (columnFile) return columnFile->loadAsync(k, column);
+			if (regionFile) return regionFile->loadAsync(k, column);
+
+			std::promise<TValueDataPtr> promise;
+			promise.set_value(nullptr);
+			return promise.get_future();
+		}
+
+		// see KvFile::prefetch
+		void prefetch(const K& k) {
+			if (file) file->prefetch(k);
+			if (columnFile) columnFile->prefetch(k, column);
+			if (regionFile) regionFile->prefetch(k, column);
+		}
+
+		bool save(const K& k, const TValueData& v) {
+			if (file) return file->save(k, v);
+			if (columnFile) return columnFile->save(k, column, v);
+			if (regionFile) return regionFile->save(k, column, v);
+			return false;
+		}
+
+		void erase(const K& k) {
+			if (file) file->erase(k);
+			if (columnFile) columnFile->erase(k, column);
+			if (regionFile) regionFile->erase(k, column);
+		}
+
+		bool saveBatch(const std::vector<std::pair<K, TValueData>>& batch) {
+			if (file) return file->saveBatch(batch);
+			if (columnFile) return columnFile->saveBatch(batch, column);
+			if (regionFile) return regionFile->saveBatch(batch, column);
+			return false;
+		}
+
+		bool patch(const K& k, const std::vector<TPatch>& patchList) {
+			if (file) return file->patch(k, patchList);
+			if (columnFile) return columnFile->patch(k, column, patchList);
+			if (regionFile) return regionFile->patch(k, column, patchList);
+			return false;
+		}
 	};
 
 	//-----------------------------------------------------------------------------
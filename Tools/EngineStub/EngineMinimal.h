@@ -0,0 +1,53 @@
+//
+// Engine types used by voxel storage headers, for standalone voxel tools (no engine dependencies).
+// see VoxelBrickArray.h and VoxelBufferPool.h, ModuleManager.h stands for module header included by VoxelBufferPool.cpp
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int32_t int32;
+
+#if defined(__linux__)
+#define PLATFORM_LINUX 1
+#else
+#define PLATFORM_LINUX 0
+#endif
+
+#define FORCEINLINE inline
+#define TEXT(x) x
+
+struct FMemory {
+	static void* Malloc(size_t size, size_t alignment) {
+		if (alignment < sizeof(void*)) alignment = sizeof(void*);
+#if defined(_WIN32)
+		return _aligned_malloc(size, alignment);
+#else
+		void* ptr = nullptr;
+		return (posix_memalign(&ptr, alignment, size) == 0) ? ptr : nullptr;
+#endif
+	}
+
+	static void Free(void* ptr) {
+#if defined(_WIN32)
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+
+	static void* Memcpy(void* dest, const void* src, size_t count) {
+		return memcpy(dest, src, count);
+	}
+
+	static void Memzero(void* dest, size_t count) {
+		memset(dest, 0, count);
+	}
+};
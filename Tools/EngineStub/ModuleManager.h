@@ -0,0 +1,16 @@
+//
+// Module declarations of UnrealSandboxTerrain.h, for standalone voxel tools. see EngineMinimal.h
+//
+
+#pragma once
+
+#include "EngineMinimal.h"
+
+#define DECLARE_LOG_CATEGORY_EXTERN(CategoryName, DefaultVerbosity, CompileTimeVerbosity)
+
+class IModuleInterface {
+public:
+	virtual ~IModuleInterface() {}
+	virtual void StartupModule() {}
+	virtual void ShutdownModule() {}
+};
@@ -0,0 +1,348 @@
+//
+// Standalone kvdb benchmark suite (no engine dependencies)
+//
+// build: g++ -std=c++17 -O2 -pthread -I../../Source/UnrealSandboxTerrain/Public kvdb_bench.cpp -o kvdb_bench
+// usage: ./kvdb_bench [options] [file]
+//   -s <scale>    multiply record and operation counts (default 1.0)
+//   -p <profile>  run one value profile only: vd, md or obj
+//   -wal          write-ahead log
+//   -mmap         memory mapped reads
+//   -lz           compressed records
+//   -cache <mb>   value cache size
+//
+// value profiles follow terrain zones: voxel data ~820 KB, mesh data 20-200 KB, object blobs < 1 KB
+// each line reports throughput and latency percentiles of single operations
+//
+
+#include "kvdb.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+
+struct TBenchIndex {
+	int32_t X = 0;
+	int32_t Y = 0;
+	int32_t Z = 0;
+
+	TBenchIndex() {};
+
+	TBenchIndex(int32_t XIndex, int32_t YIndex, int32_t ZIndex) : X(XIndex), Y(YIndex), Z(ZIndex) { }
+
+	bool operator==(const TBenchIndex &other) const {
+		return (X == other.X && Y == other.Y && Z == other.Z);
+	}
+};
+
+namespace std {
+	template <>
+	struct hash<TBenchIndex> {
+		std::size_t operator()(const TBenchIndex& k) const {
+			return ((hash<int>()(k.X) ^ (hash<int>()(k.Y) << 1)) >> 1) ^ (hash<int>()(k.Z) << 1);
+		}
+	};
+}
+
+typedef kvdb::KvFile<TBenchIndex, TValueData> TBenchFile;
+
+//============================================================================
+// Settings
+//============================================================================
+
+typedef struct TBenchProfile {
+	const char* name;
+	uint32 minSize;
+	uint32 maxSize;
+	int records;
+	int ops; // operations per thread
+} TBenchProfile;
+
+static TBenchProfile profileList[] = {
+	{ "vd", 820 * 1024, 820 * 1024, 128, 256 },
+	{ "md", 20 * 1024, 200 * 1024, 1000, 2000 },
+	{ "obj", 16, 1024, 20000, 20000 }
+};
+
+typedef struct TBenchSettings {
+	std::string fileName = "kvdb_bench.dat";
+	std::string profile;
+	double scale = 1.0;
+	bool bWal = false;
+	bool bMmap = false;
+	uint32 codec = kvdb::CODEC_NONE;
+	ulong64 cacheSize = 0;
+} TBenchSettings;
+
+static TBenchSettings settings;
+
+static const int threadCountList[] = { 1, 4, 16 };
+
+//============================================================================
+// Helpers
+//============================================================================
+
+static TBenchIndex indexFromNumber(int n) {
+	return TBenchIndex(n % 16, (n / 16) % 16, n / 256);
+}
+
+static double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int scaled(int n) {
+	const int s = (int)(n * settings.scale);
+	return (s > 0) ? s : 1;
+}
+
+// runs of equal bytes with noise, roughly as compressible as terrain data
+static void makeValue(std::mt19937& rnd, uint32 size, TValueData& value) {
+	value.resize(size);
+	uint32 pos = 0;
+	while (pos < size) {
+		const uint32 run = 1 + rnd() % 64;
+		const byte b = (byte)(rnd() % 4);
+		for (uint32 i = 0; i < run && pos < size; i++) {
+			value[pos++] = (rnd() % 16 == 0) ? (byte)rnd() : b;
+		}
+	}
+}
+
+static uint32 valueSize(std::mt19937& rnd, const TBenchProfile& profile) {
+	if (profile.maxSize <= profile.minSize) return profile.minSize;
+	return profile.minSize + rnd() % (profile.maxSize - profile.minSize + 1);
+}
+
+// values are made before measuring, so timings are storage only
+#define BENCH_VALUE_POOL_SIZE 32
+
+typedef std::vector<TValueData> TValuePool;
+
+static void makePool(const TBenchProfile& profile, double growth, TValuePool& pool) {
+	std::mt19937 rnd(42);
+	pool.resize(BENCH_VALUE_POOL_SIZE);
+	for (TValueData& value : pool) {
+		makeValue(rnd, (uint32)(valueSize(rnd, profile) * growth), value);
+	}
+}
+
+static bool openFile(TBenchFile& file) {
+	file.setWriteAheadLog(settings.bWal);
+	file.setMemoryMapping(settings.bMmap);
+	file.setCacheSize(settings.cacheSize);
+	return file.open(settings.fileName);
+}
+
+static void removeFile() {
+	std::remove(settings.fileName.c_str());
+	std::remove((settings.fileName + ".wal").c_str());
+	std::remove((settings.fileName + ".compact").c_str());
+}
+
+//============================================================================
+// Report
+//============================================================================
+
+// latency of single operations in microseconds
+typedef std::vector<double> TLatencyList;
+
+static double percentile(const TLatencyList& sorted, double p) {
+	if (sorted.empty()) return 0;
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+static void report(const char* name, const TBenchProfile& profile, int threadCount, double time, ulong64 bytes, std::vector<TLatencyList>& latencyList) {
+	TLatencyList all;
+	for (const TLatencyList& l : latencyList) all.insert(all.end(), l.begin(), l.end());
+	std::sort(all.begin(), all.end());
+
+	printf("%-12s %-4s threads %2d -> %10.0f ops/s %9.1f MB/s | us p50 %9.1f p90 %9.1f p99 %9.1f max %10.1f\n",
+		name, profile.name, threadCount, all.size() / time, bytes / time / (1024 * 1024),
+		percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), all.empty() ? 0 : all.back());
+}
+
+// runs op on each thread, op returns processed bytes
+static void run(const char* name, const TBenchProfile& profile, int threadCount, int opsPerThread, std::function<ulong64(int thread, int i, std::mt19937& rnd)> op) {
+	std::vector<std::thread> threads;
+	std::vector<TLatencyList> latencyList(threadCount);
+	std::vector<ulong64> bytes(threadCount, 0);
+
+	double start = seconds();
+	for (int t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t]() {
+			std::mt19937 rnd(t + 1);
+			latencyList[t].reserve(opsPerThread);
+			for (int i = 0; i < opsPerThread; i++) {
+				const double opStart = seconds();
+				bytes[t] += op(t, i, rnd);
+				latencyList[t].push_back((seconds() - opStart) * 1000000);
+			}
+		});
+	}
+
+	for (auto& thread : threads) thread.join();
+	double time = seconds() - start;
+
+	ulong64 totalBytes = 0;
+	for (ulong64 b : bytes) totalBytes += b;
+
+	report(name, profile, threadCount, time, totalBytes, latencyList);
+}
+
+//============================================================================
+// Benchmarks
+//============================================================================
+
+// whole file in one call, so only throughput is reported
+static void benchCreate(const TBenchProfile& profile, const TValuePool& pool, int records) {
+	std::unordered_map<TBenchIndex, TValueData> pairs;
+	ulong64 bytes = 0;
+	for (int i = 0; i < records; i++) {
+		const TValueData& value = pool[i % pool.size()];
+		pairs[indexFromNumber(i)] = value;
+		bytes += value.size();
+	}
+
+	removeFile();
+	double start = seconds();
+	TBenchFile::create(settings.fileName, pairs, settings.codec);
+	double time = seconds() - start;
+
+	printf("%-12s %-4s records %6d -> %10.0f recs/s %9.1f MB/s\n", "create", profile.name, records, records / time, bytes / time / (1024 * 1024));
+}
+
+static void benchOpen(const TBenchProfile& profile) {
+	const int count = 16;
+	std::vector<TLatencyList> latencyList(1);
+
+	double start = seconds();
+	for (int i = 0; i < count; i++) {
+		const double opStart = seconds();
+		TBenchFile file;
+		openFile(file);
+		file.close();
+		latencyList[0].push_back((seconds() - opStart) * 1000000);
+	}
+	double time = seconds() - start;
+
+	report("open", profile, 1, time, 0, latencyList);
+}
+
+static void benchSaveNew(TBenchFile& file, const TBenchProfile& profile, const TValuePool& pool, int records) {
+	run("save new", profile, 1, records, [&](int, int i, std::mt19937&) {
+		const TValueData& value = pool[i % pool.size()];
+		file.save(indexFromNumber(i), value);
+		return (ulong64)value.size();
+	});
+}
+
+// every value is larger than its extent, so it is moved
+static void benchSaveGrowing(TBenchFile& file, const TBenchProfile& profile, const TValuePool& grownPool, int records) {
+	run("save grow", profile, 1, records, [&](int, int i, std::mt19937&) {
+		const TValueData& value = grownPool[i % grownPool.size()];
+		file.save(indexFromNumber(i), value);
+		return (ulong64)value.size();
+	});
+}
+
+static void benchLoad(TBenchFile& file, const TBenchProfile& profile, int records, int ops) {
+	for (int threadCount : threadCountList) {
+		run("load random", profile, threadCount, ops, [&](int, int, std::mt19937& rnd) {
+			TValueDataPtr dataPtr = file.loadData(indexFromNumber(rnd() % records));
+			return (dataPtr != nullptr) ? (ulong64)dataPtr->size() : 0;
+		});
+	}
+}
+
+// 9 of 10 operations are reads. writers rewrite existing keys
+static void benchMixed(TBenchFile& file, const TBenchProfile& profile, const TValuePool& pool, int records, int ops) {
+	for (int threadCount : threadCountList) {
+		run("mixed 90/10", profile, threadCount, ops, [&](int, int, std::mt19937& rnd) {
+			const TBenchIndex index = indexFromNumber(rnd() % records);
+			if (rnd() % 10 == 0) {
+				const TValueData& value = pool[rnd() % pool.size()];
+				file.save(index, value);
+				return (ulong64)value.size();
+			}
+
+			TValueDataPtr dataPtr = file.loadData(index);
+			return (dataPtr != nullptr) ? (ulong64)dataPtr->size() : 0;
+		});
+	}
+}
+
+static void benchErase(TBenchFile& file, const TBenchProfile& profile, int records) {
+	run("erase", profile, 1, records, [&](int, int i, std::mt19937&) {
+		file.erase(indexFromNumber(i));
+		return (ulong64)0;
+	});
+}
+
+static void benchProfile(const TBenchProfile& profile) {
+	const int records = scaled(profile.records);
+	const int ops = scaled(profile.ops);
+
+	TValuePool pool;
+	TValuePool grownPool;
+	makePool(profile, 1.0, pool);
+	makePool(profile, 1.5, grownPool);
+
+	benchCreate(profile, pool, records);
+	benchOpen(profile);
+
+	// other benchmarks start from empty file
+	removeFile();
+	TBenchFile::create(settings.fileName, std::unordered_map<TBenchIndex, TValueData>(), settings.codec);
+
+	TBenchFile file;
+	if (!openFile(file)) {
+		printf("unable to open file: %s\n", settings.fileName.c_str());
+		return;
+	}
+
+	benchSaveNew(file, profile, pool, records);
+	file.commit();
+	benchLoad(file, profile, records, ops);
+	benchMixed(file, profile, pool, records, ops);
+	benchSaveGrowing(file, profile, grownPool, records);
+	benchErase(file, profile, records);
+
+	file.close();
+	removeFile();
+	printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			settings.scale = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			settings.profile = argv[++i];
+		} else if (strcmp(argv[i], "-wal") == 0) {
+			settings.bWal = true;
+		} else if (strcmp(argv[i], "-mmap") == 0) {
+			settings.bMmap = true;
+		} else if (strcmp(argv[i], "-lz") == 0) {
+			settings.codec = kvdb::CODEC_LZ;
+		} else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+			settings.cacheSize = (ulong64)atoi(argv[++i]) * 1024 * 1024;
+		} else {
+			settings.fileName = argv[i];
+		}
+	}
+
+	printf("file %s, scale %.2f, wal %d, mmap %d, codec %u, cache %llu MB\n\n", settings.fileName.c_str(), settings.scale, settings.bWal, settings.bMmap, settings.codec, settings.cacheSize / (1024 * 1024));
+
+	for (const TBenchProfile& profile : profileList) {
+		if (settings.profile.empty() || settings.profile == profile.name) {
+			benchProfile(profile);
+		}
+	}
+
+	return 0;
+}
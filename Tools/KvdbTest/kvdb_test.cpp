@@ -0,0 +1,1403 @@
+//
+// Standalone kvdb tests (no engine dependencies)
+//
+// build: g++ -std=c++17 -O2 -pthread -I../../Source/UnrealSandboxTerrain/Public kvdb_test.cpp -o kvdb_test
+// usage: ./kvdb_test [test]
+//
+// each test works with its own file in current directory. exit code is number of failed tests
+//
+
+#include "kvdb.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+struct TTestIndex {
+	int32_t X = 0;
+	int32_t Y = 0;
+	int32_t Z = 0;
+
+	TTestIndex() {};
+
+	TTestIndex(int32_t XIndex, int32_t YIndex, int32_t ZIndex) : X(XIndex), Y(YIndex), Z(ZIndex) { }
+
+	bool operator==(const TTestIndex &other) const {
+		return (X == other.X && Y == other.Y && Z == other.Z);
+	}
+};
+
+namespace std {
+	template <>
+	struct hash<TTestIndex> {
+		std::size_t operator()(const TTestIndex& k) const {
+			return ((hash<int>()(k.X) ^ (hash<int>()(k.Y) << 1)) >> 1) ^ (hash<int>()(k.Z) << 1);
+		}
+	};
+}
+
+typedef kvdb::KvFile<TTestIndex, TValueData> TTestFile;
+
+//============================================================================
+// Helpers
+//============================================================================
+
+static int failedChecks = 0;
+
+#define TEST_CHECK(expr) \
+	if (!(expr)) { \
+		printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+		failedChecks++; \
+	}
+
+static void createFile(const std::string& fileName) {
+	std::remove(fileName.c_str());
+	std::remove((fileName + ".wal").c_str());
+	TTestFile::create(fileName, std::unordered_map<TTestIndex, TValueData>());
+}
+
+static long fileSize(const std::string& fileName) {
+	FILE* f = fopen(fileName.c_str(), "rb");
+	if (f == nullptr) return -1;
+
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+// copy of file as it is on disk now, like after process crash
+static void copyFile(const std::string& from, const std::string& to) {
+	std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing);
+}
+
+static bool viewEquals(const kvdb::TValueView& view, const TValueData& value) {
+	return view.size() == value.size() && std::memcmp(view.data(), value.data(), value.size()) == 0;
+}
+
+static bool dataEquals(TValueDataPtr dataPtr, const TValueData& value) {
+	return dataPtr != nullptr && *dataPtr == value;
+}
+
+//============================================================================
+// Tests
+//============================================================================
+
+// memory mapped view keeps its content while the same key is saved and patched
+static void testViewAcrossSave() {
+	const std::string fileName = "kvdb_test_view.dat";
+	createFile(fileName);
+
+	const TTestIndex index(1, 2, 3);
+	const TValueData first(4096, 1);
+	const TValueData second(4096, 2);
+
+	TTestFile file;
+	file.setMemoryMapping(true);
+	TEST_CHECK(file.open(fileName));
+	file.save(index, first);
+
+	kvdb::TValueView view = file.loadView(index);
+	TEST_CHECK(viewEquals(view, first));
+
+	// the same length fits old extent, but view still reads it
+	file.save(index, second);
+	TEST_CHECK(viewEquals(view, first));
+	TEST_CHECK(dataEquals(file.loadData(index), second));
+
+	kvdb::TValueView secondView = file.loadView(index);
+	TEST_CHECK(file.patch(index, 100, TValueData(16, 7)));
+	TEST_CHECK(viewEquals(secondView, second));
+
+	TValueData patched = second;
+	std::fill(patched.begin() + 100, patched.begin() + 116, 7);
+	TEST_CHECK(dataEquals(file.loadData(index), patched));
+
+	// extent of erased pair is not reused while viewed
+	kvdb::TValueView patchedView = file.loadView(index);
+	file.erase(index);
+	file.save(TTestIndex(4, 5, 6), TValueData(4096, 9));
+	TEST_CHECK(viewEquals(patchedView, patched));
+	TEST_CHECK(viewEquals(view, first));
+
+	// released extents are reused, file stops growing
+	view = kvdb::TValueView();
+	secondView = kvdb::TValueView();
+	patchedView = kvdb::TValueView();
+	file.save(index, first);
+
+	const long sizeBefore = fileSize(fileName);
+	for (int i = 0; i < 10; i++) {
+		file.save(index, (i % 2 == 0) ? second : first);
+	}
+
+	TEST_CHECK(fileSize(fileName) == sizeBefore);
+	file.close();
+}
+
+// checkpoint of write-ahead log doesn't overwrite viewed extent
+static void testViewAcrossCheckpoint() {
+	const std::string fileName = "kvdb_test_view_wal.dat";
+	createFile(fileName);
+
+	const TTestIndex index(1, 1, 1);
+	const TValueData first(2048, 3);
+	const TValueData second(2048, 4);
+
+	TTestFile file;
+	file.setMemoryMapping(true);
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	file.save(index, first);
+	file.checkpoint();
+
+	kvdb::TValueView view = file.loadView(index);
+	TEST_CHECK(viewEquals(view, first));
+
+	file.save(index, second);
+	file.checkpoint();
+	TEST_CHECK(viewEquals(view, first));
+
+	TEST_CHECK(file.patch(index, 0, TValueData(8, 5)));
+	file.checkpoint();
+	TEST_CHECK(viewEquals(view, first));
+
+	TValueData patched = second;
+	std::fill(patched.begin(), patched.begin() + 8, 5);
+	TEST_CHECK(dataEquals(file.loadData(index), patched));
+	file.close();
+}
+
+// key slots of many key tables map back to their tables after reopen and reuse
+static void testKeyTables() {
+	const std::string fileName = "kvdb_test_tables.dat";
+	createFile(fileName);
+
+	// keys of six tables
+	const int count = KVDB_RESERVED_TABLE_SIZE * 5 + 100;
+	{
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		for (int i = 0; i < count; i++) {
+			file.save(TTestIndex(i, 0, 0), TValueData(8, (byte)i));
+		}
+	}
+
+	{
+		// freed slots and extents of every table are taken by new keys, no new table is added
+		const long sizeBefore = fileSize(fileName);
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		for (int i = 0; i < count; i += 3) file.erase(TTestIndex(i, 0, 0));
+		for (int i = 0; i < count; i += 3) file.save(TTestIndex(i, 1, 0), TValueData(8, (byte)(i + 1)));
+		file.close();
+		TEST_CHECK(fileSize(fileName) == sizeBefore);
+	}
+
+	TTestFile file;
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(file.size() == count);
+	for (int i = 0; i < count; i++) {
+		const bool bMoved = (i % 3 == 0);
+		const TTestIndex index = bMoved ? TTestIndex(i, 1, 0) : TTestIndex(i, 0, 0);
+		TEST_CHECK(dataEquals(file.loadData(index), TValueData(8, (byte)(bMoved ? i + 1 : i))));
+	}
+}
+
+// released neighbours merge into one extent, allocation takes the smallest extent which fits
+static void testFreeSpace() {
+	kvdb::TFreeSpace freeSpace;
+	freeSpace.release(1000, 100);
+	freeSpace.release(1200, 100);
+	freeSpace.release(1100, 100);
+	TEST_CHECK(freeSpace.extentCount() == 1);
+	TEST_CHECK(freeSpace.freeBytes() == 300);
+
+	freeSpace.release(2000, 50);
+	freeSpace.release(3000, 500);
+	ulong64 pos = 0;
+	TEST_CHECK(freeSpace.allocate(40, pos));
+	TEST_CHECK(pos == 2000);
+	TEST_CHECK(freeSpace.allocate(200, pos));
+	TEST_CHECK(pos == 1000);
+	TEST_CHECK(freeSpace.allocate(400, pos));
+	TEST_CHECK(pos == 3000);
+	TEST_CHECK(!freeSpace.allocate(200, pos));
+	TEST_CHECK(freeSpace.freeBytes() == 10 + 100 + 100);
+
+	// used range found inside free extent splits it
+	freeSpace.reserve(1250, 20);
+	TEST_CHECK(freeSpace.extentCount() == 4);
+	TEST_CHECK(freeSpace.freeBytes() == 10 + 80 + 100);
+
+	// erased neighbour pairs in file are one free extent, new value of their total length doesn't grow file
+	const std::string fileName = "kvdb_test_free_space.dat";
+	createFile(fileName);
+
+	TTestFile file;
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < 4; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(1000, (byte)x));
+	}
+
+	const ulong64 recordLength = file.getStats().liveBytes / 4;
+	const long sizeBefore = fileSize(fileName);
+	file.erase(TTestIndex(1, 0, 0));
+	file.erase(TTestIndex(2, 0, 0));
+	TEST_CHECK(file.getStats().freeExtents == 1);
+	TEST_CHECK(file.getStats().deadBytes == recordLength * 2);
+
+	file.save(TTestIndex(4, 0, 0), TValueData(recordLength * 2 - (recordLength - 1000), 4));
+	TEST_CHECK(file.getStats().deadBytes == 0);
+	TEST_CHECK(fileSize(fileName) == sizeBefore);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(3, 0, 0)), TValueData(1000, 3)));
+	file.close();
+
+	// free space is found again on open
+	TEST_CHECK(file.open(fileName));
+	file.erase(TTestIndex(0, 0, 0));
+	TEST_CHECK(file.getStats().deadBytes == recordLength);
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(file.getStats().deadBytes == recordLength);
+	TEST_CHECK(file.getStats().freeExtents == 1);
+}
+
+// value grows into free extent after it and shrinks by giving its tail back. 
+// key table which loops back to itself fails open instead of serving a broken index
+static void testDamagedTables() {
+	const std::string fileName = "kvdb_test_damaged.dat";
+	createFile(fileName);
+
+	{
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		file.save(TTestIndex(0, 0, 0), TValueData(100, 1));
+		file.save(TTestIndex(1, 0, 0), TValueData(100, 2));
+		file.save(TTestIndex(2, 0, 0), TValueData(100, 3));
+		file.erase(TTestIndex(1, 0, 0));
+
+		const long sizeBefore = fileSize(fileName);
+		file.save(TTestIndex(0, 0, 0), TValueData(150, 4));
+		file.save(TTestIndex(1, 0, 0), TValueData(50, 5));
+		TEST_CHECK(fileSize(fileName) == sizeBefore);
+		TEST_CHECK(file.getStats().deadBytes == 0);
+
+		file.save(TTestIndex(0, 0, 0), TValueData(20, 6));
+		TEST_CHECK(file.getStats().deadBytes == 130);
+		file.close();
+	}
+
+	{
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), TValueData(20, 6)));
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(1, 0, 0)), TValueData(50, 5)));
+		TEST_CHECK(file.getStats().deadBytes == 130);
+		file.close();
+	}
+
+	// first table links to itself
+	const long tablePos = sizeof(kvdb::TFileHeader);
+	kvdb::TTableHeader table;
+	FILE* f = fopen(fileName.c_str(), "r+b");
+	fseek(f, tablePos, SEEK_SET);
+	TEST_CHECK(fread(&table, sizeof(table), 1, f) == 1);
+	table.nextTable = tablePos;
+	fseek(f, tablePos, SEEK_SET);
+	fwrite(&table, sizeof(table), 1, f);
+	fclose(f);
+
+	TTestFile file;
+	TEST_CHECK(!file.open(fileName));
+	TEST_CHECK(file.size() == 0);
+	TEST_CHECK(file.loadData(TTestIndex(0, 0, 0)) == nullptr);
+}
+
+// batch is written with a few writes, the last value of the same key wins and empty value erases pair.
+// logged batch is one commit group
+static void testSaveBatch() {
+	const std::string fileName = "kvdb_test_batch.dat";
+	const std::string walFileName = "kvdb_test_batch_wal.dat";
+	const std::string crashFileName = "kvdb_test_batch_crash.dat";
+	createFile(fileName);
+	createFile(walFileName);
+
+	const int count = 100;
+	std::vector<std::pair<TTestIndex, TValueData>> batch;
+	for (int i = 0; i < count; i++) {
+		batch.push_back({ TTestIndex(i, 0, 0), TValueData(100 + i, (byte)i) });
+	}
+
+	batch.push_back({ TTestIndex(10, 0, 0), TValueData(50, 200) });
+
+	{
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		file.save(TTestIndex(5, 0, 0), TValueData(100, 1));
+		file.resetStats();
+
+		TEST_CHECK(file.saveBatch(batch));
+		TEST_CHECK(file.getStats().dataIo.writeOps <= 3);
+		TEST_CHECK(file.size() == count);
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(10, 0, 0)), TValueData(50, 200)));
+
+		TEST_CHECK(file.saveBatch({ { TTestIndex(5, 0, 0), TValueData() }, { TTestIndex(count, 0, 0), TValueData(8, 9) } }));
+		TEST_CHECK(file.loadData(TTestIndex(5, 0, 0)) == nullptr);
+		TEST_CHECK(file.size() == count);
+	}
+
+	{
+		TTestFile file;
+		TEST_CHECK(file.open(fileName));
+		TEST_CHECK(file.size() == count);
+		TEST_CHECK(file.loadData(TTestIndex(5, 0, 0)) == nullptr);
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(10, 0, 0)), TValueData(50, 200)));
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(count - 1, 0, 0)), TValueData(100 + count - 1, (byte)(count - 1))));
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(count, 0, 0)), TValueData(8, 9)));
+	}
+
+	{
+		TTestFile file;
+		file.setWriteAheadLog(true);
+		TEST_CHECK(file.open(walFileName));
+		file.resetStats();
+		TEST_CHECK(file.saveBatch(batch));
+		TEST_CHECK(file.getStats().walIo.writeOps == 2);
+
+		copyFile(walFileName, crashFileName);
+		copyFile(walFileName + ".wal", crashFileName + ".wal");
+	}
+
+	TTestFile file;
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(crashFileName));
+	TEST_CHECK(file.size() == count);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(10, 0, 0)), TValueData(50, 200)));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), TValueData(100, 0)));
+}
+
+// compaction drops free extents and keeps logged values, readers are served while file is copied
+static void testCompaction() {
+	const std::string fileName = "kvdb_test_compaction.dat";
+	createFile(fileName);
+
+	const int count = 50;
+	TTestFile file;
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < count; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(1000, (byte)x));
+	}
+
+	file.checkpoint();
+	for (int32_t x = 0; x < count; x += 2) {
+		file.erase(TTestIndex(x, 0, 0));
+	}
+
+	// not checkpointed yet
+	file.save(TTestIndex(count, 0, 0), TValueData(500, 1));
+	file.checkpoint();
+	file.save(TTestIndex(count + 1, 0, 0), TValueData(500, 2));
+	TEST_CHECK(file.getStats().deadBytes > 0);
+
+	std::atomic<bool> bDone(false);
+	std::atomic<int> badReads(0);
+	std::thread reader([&]() {
+		while (!bDone) {
+			for (int32_t x = 1; x < count; x += 2) {
+				if (!dataEquals(file.loadData(TTestIndex(x, 0, 0)), TValueData(1000, (byte)x))) badReads++;
+			}
+		}
+	});
+
+	const kvdb::TCompactionStats stats = file.compact();
+	bDone = true;
+	reader.join();
+
+	TEST_CHECK(stats.bSuccess);
+	TEST_CHECK(badReads == 0);
+	TEST_CHECK(stats.records == count / 2 + 2);
+	TEST_CHECK(stats.sizeAfter < stats.sizeBefore);
+	TEST_CHECK(stats.reclaimedBytes == stats.sizeBefore - stats.sizeAfter);
+	TEST_CHECK((ulong64)fileSize(fileName) == stats.sizeAfter);
+	TEST_CHECK(file.getStats().deadBytes == 0);
+	TEST_CHECK(fileSize(fileName + ".compact") == -1);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(count + 1, 0, 0)), TValueData(500, 2)));
+
+	// compacted file takes writes and opens again
+	file.save(TTestIndex(0, 0, 0), TValueData(100, 3));
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(file.size() == count / 2 + 3);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), TValueData(100, 3)));
+	TEST_CHECK(file.loadData(TTestIndex(2, 0, 0)) == nullptr);
+	for (int32_t x = 1; x < count; x += 2) {
+		TEST_CHECK(dataEquals(file.loadData(TTestIndex(x, 0, 0)), TValueData(1000, (byte)x)));
+	}
+}
+
+// snapshot keeps reading values as they were while writer replaces, patches, erases and adds pairs.
+// two snapshots see their own versions, extents of released snapshots are reused
+static void testSnapshotIsolation() {
+	const std::string fileName = "kvdb_test_snapshot.dat";
+	createFile(fileName);
+
+	const int count = 20;
+	TTestFile file;
+	file.setCacheSize(64 * 1024);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < count; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(512, (byte)x));
+	}
+
+	kvdb::TSnapshotPtr first = file.snapshot();
+
+	std::atomic<bool> bDone(false);
+	std::atomic<int> badReads(0);
+	std::thread reader([&]() {
+		while (!bDone) {
+			for (int32_t x = 0; x < count; x++) {
+				if (!dataEquals(file.loadData(TTestIndex(x, 0, 0), first), TValueData(512, (byte)x))) badReads++;
+			}
+
+			if (file.isExist(TTestIndex(count, 0, 0), first)) badReads++;
+		}
+	});
+
+	for (int round = 0; round < 20; round++) {
+		for (int32_t x = 0; x < count; x++) {
+			switch (x % 4) {
+				case 0: file.save(TTestIndex(x, 0, 0), TValueData(512, (byte)(100 + round))); break;
+				case 1: file.save(TTestIndex(x, 0, 0), TValueData(300 + round, (byte)(100 + round))); break;
+				case 2: file.patch(TTestIndex(x, 0, 0), 0, TValueData(16, (byte)(100 + round))); break;
+				default: file.erase(TTestIndex(x, 0, 0)); file.save(TTestIndex(x, 0, 0), TValueData(512, (byte)(100 + round))); break;
+			}
+		}
+
+		file.save(TTestIndex(count, 0, 0), TValueData(64, 1));
+		file.erase(TTestIndex(count, 0, 0));
+	}
+
+	bDone = true;
+	reader.join();
+	TEST_CHECK(badReads == 0);
+
+	file.save(TTestIndex(count, 0, 0), TValueData(64, 1));
+	kvdb::TSnapshotPtr second = file.snapshot();
+	file.erase(TTestIndex(0, 0, 0));
+	file.erase(TTestIndex(count, 0, 0));
+
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), first), TValueData(512, 0)));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), second), TValueData(512, 119)));
+	TEST_CHECK(file.loadData(TTestIndex(0, 0, 0)) == nullptr);
+	TEST_CHECK(!file.isExist(TTestIndex(count, 0, 0), first));
+	TEST_CHECK(file.isExist(TTestIndex(count, 0, 0), second));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(1, 0, 0), second), TValueData(319, 119)));
+	TEST_CHECK(file.getStats().retiredBytes > 0);
+
+	first.reset();
+	second.reset();
+	TEST_CHECK(file.getStats().retiredBytes == 0);
+
+	const long sizeBefore = fileSize(fileName);
+	for (int32_t x = 1; x < count; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(512, 1));
+	}
+
+	TEST_CHECK(fileSize(fileName) == sizeBefore);
+}
+
+// snapshot of write-ahead log file reads logged and patched versions by reference,
+// they are copied only when log is checkpointed. data extent read by snapshot is not rewritten
+static void testWalSnapshot() {
+	const std::string fileName = "kvdb_test_wal_snapshot.dat";
+	createFile(fileName);
+
+	const TTestIndex stored(0, 0, 0);
+	const TTestIndex logged(1, 0, 0);
+
+	TTestFile file;
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	file.save(stored, TValueData(64, 1));
+	file.checkpoint();
+	file.save(logged, TValueData(64, 2));
+	file.patch(logged, 0, TValueData(8, 3));
+
+	TValueData loggedBefore(64, 2);
+	std::fill(loggedBefore.begin(), loggedBefore.begin() + 8, 3);
+
+	kvdb::TSnapshotPtr snap = file.snapshot();
+	file.patch(stored, 8, TValueData(8, 4));
+	file.save(logged, TValueData(32, 5));
+	file.erase(stored);
+	file.save(logged, TValueData(16, 6));
+
+	TEST_CHECK(dataEquals(file.loadData(stored, snap), TValueData(64, 1)));
+	TEST_CHECK(dataEquals(file.loadData(logged, snap), loggedBefore));
+
+	file.checkpoint();
+	TEST_CHECK(dataEquals(file.loadData(stored, snap), TValueData(64, 1)));
+	TEST_CHECK(dataEquals(file.loadData(logged, snap), loggedBefore));
+	TEST_CHECK(file.loadData(stored) == nullptr);
+	TEST_CHECK(dataEquals(file.loadData(logged), TValueData(16, 6)));
+
+	// extents of released snapshot go to free space
+	snap.reset();
+	file.save(logged, TValueData(16, 7));
+	TEST_CHECK(file.getStats().retiredBytes == 0);
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(dataEquals(file.loadData(logged), TValueData(16, 7)));
+	TEST_CHECK(file.getStats().liveBytes < file.getStats().deadBytes);
+	file.close();
+}
+
+// committed groups of write-ahead log are replayed after crash, uncommitted and torn tail of log is dropped
+static void testWalReplay() {
+	const std::string fileName = "kvdb_test_wal_replay.dat";
+	const std::string crashFileName = "kvdb_test_wal_replay_crash.dat";
+	const std::string tornFileName = "kvdb_test_wal_replay_torn.dat";
+	createFile(fileName);
+
+	const TTestIndex stored(0, 0, 0);
+	const TTestIndex first(1, 0, 0);
+	const TTestIndex second(2, 0, 0);
+	const TTestIndex uncommitted(3, 0, 0);
+
+	{
+		TTestFile file;
+		file.setWriteAheadLog(true, kvdb::DURABILITY_GROUP, 16);
+		TEST_CHECK(file.open(fileName));
+		file.save(stored, TValueData(64, 1));
+		file.checkpoint();
+
+		file.save(first, TValueData(64, 2));
+		file.erase(stored);
+		file.commit();
+		const long firstCommitSize = fileSize(fileName + ".wal");
+
+		file.save(second, TValueData(64, 3));
+		file.patch(first, 0, TValueData(8, 4));
+		file.commit();
+		const long secondCommitSize = fileSize(fileName + ".wal");
+		file.save(uncommitted, TValueData(64, 5));
+
+		copyFile(fileName, crashFileName);
+		copyFile(fileName + ".wal", crashFileName + ".wal");
+
+		// log ends inside commit record of second group
+		copyFile(fileName, tornFileName);
+		copyFile(fileName + ".wal", tornFileName + ".wal");
+		std::filesystem::resize_file(tornFileName + ".wal", secondCommitSize - 6);
+		TEST_CHECK(secondCommitSize - 6 > firstCommitSize);
+	}
+
+	TValueData patched(64, 2);
+	std::fill(patched.begin(), patched.begin() + 8, 4);
+
+	{
+		TTestFile file;
+		file.setWriteAheadLog(true);
+		TEST_CHECK(file.open(crashFileName));
+		TEST_CHECK(fileSize(crashFileName + ".wal") == 0);
+		TEST_CHECK(file.loadData(stored) == nullptr);
+		TEST_CHECK(dataEquals(file.loadData(first), patched));
+		TEST_CHECK(dataEquals(file.loadData(second), TValueData(64, 3)));
+		TEST_CHECK(file.loadData(uncommitted) == nullptr);
+		TEST_CHECK(file.size() == 2);
+	}
+
+	{
+		TTestFile file;
+		file.setWriteAheadLog(true);
+		TEST_CHECK(file.open(tornFileName));
+		TEST_CHECK(file.loadData(stored) == nullptr);
+		TEST_CHECK(dataEquals(file.loadData(first), TValueData(64, 2)));
+		TEST_CHECK(file.loadData(second) == nullptr);
+		TEST_CHECK(file.size() == 1);
+	}
+
+	// replayed values are in data file, log is not needed anymore
+	TTestFile file;
+	TEST_CHECK(file.open(crashFileName));
+	TEST_CHECK(dataEquals(file.loadData(first), patched));
+	TEST_CHECK(dataEquals(file.loadData(second), TValueData(64, 3)));
+}
+
+static TValueData randomData(size_t length, uint32 seed) {
+	TValueData data(length);
+	for (size_t i = 0; i < length; i++) {
+		seed = seed * 1664525 + 1013904223;
+		data[i] = (byte)(seed >> 24);
+	}
+
+	return data;
+}
+
+// both LZ codecs decode what they encode: runs, long and far matches, lengths at token limits.
+// random data is not compressible and is stored raw, damaged block fails to decode
+static void testLzCodec() {
+	std::vector<TValueData> inputList;
+	inputList.push_back(TValueData(65 * 65 * 65, 0));
+	for (size_t length : { 15, 16, 19, 270, 271, 529, 1000 }) {
+		TValueData data = randomData(length, (uint32)length);
+		const TValueData tail = data;
+		data.insert(data.end(), tail.begin(), tail.end());
+		data.insert(data.end(), length, 7);
+		inputList.push_back(data);
+	}
+
+	// repeat is farther than max offset
+	const TValueData head = randomData(4096, 1);
+	TValueData far = head;
+	far.insert(far.end(), 70000, 0);
+	far.insert(far.end(), head.begin(), head.end());
+	inputList.push_back(far);
+
+	// voxel plane like runs
+	TValueData runs;
+	for (int i = 0; i < 300; i++) runs.insert(runs.end(), 1 + (i * 37) % 200, (byte)(i % 5));
+	inputList.push_back(runs);
+
+	for (uint32 codecId : { kvdb::CODEC_LZ, kvdb::CODEC_LZ_HIGH }) {
+		kvdb::TCodecPtr codec = kvdb::TCodecRegistry::instance().get(codecId);
+		TEST_CHECK(codec != nullptr);
+		if (codec == nullptr) continue;
+
+		for (const TValueData& input : inputList) {
+			TValueData encoded;
+			TEST_CHECK(codec->encode(input.data(), input.size(), encoded));
+			TEST_CHECK(encoded.size() < input.size());
+
+			TValueData decoded(input.size());
+			TEST_CHECK(codec->decode(encoded.data(), encoded.size(), decoded.data(), decoded.size()));
+			TEST_CHECK(decoded == input);
+
+			TValueData shorter(input.size() - 1);
+			TEST_CHECK(!codec->decode(encoded.data(), encoded.size(), shorter.data(), shorter.size()));
+			TEST_CHECK(!codec->decode(encoded.data(), encoded.size() / 2, decoded.data(), decoded.size()));
+		}
+
+		const TValueData noise = randomData(4096, 3);
+		TValueData encoded;
+		TEST_CHECK(!codec->encode(noise.data(), noise.size(), encoded));
+	}
+
+	const std::string fileName = "kvdb_test_lz.dat";
+	createFile(fileName);
+
+	const TValueData plain(64 * 1024, 1);
+	const TValueData noise = randomData(4096, 4);
+
+	TTestFile file;
+	file.setCodec(kvdb::CODEC_LZ);
+	TEST_CHECK(file.open(fileName));
+	file.save(TTestIndex(0, 0, 0), plain);
+	file.save(TTestIndex(1, 0, 0), noise);
+	TEST_CHECK(file.getStats().liveBytes < 1024 + noise.size() + 2 * sizeof(kvdb::TRecordHeader));
+
+	// stored raw, so it can be patched
+	TEST_CHECK(file.patch(TTestIndex(1, 0, 0), 0, TValueData(4, 2)));
+	TEST_CHECK(!file.patch(TTestIndex(0, 0, 0), 0, TValueData(4, 2)));
+	file.close();
+
+	TValueData patchedNoise = noise;
+	std::fill(patchedNoise.begin(), patchedNoise.begin() + 4, 2);
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), plain));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(1, 0, 0)), patchedNoise));
+	TEST_CHECK(viewEquals(file.loadView(TTestIndex(0, 0, 0)), plain));
+}
+
+static bool isMortonOrder(const std::vector<TTestIndex>& keyList) {
+	for (size_t i = 1; i < keyList.size(); i++) {
+		const TTestIndex& a = keyList[i - 1];
+		const TTestIndex& b = keyList[i];
+		if (kvdb::mortonCode(kvdb::coordsToKey(a.X, a.Y, a.Z)) > kvdb::mortonCode(kvdb::coordsToKey(b.X, b.Y, b.Z))) return false;
+	}
+
+	return true;
+}
+
+// batch and compaction write records in Z-order of key, negative indexes included.
+// range load returns pairs inside box with bounds, logged and cached ones too, and reads neighbour records at once
+static void testRangeMorton() {
+	const std::string fileName = "kvdb_test_morton.dat";
+	createFile(fileName);
+
+	TEST_CHECK(kvdb::mortonCode(kvdb::coordsToKey(-1, 0, 0)) < kvdb::mortonCode(kvdb::coordsToKey(0, 0, 0)));
+	TEST_CHECK(kvdb::mortonCode(kvdb::coordsToKey(1, 1, 1)) < kvdb::mortonCode(kvdb::coordsToKey(2, 0, 0)));
+
+	std::vector<std::pair<TTestIndex, TValueData>> batch;
+	for (int32_t x = 3; x >= -4; x--) {
+		for (int32_t y = 3; y >= -4; y--) {
+			for (int32_t z = 1; z >= -2; z--) {
+				batch.push_back({ TTestIndex(x, y, z), TValueData(256, (byte)(x * 16 + y * 4 + z)) });
+			}
+		}
+	}
+
+	TTestFile file;
+	file.setPlacement(kvdb::PLACEMENT_MORTON);
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(file.saveBatch(batch));
+	file.checkpoint();
+	TEST_CHECK(isMortonOrder(file.keys(true)));
+	TEST_CHECK(file.keys(true).size() == batch.size());
+
+	auto inBox = [](const std::vector<std::pair<TTestIndex, TValueDataPtr>>& range, int32_t lo, int32_t hi) {
+		for (const auto& it : range) {
+			const TTestIndex& k = it.first;
+			if (k.X < lo || k.X > hi || k.Y < lo || k.Y > hi || k.Z < lo || k.Z > hi) return false;
+			if (!dataEquals(it.second, TValueData(256, (byte)(k.X * 16 + k.Y * 4 + k.Z)))) return false;
+		}
+
+		return true;
+	};
+
+	// 2^3 box of Z-order is one block of records
+	file.resetStats();
+	auto range = file.loadRange(TTestIndex(-2, -2, -2), TTestIndex(-1, -1, -1));
+	TEST_CHECK(range.size() == 8);
+	TEST_CHECK(inBox(range, -2, -1));
+	TEST_CHECK(file.getStats().dataIo.readOps == 1);
+
+	// box larger than file is scanned. erased pair is missing, logged pair is read from log
+	file.erase(TTestIndex(0, 0, 0));
+	file.save(TTestIndex(1, 1, 1), TValueData(256, (byte)(16 + 4 + 1)));
+	range = file.loadRange(TTestIndex(-100, -100, -100), TTestIndex(100, 100, 100));
+	TEST_CHECK(range.size() == batch.size() - 1);
+
+	range = file.loadRange(TTestIndex(0, 0, 0), TTestIndex(1, 1, 1));
+	TEST_CHECK(range.size() == 7);
+	TEST_CHECK(inBox(range, 0, 1));
+	TEST_CHECK(file.loadRange(TTestIndex(1, 1, 1), TTestIndex(0, 0, 0)).empty());
+
+	// later saves go to end of file, compaction puts them back in order
+	file.save(TTestIndex(-5, -5, -5), TValueData(512, 1));
+	file.checkpoint();
+	TEST_CHECK(!isMortonOrder(file.keys(true)));
+	TEST_CHECK(file.compact().bSuccess);
+	TEST_CHECK(isMortonOrder(file.keys(true)));
+	range = file.loadRange(TTestIndex(-4, -4, -4), TTestIndex(3, 3, 3));
+	TEST_CHECK(range.size() == batch.size() - 1);
+	TEST_CHECK(inBox(range, -4, 3));
+}
+
+// async saves are applied in call order on shared I/O pool, loads after ready save see it.
+// close waits for queued work
+static void testAsync() {
+	const std::string fileName = "kvdb_test_async.dat";
+	const std::string otherFileName = "kvdb_test_async_other.dat";
+	createFile(fileName);
+	createFile(otherFileName);
+
+	kvdb::TIoThreadPoolPtr pool = std::make_shared<kvdb::TIoThreadPool>(2);
+	TTestFile file;
+	TTestFile other;
+	file.setIoThreadPool(pool);
+	other.setIoThreadPool(pool);
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(other.open(otherFileName));
+
+	std::vector<std::future<void>> saveList;
+	for (int i = 0; i < 100; i++) {
+		saveList.push_back(file.saveAsync(TTestIndex(0, 0, 0), TValueData(64 + i, (byte)i)));
+		saveList.push_back(other.saveAsync(TTestIndex(i, 0, 0), TValueData(64, (byte)i)));
+	}
+
+	saveList[198].wait();
+	TEST_CHECK(dataEquals(file.loadAsync(TTestIndex(0, 0, 0)).get(), TValueData(163, 99)));
+
+	for (std::future<void>& save : saveList) save.wait();
+	TEST_CHECK(other.size() == 100);
+
+	const std::thread::id callerId = std::this_thread::get_id();
+	std::promise<bool> callbackDone;
+	other.loadAsync(TTestIndex(5, 0, 0), [&](const TTestIndex& k, TValueDataPtr dataPtr) {
+		callbackDone.set_value(k == TTestIndex(5, 0, 0) && dataEquals(dataPtr, TValueData(64, 5)) && std::this_thread::get_id() != callerId);
+	});
+
+	TEST_CHECK(callbackDone.get_future().get());
+	TEST_CHECK(file.loadAsync(TTestIndex(1, 0, 0)).get() == nullptr);
+
+	// futures are dropped, close still finishes the saves
+	for (int i = 0; i < 100; i++) {
+		other.saveAsync(TTestIndex(i, 1, 0), TValueData(64, (byte)i));
+	}
+
+	other.close();
+	TEST_CHECK(other.open(otherFileName));
+	TEST_CHECK(other.size() == 200);
+	TEST_CHECK(dataEquals(other.loadData(TTestIndex(99, 1, 0)), TValueData(64, 99)));
+}
+
+// every live key is enumerated once and preloaded once by parallel workers, logged values included.
+// listed missing keys get nullptr
+static void testPreload() {
+	const std::string fileName = "kvdb_test_preload.dat";
+	const std::string columnFileName = "kvdb_test_preload_columns.dat";
+	createFile(fileName);
+	createFile(columnFileName);
+
+	const int count = 500;
+	TTestFile file;
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < count; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(100 + x % 50, (byte)x));
+	}
+
+	file.checkpoint();
+	file.erase(TTestIndex(0, 0, 0));
+	file.save(TTestIndex(count, 0, 0), TValueData(100, 1));
+
+	const std::vector<TTestIndex> keyList = file.keys(true);
+	TEST_CHECK(keyList.size() == count);
+	TEST_CHECK(keyList.back() == TTestIndex(count, 0, 0));
+
+	std::mutex resultMutex;
+	std::unordered_map<TTestIndex, int> seenMap;
+	int badValues = 0;
+	file.preload(4, [&](const TTestIndex& k, TValueDataPtr dataPtr) {
+		std::unique_lock<std::mutex> lock(resultMutex);
+		seenMap[k]++;
+		const TValueData expected = (k.X == count) ? TValueData(100, 1) : TValueData(100 + k.X % 50, (byte)k.X);
+		if (!dataEquals(dataPtr, expected)) badValues++;
+	});
+
+	TEST_CHECK(seenMap.size() == count);
+	TEST_CHECK(badValues == 0);
+	TEST_CHECK(seenMap.find(TTestIndex(0, 0, 0)) == seenMap.end());
+	bool bOnce = true;
+	for (const auto& it : seenMap) bOnce = bOnce && it.second == 1;
+	TEST_CHECK(bOnce);
+
+	int missing = 0;
+	file.preload({ TTestIndex(0, 0, 0), TTestIndex(-1, 0, 0), TTestIndex(1, 0, 0) }, 2, [&](const TTestIndex& k, TValueDataPtr dataPtr) {
+		std::unique_lock<std::mutex> lock(resultMutex);
+		if (dataPtr == nullptr) missing++;
+		if (k == TTestIndex(1, 0, 0) && !dataEquals(dataPtr, TValueData(101, 1))) badValues++;
+	});
+
+	TEST_CHECK(missing == 2);
+	TEST_CHECK(badValues == 0);
+
+	// the same for one column of column file
+	kvdb::KvColumnFile<TTestIndex> columnFile;
+	TEST_CHECK(columnFile.open(columnFileName));
+	for (int32_t x = 0; x < 100; x++) {
+		columnFile.save(TTestIndex(x, 0, 0), 0, TValueData(64, (byte)x));
+		if (x % 2 == 0) columnFile.save(TTestIndex(x, 0, 0), 1, TValueData(32, (byte)x));
+	}
+
+	int loaded = 0;
+	columnFile.preload(columnFile.keys(1, true), 1, 3, [&](const TTestIndex& k, TValueDataPtr dataPtr) {
+		std::unique_lock<std::mutex> lock(resultMutex);
+		loaded++;
+		if (!dataEquals(dataPtr, TValueData(32, (byte)k.X))) badValues++;
+	});
+
+	TEST_CHECK(loaded == 50);
+	TEST_CHECK(badValues == 0);
+}
+
+static void removeBackup(const std::string& backupFile, uint32 lastSeq) {
+	std::remove(kvdb::backupManifestFile(backupFile).c_str());
+	for (uint32 seq = 1; seq <= lastSeq; seq++) {
+		std::remove(kvdb::backupStepFile(backupFile, seq).c_str());
+	}
+}
+
+// incremental backups carry changed and erased keys only, any backup of manifest is restored.
+// torn manifest entry is dropped and overwritten by next full backup, first backup after open is full
+static void testBackupRestore() {
+	const std::string fileName = "kvdb_test_backup.dat";
+	const std::string backupFileName = "kvdb_test_backup.bak";
+	const std::string restoredFileName = "kvdb_test_backup_restored.dat";
+	createFile(fileName);
+	removeBackup(backupFileName, 5);
+
+	auto restoredEquals = [&](uint32 seq, const std::unordered_map<TTestIndex, TValueData>& expected) {
+		std::remove(restoredFileName.c_str());
+		if (!TTestFile::restoreBackup(backupFileName, restoredFileName, seq)) return false;
+
+		TTestFile restored;
+		if (!restored.open(restoredFileName) || restored.size() != (int)expected.size()) return false;
+		for (const auto& it : expected) {
+			if (!dataEquals(restored.loadData(it.first), it.second)) return false;
+		}
+
+		return true;
+	};
+
+	std::unordered_map<TTestIndex, TValueData> state;
+	TTestFile file;
+	file.setWriteAheadLog(true);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < 10; x++) {
+		state[TTestIndex(x, 0, 0)] = TValueData(128, (byte)x);
+		file.save(TTestIndex(x, 0, 0), state[TTestIndex(x, 0, 0)]);
+	}
+
+	kvdb::TBackupStats stats = file.backup(backupFileName);
+	TEST_CHECK(stats.bSuccess && stats.bFull && stats.seq == 1 && stats.pairs == 10);
+	const auto firstState = state;
+
+	state[TTestIndex(1, 0, 0)] = TValueData(64, 11);
+	state[TTestIndex(10, 0, 0)] = TValueData(64, 12);
+	state.erase(TTestIndex(2, 0, 0));
+	file.save(TTestIndex(1, 0, 0), state[TTestIndex(1, 0, 0)]);
+	file.save(TTestIndex(10, 0, 0), state[TTestIndex(10, 0, 0)]);
+	file.erase(TTestIndex(2, 0, 0));
+	file.save(TTestIndex(11, 0, 0), TValueData(64, 13));
+	file.erase(TTestIndex(11, 0, 0));
+
+	stats = file.backup(backupFileName);
+	TEST_CHECK(stats.bSuccess && !stats.bFull && stats.seq == 2);
+	TEST_CHECK(stats.pairs == 2 && stats.erased == 2);
+	const auto secondState = state;
+
+	state[TTestIndex(3, 0, 0)] = TValueData(32, 14);
+	file.patch(TTestIndex(3, 0, 0), 0, TValueData(0));
+	file.save(TTestIndex(3, 0, 0), state[TTestIndex(3, 0, 0)]);
+	stats = file.backup(backupFileName);
+	TEST_CHECK(stats.bSuccess && stats.seq == 3 && stats.pairs == 1);
+
+	TEST_CHECK(restoredEquals(1, firstState));
+	TEST_CHECK(restoredEquals(2, secondState));
+	TEST_CHECK(restoredEquals(UINT_MAX, state));
+
+	// interrupted backup leaves partial entry at end of manifest
+	const std::string manifestFile = kvdb::backupManifestFile(backupFileName);
+	const long manifestSize = fileSize(manifestFile);
+	std::filesystem::resize_file(manifestFile, manifestSize - 4);
+	TEST_CHECK(restoredEquals(UINT_MAX, secondState));
+
+	state[TTestIndex(4, 0, 0)] = TValueData(32, 15);
+	file.save(TTestIndex(4, 0, 0), state[TTestIndex(4, 0, 0)]);
+	// changes of lost backup are not in chain anymore, so it is full
+	stats = file.backup(backupFileName);
+	TEST_CHECK(stats.bSuccess && stats.bFull && stats.seq == 3);
+	TEST_CHECK(restoredEquals(UINT_MAX, state));
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	stats = file.backup(backupFileName);
+	TEST_CHECK(stats.bSuccess && stats.bFull && stats.seq == 4 && stats.pairs == state.size());
+	TEST_CHECK(restoredEquals(4, state));
+	TEST_CHECK(restoredEquals(2, secondState));
+
+	// restore of missing backup leaves file as is
+	TEST_CHECK(!TTestFile::restoreBackup(backupFileName + ".missing", restoredFileName));
+	TTestFile restored;
+	TEST_CHECK(restored.open(restoredFileName));
+	TEST_CHECK(restored.size() == (int)secondState.size());
+}
+
+// terrain storage with memory mapping, write-ahead log, patched voxel column and compressed objects column
+static void testColumnPatch() {
+	const std::string fileName = "kvdb_test_columns.dat";
+	createFile(fileName);
+
+	const uint32 vdColumn = 0;
+	const uint32 objColumn = 2;
+	const TTestIndex index(0, 0, 0);
+
+	kvdb::KvColumnFile<TTestIndex> file;
+	file.setMemoryMapping(true);
+	file.setWriteAheadLog(true);
+	file.setColumnCodec(vdColumn, kvdb::CODEC_NONE);
+	file.setColumnCodec(objColumn, kvdb::CODEC_LZ);
+	TEST_CHECK(file.open(fileName));
+
+	TValueData vd(65 * 65 * 65, 1);
+	const TValueData obj(4096, 2);
+	file.save(index, vdColumn, vd);
+	file.save(index, objColumn, obj);
+
+	// changed plane goes to patched copy of column value in write-ahead log mode, other columns stay as is
+	const TValueData vdBefore = vd;
+	kvdb::TSnapshotPtr snap = file.snapshot();
+	TEST_CHECK(file.patch(index, vdColumn, { { 65 * 65 * 3, TValueData(65 * 65, 5) } }));
+	std::fill(vd.begin() + 65 * 65 * 3, vd.begin() + 65 * 65 * 4, 5);
+	TEST_CHECK(dataEquals(file.loadData(index, vdColumn), vd));
+	TEST_CHECK(viewEquals(file.loadView(index, vdColumn), vd));
+	TEST_CHECK(dataEquals(file.loadData(index, objColumn), obj));
+
+	file.checkpoint();
+	TEST_CHECK(dataEquals(file.loadData(index, vdColumn), vd));
+	TEST_CHECK(dataEquals(file.loadData(index, vdColumn, snap), vdBefore));
+	snap.reset();
+
+	// compressed column is saved whole
+	TEST_CHECK(!file.patch(index, objColumn, { { 0, TValueData(16, 3) } }));
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(viewEquals(file.loadView(index, vdColumn), vd));
+	TEST_CHECK(viewEquals(file.loadView(index, objColumn), obj));
+	file.close();
+}
+
+// each column value is its own extent: saving one column doesn't write others,
+// column keys come from index, extents survive reopen, compaction and backup
+static void testColumnExtents() {
+	const std::string fileName = "kvdb_test_column_extents.dat";
+	const std::string backupFileName = "kvdb_test_column_extents.bak";
+	const std::string restoredFileName = "kvdb_test_column_extents_restored.dat";
+	createFile(fileName);
+	std::remove(backupFileName.c_str());
+	std::remove(kvdb::backupStepFile(backupFileName, 1).c_str());
+
+	const uint32 vdColumn = 0;
+	const uint32 objColumn = 2;
+	const TValueData vd(256 * 1024, 1);
+
+	kvdb::KvColumnFile<TTestIndex> file;
+	file.setColumnCodec(objColumn, kvdb::CODEC_LZ);
+	TEST_CHECK(file.open(fileName));
+
+	for (int32_t x = 0; x < 4; x++) {
+		file.save(TTestIndex(x, 0, 0), vdColumn, vd);
+	}
+
+	file.save(TTestIndex(0, 0, 0), objColumn, TValueData(1024, 2));
+	file.save(TTestIndex(5, 0, 0), objColumn, TValueData(1024, 3));
+
+	// small column of row with large one
+	const long sizeBefore = fileSize(fileName);
+	for (int i = 0; i < 8; i++) {
+		file.save(TTestIndex(0, 0, 0), objColumn, TValueData(1024, (byte)(10 + i)));
+	}
+
+	TEST_CHECK(fileSize(fileName) - sizeBefore < (long)vd.size());
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), vdColumn), vd));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), objColumn), TValueData(1024, 17)));
+
+	TEST_CHECK(file.keys(vdColumn).size() == 4);
+	TEST_CHECK(file.keys(objColumn).size() == 2);
+	TEST_CHECK(file.keys(1).empty());
+	TEST_CHECK(file.isExist(TTestIndex(5, 0, 0), objColumn));
+	TEST_CHECK(!file.isExist(TTestIndex(5, 0, 0), vdColumn));
+	TEST_CHECK(file.size() == 5);
+
+	// the last column of row removes row
+	file.erase(TTestIndex(5, 0, 0), objColumn);
+	file.erase(TTestIndex(6, 0, 0), objColumn);
+	TEST_CHECK(file.size() == 4);
+	TEST_CHECK(file.keys(objColumn).size() == 1);
+
+	// other column and other rows are read in range
+	file.erase(TTestIndex(3, 0, 0), vdColumn);
+	const auto range = file.loadRange(TTestIndex(0, 0, 0), TTestIndex(3, 0, 0), vdColumn);
+	TEST_CHECK(range.size() == 3);
+	for (const auto& it : range) TEST_CHECK(dataEquals(it.second, vd));
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	TEST_CHECK(file.keys(vdColumn).size() == 3);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), objColumn), TValueData(1024, 17)));
+
+	const kvdb::TCompactionStats compaction = file.compact();
+	TEST_CHECK(compaction.bSuccess);
+	TEST_CHECK(compaction.sizeAfter < compaction.sizeBefore);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(2, 0, 0), vdColumn), vd));
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0), objColumn), TValueData(1024, 17)));
+
+	TEST_CHECK(file.backup(backupFileName).bSuccess);
+	file.close();
+
+	// restored rows get column extents on open
+	std::remove(restoredFileName.c_str());
+	TEST_CHECK(kvdb::KvColumnFile<TTestIndex>::restoreBackup(backupFileName, restoredFileName));
+	kvdb::KvColumnFile<TTestIndex> restored;
+	TEST_CHECK(restored.open(restoredFileName));
+	TEST_CHECK(restored.keys(vdColumn).size() == 3);
+	TEST_CHECK(dataEquals(restored.loadData(TTestIndex(1, 0, 0), vdColumn), vd));
+	TEST_CHECK(dataEquals(restored.loadData(TTestIndex(0, 0, 0), objColumn), TValueData(1024, 17)));
+	restored.close();
+
+	TEST_CHECK(restored.open(restoredFileName));
+	TEST_CHECK(restored.keys(objColumn).size() == 1);
+	restored.close();
+}
+
+// least recently used regions are closed over limit and when idle, closed region is opened again on access.
+// snapshots and backups of region files fail with logged error
+static void testRegions() {
+	const std::string dirName = "kvdb_test_regions/";
+	std::filesystem::remove_all(dirName);
+	std::filesystem::create_directory(dirName);
+
+	std::vector<std::string> errorList;
+	kvdb::errorLog() = [&](const std::string& message) { errorList.push_back(message); };
+
+	auto regionFile = std::make_shared<kvdb::KvRegionFile<TTestIndex>>();
+	regionFile->setRegionSize(4);
+	regionFile->setMaxOpenRegions(2);
+	regionFile->setWriteAheadLog(true);
+	TEST_CHECK(regionFile->open(dirName));
+
+	for (int32_t x = 0; x < 4; x++) {
+		TEST_CHECK(regionFile->save(TTestIndex(x * 4, 0, 0), 0, TValueData(64, (byte)x)));
+		TEST_CHECK(regionFile->openCount() <= 2);
+	}
+
+	TEST_CHECK(regionFile->regionCount() == 4);
+	for (int32_t x = 0; x < 4; x++) {
+		TEST_CHECK(dataEquals(regionFile->loadData(TTestIndex(x * 4, 0, 0), 0), TValueData(64, (byte)x)));
+	}
+
+	TEST_CHECK(regionFile->closeIdle(0) == 0);
+	TEST_CHECK(dataEquals(regionFile->loadData(TTestIndex(4, 0, 0), 0), TValueData(64, 1)));
+	TEST_CHECK(regionFile->openCount() == 1);
+
+	kvdb::KvColumn<TTestIndex> column;
+	column.bind(regionFile, 0);
+	TEST_CHECK(!column.hasSnapshots());
+	TEST_CHECK(column.snapshot() == nullptr);
+	TEST_CHECK(!column.backup(dirName + "backup.dat").bSuccess);
+	TEST_CHECK(errorList.size() == 2);
+	column.close();
+
+	TEST_CHECK(regionFile->open(dirName));
+	TEST_CHECK(regionFile->regionCount() == 4);
+	TEST_CHECK(dataEquals(regionFile->loadData(TTestIndex(12, 0, 0), 0), TValueData(64, 3)));
+	regionFile->close();
+
+	kvdb::errorLog() = nullptr;
+}
+
+static TKeyData testKey(int32_t x) {
+	return kvdb::coordsToKey(x, 0, 0);
+}
+
+// cache evicts least recently used values over byte budget, file keeps cache in step with saves and erases
+static void testValueCache() {
+	const ulong64 entrySize = 1000 + KVDB_CACHE_ENTRY_OVERHEAD;
+
+	kvdb::TValueCache cache;
+	cache.setCapacity(entrySize * 3);
+	for (int32_t x = 0; x < 3; x++) {
+		cache.put(testKey(x), std::make_shared<TValueData>(1000, (byte)x));
+	}
+
+	TEST_CHECK(cache.get(testKey(0)) != nullptr);
+	cache.put(testKey(3), std::make_shared<TValueData>(1000, 3));
+	TEST_CHECK(cache.get(testKey(1)) == nullptr);
+	TEST_CHECK(dataEquals(cache.get(testKey(0)), TValueData(1000, 0)));
+	TEST_CHECK(cache.getStats().entries == 3);
+	TEST_CHECK(cache.getStats().usedBytes == entrySize * 3);
+
+	// value over budget is not cached and evicts nothing
+	cache.put(testKey(4), std::make_shared<TValueData>(entrySize * 3, 4));
+	TEST_CHECK(cache.get(testKey(4)) == nullptr);
+	TEST_CHECK(cache.getStats().entries == 3);
+
+	// the same key replaces its entry
+	cache.put(testKey(2), std::make_shared<TValueData>(500, 5));
+	TEST_CHECK(cache.getStats().usedBytes == entrySize * 2 + 500 + KVDB_CACHE_ENTRY_OVERHEAD);
+
+	// least recently used of 3, 0, 2 is 3
+	cache.get(testKey(3));
+	cache.get(testKey(2));
+	cache.setCapacity(entrySize * 2);
+	TEST_CHECK(cache.get(testKey(0)) == nullptr);
+	TEST_CHECK(cache.get(testKey(3)) != nullptr);
+	TEST_CHECK(cache.getStats().usedBytes <= entrySize * 2);
+
+	const std::string fileName = "kvdb_test_cache.dat";
+	createFile(fileName);
+
+	TTestFile file;
+	file.setCacheSize(entrySize * 2);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < 4; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(1000, (byte)x));
+	}
+
+	TEST_CHECK(file.getCacheStats().entries == 2);
+	TEST_CHECK(file.getCacheStats().usedBytes <= entrySize * 2);
+
+	const kvdb::TCacheStats before = file.getCacheStats();
+	TValueDataPtr first = file.loadData(TTestIndex(3, 0, 0));
+	TEST_CHECK(file.loadData(TTestIndex(3, 0, 0)) == first);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), TValueData(1000, 0)));
+	TEST_CHECK(file.getCacheStats().hits == before.hits + 2);
+	TEST_CHECK(file.getCacheStats().misses == before.misses + 1);
+
+	file.erase(TTestIndex(3, 0, 0));
+	TEST_CHECK(file.loadData(TTestIndex(3, 0, 0)) == nullptr);
+	TEST_CHECK(dataEquals(first, TValueData(1000, 3)));
+
+	file.patch(TTestIndex(0, 0, 0), 0, TValueData(4, 9));
+	TValueData patched(1000, 0);
+	std::fill(patched.begin(), patched.begin() + 4, 9);
+	TEST_CHECK(dataEquals(file.loadData(TTestIndex(0, 0, 0)), patched));
+	file.close();
+	TEST_CHECK(file.getCacheStats().entries == 0);
+}
+
+// keys go to regions by floor division, batches and ranges span regions, erase only batch creates nothing.
+// idle regions close by time, readers of many threads share regions while they are closed and opened over limit
+static void testRegionLayout() {
+	TEST_CHECK(kvdb::regionCoord(3, 4) == 0);
+	TEST_CHECK(kvdb::regionCoord(4, 4) == 1);
+	TEST_CHECK(kvdb::regionCoord(-1, 4) == -1);
+	TEST_CHECK(kvdb::regionCoord(-4, 4) == -1);
+	TEST_CHECK(kvdb::regionCoord(-5, 4) == -2);
+
+	const std::string dirName = "kvdb_test_region_layout/";
+	std::filesystem::remove_all(dirName);
+	std::filesystem::create_directory(dirName);
+
+	auto valueOf = [](int32_t x) { return TValueData(64, (byte)(x + 100)); };
+
+	kvdb::KvRegionFile<TTestIndex> regionFile;
+	regionFile.setRegionSize(4);
+	regionFile.setMaxOpenRegions(2);
+	TEST_CHECK(regionFile.open(dirName));
+
+	std::vector<std::pair<TTestIndex, TValueData>> batch;
+	for (int32_t x = -8; x < 8; x++) {
+		batch.push_back({ TTestIndex(x, 0, 0), valueOf(x) });
+	}
+
+	TEST_CHECK(regionFile.saveBatch(batch, 0));
+	TEST_CHECK(regionFile.regionCount() == 4);
+	TEST_CHECK(regionFile.openCount() <= 2);
+	TEST_CHECK(regionFile.keys(0).size() == 16);
+
+	TEST_CHECK(regionFile.saveBatch({ { TTestIndex(100, 0, 0), TValueData() } }, 0));
+	TEST_CHECK(regionFile.regionCount() == 4);
+
+	const auto range = regionFile.loadRange(TTestIndex(-5, 0, 0), TTestIndex(4, 0, 0), 0);
+	TEST_CHECK(range.size() == 10);
+	for (const auto& it : range) {
+		TEST_CHECK(it.first.X >= -5 && it.first.X <= 4 && dataEquals(it.second, valueOf(it.first.X)));
+	}
+
+	// the other region is used later, so only it stays open
+	TEST_CHECK(regionFile.loadData(TTestIndex(-8, 0, 0), 0) != nullptr);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	TEST_CHECK(regionFile.loadData(TTestIndex(7, 0, 0), 0) != nullptr);
+	TEST_CHECK(regionFile.openCount() == 2);
+	TEST_CHECK(regionFile.closeIdle(100) == 1);
+	TEST_CHECK(regionFile.closeIdle(0) == 0);
+
+	std::atomic<int> badReads(0);
+	std::vector<std::thread> readerList;
+	for (int t = 0; t < 4; t++) {
+		readerList.emplace_back([&, t]() {
+			uint32 seed = t + 1;
+			for (int i = 0; i < 2000; i++) {
+				seed = seed * 1664525 + 1013904223;
+				const int32_t x = (int32_t)(seed >> 16) % 16 - 8;
+				if (!dataEquals(regionFile.loadData(TTestIndex(x, 0, 0), 0), valueOf(x))) badReads++;
+			}
+		});
+	}
+
+	// regions in use by other readers are kept open over limit, next access closes them
+	for (std::thread& reader : readerList) reader.join();
+	TEST_CHECK(badReads == 0);
+	TEST_CHECK(dataEquals(regionFile.loadData(TTestIndex(0, 0, 0), 0), valueOf(0)));
+	TEST_CHECK(regionFile.openCount() <= 2);
+	regionFile.close();
+
+	TEST_CHECK(regionFile.open(dirName));
+	TEST_CHECK(regionFile.regionCount() == 4);
+	TEST_CHECK(regionFile.openCount() == 0);
+	TEST_CHECK(dataEquals(regionFile.loadData(TTestIndex(-5, 0, 0), 0), valueOf(-5)));
+	TEST_CHECK(regionFile.loadData(TTestIndex(100, 0, 0), 0) == nullptr);
+	TEST_CHECK(regionFile.openCount() == 1);
+}
+
+// prefetched and range loaded values are served from cache by memory mapped view
+static void testPrefetch() {
+	const std::string fileName = "kvdb_test_prefetch.dat";
+	createFile(fileName);
+
+	TTestFile file;
+	file.setMemoryMapping(true);
+	file.setCacheSize(1024 * 1024);
+	TEST_CHECK(file.open(fileName));
+	for (int32_t x = 0; x < 4; x++) {
+		file.save(TTestIndex(x, 0, 0), TValueData(256, (byte)x));
+	}
+	file.close();
+
+	TEST_CHECK(file.open(fileName));
+	file.prefetch(TTestIndex(0, 0, 0));
+	for (int i = 0; i < 1000 && file.getCacheStats().entries == 0; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	TEST_CHECK(file.getCacheStats().entries == 1);
+	const ulong64 hitsBefore = file.getCacheStats().hits;
+	TEST_CHECK(viewEquals(file.loadView(TTestIndex(0, 0, 0)), TValueData(256, 0)));
+	TEST_CHECK(file.getCacheStats().hits == hitsBefore + 1);
+
+	TEST_CHECK(file.loadRange(TTestIndex(1, 0, 0), TTestIndex(3, 0, 0)).size() == 3);
+	TEST_CHECK(viewEquals(file.loadView(TTestIndex(2, 0, 0)), TValueData(256, 2)));
+	TEST_CHECK(file.getCacheStats().hits == hitsBefore + 2);
+
+	// saved value replaces cached one
+	file.save(TTestIndex(2, 0, 0), TValueData(128, 9));
+	TEST_CHECK(viewEquals(file.loadView(TTestIndex(2, 0, 0)), TValueData(128, 9)));
+	file.close();
+}
+
+typedef struct TTestCase {
+	const char* name;
+	void (*run)();
+} TTestCase;
+
+static TTestCase testList[] = {
+	{ "view_save", testViewAcrossSave },
+	{ "view_checkpoint", testViewAcrossCheckpoint },
+	{ "key_tables", testKeyTables },
+	{ "free_space", testFreeSpace },
+	{ "damaged_tables", testDamagedTables },
+	{ "save_batch", testSaveBatch },
+	{ "snapshot", testSnapshotIsolation },
+	{ "wal_snapshot", testWalSnapshot },
+	{ "wal_replay", testWalReplay },
+	{ "compaction", testCompaction },
+	{ "lz_codec", testLzCodec },
+	{ "range_morton", testRangeMorton },
+	{ "async", testAsync },
+	{ "preload", testPreload },
+	{ "backup_restore", testBackupRestore },
+	{ "column_patch", testColumnPatch },
+	{ "column_extents", testColumnExtents },
+	{ "regions", testRegions },
+	{ "region_layout", testRegionLayout },
+	{ "value_cache", testValueCache },
+	{ "prefetch", testPrefetch }
+};
+
+int main(int argc, char* argv[]) {
+	int failedTests = 0;
+
+	for (const TTestCase& test : testList) {
+		if (argc > 1 && strcmp(argv[1], test.name) != 0) continue;
+
+		const int checksBefore = failedChecks;
+		test.run();
+
+		const bool bPassed = failedChecks == checksBefore;
+		printf("%s %s\n", bPassed ? "ok    " : "FAILED", test.name);
+		if (!bPassed) failedTests++;
+	}
+
+	return failedTests;
+}
@@ -0,0 +1,211 @@
+//
+// Standalone voxel storage benchmark (no engine dependencies)
+//
+// voxel layout is compile-time, build once per VD_BRICK_LAYOUT:
+// build: g++ -std=c++17 -O2 -pthread -DVD_BRICK_LAYOUT=0 -I../EngineStub -I../../Source/UnrealSandboxTerrain/Public voxel_bench.cpp ../../Source/UnrealSandboxTerrain/Private/VoxelBufferPool.cpp -o voxel_bench_tiled
+// build: g++ -std=c++17 -O2 -pthread -DVD_BRICK_LAYOUT=1 -I../EngineStub -I../../Source/UnrealSandboxTerrain/Public voxel_bench.cpp ../../Source/UnrealSandboxTerrain/Private/VoxelBufferPool.cpp -o voxel_bench_morton
+// usage: ./voxel_bench_tiled [zones]
+//
+// zones are generated from synthetic height field around ground level, like terrain generator fills them.
+// reports per zone: generation by voxel writes, import of linear voxels (load path),
+// cell corner reads and cell extraction (corner case and surface material) as mesher does, memory of bricks
+//
+
+#include "VoxelBrickArray.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define BENCH_ZONE_DIMENSION 65 // USBT_ZONE_DIMENSION
+#define BENCH_ZONE_SIZE 1000.0 // USBT_ZONE_SIZE
+#define BENCH_ISOLEVEL 127
+
+typedef struct TBenchZone {
+	TBrickArray<TDensityVal> density;
+	TPaletteBrickArray material;
+	bool bMixed = false;
+} TBenchZone;
+
+typedef struct TBenchTimes {
+	double generation = 0;
+	double import = 0;
+	double corners = 0;
+	double cells = 0;
+	unsigned long long memory = 0;
+	unsigned long long surfaceCells = 0;
+	unsigned long long sum = 0;
+} TBenchTimes;
+
+//============================================================================
+// Helpers
+//============================================================================
+
+static double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double groundLevel(double x, double y) {
+	return 200 * std::sin(x / 700) + 150 * std::cos(y / 500) + 80 * std::sin((x + y) / 230);
+}
+
+// grass on surface, dirt below, stone with ore veins deeper
+static unsigned short materialAt(double x, double y, double z, double depth) {
+	if (depth < 40) return 2;
+	if (depth < 300) return 1;
+	if (std::sin(x / 90) * std::cos(y / 70) * std::sin(z / 110) > 0.6) return 10 + (unsigned short)(std::fabs(x + y) / 300) % 4;
+	return 4;
+}
+
+static void zonePos(int n, double pos[3]) {
+	pos[0] = (n % 5 - 2) * BENCH_ZONE_SIZE;
+	pos[1] = ((n / 5) % 5 - 2) * BENCH_ZONE_SIZE;
+	pos[2] = ((n / 25) % 2 - 1) * BENCH_ZONE_SIZE;
+}
+
+//============================================================================
+// Benchmarks
+//============================================================================
+
+static void generateZone(int n, TBenchZone& zone, std::vector<TDensityVal>& linearDensity, std::vector<unsigned short>& linearMaterial) {
+	const int num = BENCH_ZONE_DIMENSION;
+	const double step = BENCH_ZONE_SIZE / (num - 1);
+	double origin[3];
+	zonePos(n, origin);
+
+	zone.density.allocate(num, 0);
+	zone.material.allocate(num, 0);
+	linearDensity.assign(num * num * num, 0);
+	linearMaterial.assign(num * num * num, 0);
+
+	TDensityVal minDensity = 255;
+	TDensityVal maxDensity = 0;
+	for (int x = 0; x < num; x++) {
+		for (int y = 0; y < num; y++) {
+			const double wx = origin[0] + x * step - BENCH_ZONE_SIZE / 2;
+			const double wy = origin[1] + y * step - BENCH_ZONE_SIZE / 2;
+			const double ground = groundLevel(wx, wy);
+
+			for (int z = 0; z < num; z++) {
+				const double wz = origin[2] + z * step - BENCH_ZONE_SIZE / 2;
+				const double depth = ground - wz;
+				const double d = std::min(1.0, std::max(0.0, 0.5 + depth / (step * 2)));
+				const TDensityVal density = (TDensityVal)(d * 255);
+				const unsigned short material = (depth > 0) ? materialAt(wx, wy, wz, depth) : 0;
+
+				zone.density.set(x, y, z, density);
+				zone.material.set(x, y, z, material);
+
+				const int i = (x * num + y) * num + z;
+				linearDensity[i] = density;
+				linearMaterial[i] = material;
+
+				minDensity = std::min(minDensity, density);
+				maxDensity = std::max(maxDensity, density);
+			}
+		}
+	}
+
+	zone.bMixed = minDensity != maxDensity;
+}
+
+// 8 corners of every cell, as mesher reads them
+static unsigned long long readCorners(const TBenchZone& zone) {
+	const int num = BENCH_ZONE_DIMENSION;
+	unsigned long long sum = 0;
+	for (int x = 1; x < num; x++) {
+		for (int y = 1; y < num; y++) {
+			for (int z = 1; z < num; z++) {
+				sum += zone.density.get(x, y, z) + zone.density.get(x - 1, y, z) + zone.density.get(x, y - 1, z) + zone.density.get(x, y, z - 1) +
+					zone.density.get(x - 1, y - 1, z) + zone.density.get(x - 1, y, z - 1) + zone.density.get(x, y - 1, z - 1) + zone.density.get(x - 1, y - 1, z - 1);
+			}
+		}
+	}
+
+	return sum;
+}
+
+// corner case of every cell, material of surface cells
+static unsigned long long extractCells(const TBenchZone& zone, unsigned long long& sum) {
+	static const int corner[8][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } };
+
+	const int num = BENCH_ZONE_DIMENSION;
+	unsigned long long surfaceCells = 0;
+	for (int x = 0; x < num - 1; x++) {
+		for (int y = 0; y < num - 1; y++) {
+			for (int z = 0; z < num - 1; z++) {
+				int caseIndex = 0;
+				for (int c = 0; c < 8; c++) {
+					if (zone.density.get(x + corner[c][0], y + corner[c][1], z + corner[c][2]) > BENCH_ISOLEVEL) caseIndex |= 1 << c;
+				}
+
+				if (caseIndex == 0 || caseIndex == 255) continue;
+
+				surfaceCells++;
+				for (int c = 0; c < 8; c++) {
+					sum += zone.material.get(x + corner[c][0], y + corner[c][1], z + corner[c][2]);
+				}
+			}
+		}
+	}
+
+	return surfaceCells;
+}
+
+static void benchZone(int n, TBenchTimes& times, int& mixedCount) {
+	TBenchZone zone;
+	std::vector<TDensityVal> linearDensity;
+	std::vector<unsigned short> linearMaterial;
+
+	double start = seconds();
+	generateZone(n, zone, linearDensity, linearMaterial);
+	times.generation += seconds() - start;
+
+	if (!zone.bMixed) {
+		return;
+	}
+
+	mixedCount++;
+
+	start = seconds();
+	TBenchZone imported;
+	imported.density.import(BENCH_ZONE_DIMENSION, linearDensity.data());
+	imported.material.import(BENCH_ZONE_DIMENSION, linearMaterial.data());
+	times.import += seconds() - start;
+
+	zone.density.compact();
+	zone.material.compact();
+	times.memory += zone.density.memoryUsage() + zone.material.memoryUsage();
+
+	start = seconds();
+	times.sum += readCorners(zone);
+	times.corners += seconds() - start;
+
+	start = seconds();
+	times.surfaceCells += extractCells(zone, times.sum);
+	times.cells += seconds() - start;
+}
+
+int main(int argc, char* argv[]) {
+	const int zoneCount = (argc > 1) ? std::max(1, atoi(argv[1])) : 50;
+
+	TBenchTimes times;
+	int mixedCount = 0;
+	for (int n = 0; n < zoneCount; n++) {
+		benchZone(n, times, mixedCount);
+	}
+
+	const double zones = (mixedCount > 0) ? mixedCount : 1;
+	printf("layout %s, brick %d^3, zone %d^3\n\n", VD_LAYOUT_NAME, VD_BRICK_SIZE, BENCH_ZONE_DIMENSION);
+	printf("%-12s -> %d zones, %d mixed, %10.3f ms/zone\n", "generation", zoneCount, mixedCount, times.generation * 1000 / zoneCount);
+	printf("%-12s -> %10.3f ms/zone\n", "import", times.import * 1000 / zones);
+	printf("%-12s -> %10.3f ms/zone\n", "corners", times.corners * 1000 / zones);
+	printf("%-12s -> %10.3f ms/zone, %llu surface cells/zone\n", "cells", times.cells * 1000 / zones, (unsigned long long)(times.surfaceCells / zones));
+	printf("%-12s -> %10llu bytes/zone (%llu)\n", "memory", (unsigned long long)(times.memory / zones), times.sum);
+
+	const TVoxelBufferPoolStats poolStats = TVoxelBufferPool::instance().getStats();
+	printf("%-12s -> %llu slab bytes, %llu used, %llu free\n", "pool", (unsigned long long)poolStats.slabBytes, (unsigned long long)poolStats.usedBytes, (unsigned long long)poolStats.freeBytes);
+	return 0;
+}
@@ -0,0 +1,409 @@
+//
+// Standalone voxel storage tests (no engine dependencies)
+//
+// voxel layout is compile-time, build and run once per VD_BRICK_LAYOUT:
+// build: g++ -std=c++17 -O2 -pthread -DVD_BRICK_LAYOUT=0 -I../EngineStub -I../../Source/UnrealSandboxTerrain/Public voxel_test.cpp ../../Source/UnrealSandboxTerrain/Private/VoxelBufferPool.cpp -o voxel_test_tiled
+// build: g++ -std=c++17 -O2 -pthread -DVD_BRICK_LAYOUT=1 -I../EngineStub -I../../Source/UnrealSandboxTerrain/Public voxel_test.cpp ../../Source/UnrealSandboxTerrain/Private/VoxelBufferPool.cpp -o voxel_test_morton
+// usage: ./voxel_test_tiled [test]
+//
+// exit code is number of failed tests
+//
+
+#include "VoxelBrickArray.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define TEST_ZONE_DIMENSION 65 // USBT_ZONE_DIMENSION, last brick of each axis is partial
+
+//============================================================================
+// Helpers
+//============================================================================
+
+static int failedChecks = 0;
+
+#define TEST_CHECK(expr) \
+	if (!(expr)) { \
+		printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+		failedChecks++; \
+	}
+
+static int linearIndex(int num, int x, int y, int z) {
+	return (x * num + y) * num + z;
+}
+
+// surface like zone: solid below wavy ground, some single voxels
+static std::vector<TDensityVal> testDensity(int num) {
+	std::vector<TDensityVal> density(num * num * num);
+	for (int x = 0; x < num; x++) {
+		for (int y = 0; y < num; y++) {
+			const int ground = num / 2 + (x * 7 + y * 3) % 9 - 4;
+			for (int z = 0; z < num; z++) {
+				density[linearIndex(num, x, y, z)] = (z < ground) ? 255 : ((z == ground) ? (TDensityVal)(x + y) : 0);
+			}
+		}
+	}
+
+	return density;
+}
+
+//============================================================================
+// Tests
+//============================================================================
+
+// linear voxels are the same after import and export of all or some x planes,
+// uniform bricks take no voxels from pool. brick relative index maps back to voxel
+static void testBrickImportExport() {
+	const int num = TEST_ZONE_DIMENSION;
+	const std::vector<TDensityVal> density = testDensity(num);
+
+	TBrickArray<TDensityVal> bricks;
+	bricks.import(num, density.data());
+
+	bool bSame = true;
+	for (int x = 0; x < num; x++) {
+		for (int y = 0; y < num; y++) {
+			for (int z = 0; z < num; z++) {
+				bSame = bSame && bricks.get(x, y, z) == density[linearIndex(num, x, y, z)];
+			}
+		}
+	}
+
+	TEST_CHECK(bSame);
+
+	std::vector<TDensityVal> exported(density.size(), 1);
+	bricks.exportPlanes(num, 0, num - 1, exported.data());
+	TEST_CHECK(exported == density);
+
+	// planes of partial brick and planes across bricks, written from start of buffer
+	for (int minX : { 3, 60, 64 }) {
+		const int maxX = std::min(minX + 9, num - 1);
+		const size_t plane = num * num;
+		std::vector<TDensityVal> planes((maxX - minX + 1) * plane, 1);
+		bricks.exportPlanes(num, minX, maxX, planes.data());
+		TEST_CHECK(std::memcmp(planes.data(), density.data() + minX * plane, planes.size()) == 0);
+	}
+
+	// ground crosses only some bricks
+	const int brickNum = (num + VD_BRICK_MASK) >> VD_BRICK_SHIFT;
+	TBrickArray<TDensityVal> uniformBricks;
+	uniformBricks.allocate(num, 0);
+	const size_t headers = uniformBricks.memoryUsage();
+	TEST_CHECK(bricks.memoryUsage() < headers + (size_t)brickNum * brickNum * brickNum * VD_BRICK_VOLUME / 2);
+
+	const std::vector<TDensityVal> solid(density.size(), 255);
+	TBrickArray<TDensityVal> solidBricks;
+	solidBricks.import(num, solid.data());
+	TEST_CHECK(solidBricks.memoryUsage() == headers);
+	TEST_CHECK(solidBricks.get(num - 1, num - 1, num - 1) == 255);
+
+	// material of the same zone by palette bricks
+	std::vector<TMaterialId> material(density.size());
+	for (size_t i = 0; i < material.size(); i++) material[i] = (density[i] == 0) ? 0 : (TMaterialId)(1 + i % 3);
+
+	TPaletteBrickArray materialBricks;
+	materialBricks.import(num, material.data());
+	std::vector<TMaterialId> exportedMaterial(material.size(), 7);
+	materialBricks.exportPlanes(num, 0, num - 1, exportedMaterial.data());
+	TEST_CHECK(exportedMaterial == material);
+	TEST_CHECK(materialBricks.get(num - 1, 0, 0) == material[linearIndex(num, num - 1, 0, 0)]);
+
+	bool bIndexSame = true;
+	bool bBrickRange = true;
+	for (int x = 0; x < num; x++) {
+		for (int y = 0; y < num; y++) {
+			for (int z = 0; z < num; z++) {
+				const int index = brickRelativeIndex(brickNum, x, y, z);
+				const int brick = ((x >> VD_BRICK_SHIFT) * brickNum + (y >> VD_BRICK_SHIFT)) * brickNum + (z >> VD_BRICK_SHIFT);
+				bBrickRange = bBrickRange && index >= brick * VD_BRICK_VOLUME && index < (brick + 1) * VD_BRICK_VOLUME;
+
+				int rx, ry, rz;
+				brickRelativePos(brickNum, index, rx, ry, rz);
+				bIndexSame = bIndexSame && rx == x && ry == y && rz == z;
+			}
+		}
+	}
+
+	TEST_CHECK(bIndexSame);
+	TEST_CHECK(bBrickRange);
+}
+
+// voxel of one brick array by index in brick
+static void brickPos(int i, int& x, int& y, int& z) {
+	x = i / (VD_BRICK_SIZE * VD_BRICK_SIZE);
+	y = (i / VD_BRICK_SIZE) % VD_BRICK_SIZE;
+	z = i % VD_BRICK_SIZE;
+}
+
+static bool brickEquals(const TPaletteBrickArray& bricks, const std::vector<TMaterialId>& expected) {
+	for (int i = 0; i < VD_BRICK_VOLUME; i++) {
+		int x, y, z;
+		brickPos(i, x, y, z);
+		if (bricks.get(x, y, z) != expected[i]) return false;
+	}
+
+	return true;
+}
+
+// smallest index width of distinct values, as brick widens on write
+static int paletteBits(int distinct) {
+	if (distinct > (1 << VD_PALETTE_MAX_BITS)) return VD_RAW_BITS;
+
+	int bits = 1;
+	while ((1 << bits) < distinct) bits *= 2;
+	return bits;
+}
+
+// every new value widens brick when palette is full: 1 -> 2 -> 4 -> 8 bits -> raw values.
+// voxels keep values on each widen, compact packs brick back to smallest width or uniform value
+static void testPaletteWiden() {
+	TPaletteBrickArray bricks;
+	bricks.allocate(VD_BRICK_SIZE, 0);
+	const size_t headers = bricks.memoryUsage();
+
+	std::vector<TMaterialId> expected(VD_BRICK_VOLUME, 0);
+	bool bSame = true;
+	bool bWidth = true;
+	for (int i = 1; i < 300; i++) {
+		int x, y, z;
+		brickPos(i, x, y, z);
+		expected[i] = (TMaterialId)(i * 3 + 1);
+		bricks.set(x, y, z, expected[i]);
+
+		bSame = bSame && brickEquals(bricks, expected);
+		bWidth = bWidth && bricks.memoryUsage() == headers + VD_PALETTE_BLOCK_WORDS(paletteBits(i + 1)) * sizeof(uint32);
+	}
+
+	TEST_CHECK(bSame);
+	TEST_CHECK(bWidth);
+
+	// known value doesn't widen raw brick
+	bricks.set(0, 0, 0, expected[5]);
+	expected[0] = expected[5];
+	TEST_CHECK(brickEquals(bricks, expected));
+
+	bricks.compact();
+	TEST_CHECK(brickEquals(bricks, expected));
+	TEST_CHECK(bricks.memoryUsage() == headers + VD_PALETTE_BLOCK_WORDS(VD_RAW_BITS) * sizeof(uint32));
+
+	// two values left
+	for (int i = 1; i < VD_BRICK_VOLUME; i++) {
+		int x, y, z;
+		brickPos(i, x, y, z);
+		expected[i] = 7;
+		bricks.set(x, y, z, 7);
+	}
+
+	bricks.compact();
+	TEST_CHECK(brickEquals(bricks, expected));
+	TEST_CHECK(bricks.memoryUsage() == headers + VD_PALETTE_BLOCK_WORDS(1) * sizeof(uint32));
+
+	// new value after compact widens again
+	bricks.set(1, 2, 3, 9);
+	expected[(1 * VD_BRICK_SIZE + 2) * VD_BRICK_SIZE + 3] = 9;
+	TEST_CHECK(brickEquals(bricks, expected));
+	TEST_CHECK(bricks.memoryUsage() == headers + VD_PALETTE_BLOCK_WORDS(2) * sizeof(uint32));
+
+	bricks.set(1, 2, 3, 7);
+	bricks.set(0, 0, 0, 7);
+	bricks.compact();
+	TEST_CHECK(bricks.memoryUsage() == headers);
+	TEST_CHECK(bricks.get(VD_BRICK_MASK, VD_BRICK_MASK, VD_BRICK_MASK) == 7);
+
+	// import picks the same width: full 8 bit palette and one value more
+	for (int distinct : { 2, 3, 16, 17, 256, 257 }) {
+		std::vector<TMaterialId> values(VD_BRICK_VOLUME);
+		for (int i = 0; i < VD_BRICK_VOLUME; i++) values[i] = (TMaterialId)(1000 + i % distinct);
+
+		// import order is linear, brick order is layout order
+		std::vector<TMaterialId> linear(VD_BRICK_VOLUME);
+		for (int i = 0; i < VD_BRICK_VOLUME; i++) {
+			int x, y, z;
+			brickPos(i, x, y, z);
+			linear[linearIndex(VD_BRICK_SIZE, x, y, z)] = values[i];
+		}
+
+		TPaletteBrickArray imported;
+		imported.import(VD_BRICK_SIZE, linear.data());
+		TEST_CHECK(brickEquals(imported, values));
+		TEST_CHECK(imported.memoryUsage() == headers + VD_PALETTE_BLOCK_WORDS(paletteBits(distinct)) * sizeof(uint32));
+	}
+}
+
+static uint64 poolUsedBytes() {
+	return TVoxelBufferPool::instance().getStats().usedBytes;
+}
+
+// share() copy and source see their own writes only. shared brick is copied once by first writer,
+// writes of the same value copy nothing. all bricks return to pool with the last owner
+static void testCowShare() {
+	const uint64 usedStart = poolUsedBytes();
+	{
+		TBrickArray<TDensityVal> source;
+		source.allocate(16, 0);
+		source.set(1, 1, 1, 5);
+		const uint64 brickBytes = poolUsedBytes() - usedStart;
+		TEST_CHECK(brickBytes > 0);
+
+		TBrickArray<TDensityVal> snapshot = source.share();
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes);
+
+		snapshot.set(1, 1, 1, 5);
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes);
+
+		snapshot.set(2, 2, 2, 6);
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes * 2);
+		snapshot.set(3, 3, 3, 7);
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes * 2);
+		TEST_CHECK(source.get(2, 2, 2) == 0);
+		TEST_CHECK(source.get(3, 3, 3) == 0);
+		TEST_CHECK(snapshot.get(1, 1, 1) == 5);
+
+		// source lost ownership by share() too. its copy releases old brick, snapshot has own one already
+		source.set(1, 1, 1, 8);
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes * 2);
+		TEST_CHECK(snapshot.get(1, 1, 1) == 5);
+		TEST_CHECK(source.get(1, 1, 1) == 8);
+
+		// uniform brick of snapshot
+		snapshot.set(9, 9, 9, 1);
+		TEST_CHECK(source.get(9, 9, 9) == 0);
+		TEST_CHECK(snapshot.get(9, 9, 9) == 1);
+
+		TBrickArray<TDensityVal> moved = std::move(snapshot);
+		TEST_CHECK(moved.get(2, 2, 2) == 6);
+		TEST_CHECK(poolUsedBytes() == usedStart + brickBytes * 3);
+
+		TPaletteBrickArray materialSource;
+		materialSource.allocate(16, 1);
+		materialSource.set(1, 1, 1, 2);
+		const size_t sourceUsage = materialSource.memoryUsage();
+
+		TPaletteBrickArray materialSnapshot = materialSource.share();
+
+		// widen of shared brick builds new block, source keeps 1 bit block
+		for (unsigned short value = 3; value < 40; value++) {
+			materialSnapshot.set(value % VD_BRICK_SIZE, value / VD_BRICK_SIZE, 0, value);
+		}
+
+		TEST_CHECK(materialSource.memoryUsage() == sourceUsage);
+		TEST_CHECK(materialSource.get(1, 1, 1) == 2);
+		TEST_CHECK(materialSource.get(3, 0, 0) == 1);
+		TEST_CHECK(materialSnapshot.get(3, 0, 0) == 3);
+		TEST_CHECK(materialSnapshot.get(1, 1, 1) == 2);
+
+		// write of known value copies block at the same width
+		TPaletteBrickArray materialSnapshot2 = materialSource.share();
+		materialSnapshot2.set(2, 2, 2, 2);
+		TEST_CHECK(materialSnapshot2.memoryUsage() == sourceUsage);
+		TEST_CHECK(materialSource.get(2, 2, 2) == 1);
+		TEST_CHECK(materialSnapshot2.get(2, 2, 2) == 2);
+
+		materialSource.set(1, 1, 1, 1);
+		TEST_CHECK(materialSource.get(1, 1, 1) == 1);
+		TEST_CHECK(materialSnapshot.get(1, 1, 1) == 2);
+		TEST_CHECK(materialSnapshot2.get(1, 1, 1) == 2);
+
+		// compact of shared brick leaves other copy
+		materialSource.compact();
+		TEST_CHECK(materialSource.get(1, 1, 1) == 1);
+		TEST_CHECK(materialSnapshot2.get(2, 2, 2) == 2);
+		TEST_CHECK(materialSnapshot2.get(1, 1, 1) == 2);
+	}
+
+	TEST_CHECK(poolUsedBytes() == usedStart);
+}
+
+// freed buffer is reused by next allocation of its size class, used and free bytes follow,
+// bigger buffers bypass pool
+static void testPoolReuse() {
+	TVoxelBufferPool& pool = TVoxelBufferPool::instance();
+	const TVoxelBufferPoolStats start = pool.getStats();
+
+	void* buffer = pool.allocate(100);
+	TEST_CHECK(pool.getStats().usedBytes == start.usedBytes + 112);
+
+	pool.free(buffer, 100);
+	TVoxelBufferPoolStats stats = pool.getStats();
+	TEST_CHECK(stats.usedBytes == start.usedBytes);
+	TEST_CHECK(stats.freeBytes == start.freeBytes + 112);
+
+	// the same class
+	void* reused = pool.allocate(110);
+	TEST_CHECK(reused == buffer);
+	stats = pool.getStats();
+	TEST_CHECK(stats.usedBytes == start.usedBytes + 112);
+	TEST_CHECK(stats.freeBytes == start.freeBytes);
+
+	// other class doesn't take it
+	pool.free(reused, 110);
+	void* other = pool.allocate(200);
+	TEST_CHECK(other != buffer);
+	pool.free(other, 200);
+
+	// last freed is first reused
+	void* first = pool.allocate(64);
+	void* second = pool.allocate(64);
+	TEST_CHECK(first != second);
+	pool.free(first, 64);
+	pool.free(second, 64);
+	TEST_CHECK(pool.allocate(64) == second);
+	TEST_CHECK(pool.allocate(64) == first);
+	pool.free(first, 64);
+	pool.free(second, 64);
+
+	const uint64 slabBytes = pool.getStats().slabBytes;
+	void* big = pool.allocate(VD_POOL_MAX_SIZE + 1);
+	TEST_CHECK(pool.getStats().usedBytes == start.usedBytes);
+	pool.free(big, VD_POOL_MAX_SIZE + 1);
+
+	// brick buffers come back with the last shared owner
+	TDensityVal* brick = nullptr;
+	{
+		std::shared_ptr<TDensityVal> data = pool.allocateShared<TDensityVal, VD_BRICK_VOLUME>();
+		std::shared_ptr<TDensityVal> copy = data;
+		brick = data.get();
+		data.reset();
+		TEST_CHECK(pool.getStats().usedBytes > start.usedBytes);
+	}
+
+	TEST_CHECK(pool.getStats().usedBytes == start.usedBytes);
+	std::shared_ptr<TDensityVal> data = pool.allocateShared<TDensityVal, VD_BRICK_VOLUME>();
+	TEST_CHECK(data.get() == brick);
+	data.reset();
+
+	stats = pool.getStats();
+	TEST_CHECK(stats.usedBytes == start.usedBytes);
+	TEST_CHECK(stats.slabBytes == slabBytes);
+}
+
+typedef struct TTestCase {
+	const char* name;
+	void (*run)();
+} TTestCase;
+
+static TTestCase testList[] = {
+	{ "brick_import_export", testBrickImportExport },
+	{ "palette_widen", testPaletteWiden },
+	{ "cow_share", testCowShare },
+	{ "pool_reuse", testPoolReuse }
+};
+
+int main(int argc, char* argv[]) {
+	int failedTests = 0;
+	printf("layout %s\n", VD_LAYOUT_NAME);
+
+	for (const TTestCase& test : testList) {
+		if (argc > 1 && strcmp(argv[1], test.name) != 0) continue;
+
+		const int checksBefore = failedChecks;
+		test.run();
+
+		const bool bPassed = failedChecks == checksBefore;
+		printf("%s %s\n", bPassed ? "ok    " : "FAILED", test.name);
+		if (!bPassed) failedTests++;
+	}
+
+	return failedTests;
+}